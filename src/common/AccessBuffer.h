@@ -0,0 +1,46 @@
+/////////////////////////////////////////////////////////////////
+//  TaskSanitizer: a lightweight determinacy race checking
+//          tool for OpenMP task applications
+//
+//    Copyright (c) 2015 - 2018 Hassan Salehe Matar
+//      Copying or using this code by any means whatsoever
+//      without consent of the owner is strictly prohibited.
+//
+//   Contact: hassansalehe-at-gmail-dot-com
+//
+/////////////////////////////////////////////////////////////////
+
+// Defines the layout of the thread-local buffer of memory accesses
+// used when accesses are logged in batches. Instrumented code stores
+// access records into the buffer with inline stores and calls
+// __tasksan_flush_accesses at the end of each batch. The layout is
+// shared by the instrumentation pass and the runtime.
+
+#ifndef _COMMON_ACCESSBUFFER_H_
+#define _COMMON_ACCESSBUFFER_H_
+
+namespace tasksan {
+
+// number of records in the buffer, i.e. the largest batch
+const unsigned ACCESS_BUFFER_SIZE = 64;
+
+// flag of AccessRecord::kind for writes; the other bits hold the size
+const unsigned ACCESS_WRITE = 1u << 31;
+
+// a single memory access: { i8*, i64, i32, i32 } in the IR
+struct AccessRecord {
+  void *    addr;    // accessed address
+  long      value;   // value written, 0 for reads
+  int       lineNo;  // source-line number
+  unsigned  kind;    // size in bytes | ACCESS_WRITE
+};
+
+/**
+ * Returns the name of the thread-local buffer of access records
+ */
+inline const char * getAccessBufferName() {
+  return "__tasksan_access_buffer";
+}
+} // end namespace
+
+#endif
@@ -0,0 +1,162 @@
+/////////////////////////////////////////////////////////////////
+//  TaskSanitizer: a lightweight determinacy race checking
+//          tool for OpenMP task applications
+//
+//    Copyright (c) 2015 - 2018 Hassan Salehe Matar
+//      Copying or using this code by any means whatsoever
+//      without consent of the owner is strictly prohibited.
+//
+//   Contact: hassansalehe-at-gmail-dot-com
+//
+/////////////////////////////////////////////////////////////////
+
+// Defines a fast compressor of blocks of at most 64 KB in the manner
+// of LZ4, for traces. A compressed block is a list of sequences: a
+// token byte with the number of literals in its high and the length
+// of the match minus 4 in its low nibble, more bytes of either length
+// if the nibble is 15 (255 each until a smaller one), the literals,
+// then the 16-bit offset of the match back in the block. The last
+// sequence ends after its literals.
+
+#ifndef _COMMON_BLOCKCOMPRESSOR_H_
+#define _COMMON_BLOCKCOMPRESSOR_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+
+namespace tasksan {
+namespace compress {
+
+const unsigned MIN_MATCH  = 4;
+const unsigned MAX_OFFSET = 0xffff;
+const unsigned HASH_BITS  = 12;
+
+/**
+ * Returns the most bytes "size" bytes compress to */
+inline unsigned long getMaxCompressedSize(unsigned long size) {
+  return size + size / 255 + 16;
+}
+
+/** Stores "length" beyond a nibble of 15 */
+inline unsigned char * putLength(unsigned char * out, unsigned long length) {
+  for (; length >= 255; length -= 255) *out++ = 255;
+  *out++ = (unsigned char)length;
+  return out;
+}
+
+/**
+ * Stores a sequence of "literalCount" bytes at "literals" followed
+ * by a match of "matchLength" bytes "offset" bytes back, or none if
+ * "matchLength" is 0 */
+inline unsigned char * putSequence(unsigned char * out,
+    const unsigned char * literals, unsigned long literalCount,
+    unsigned long offset, unsigned long matchLength) {
+  unsigned long matchCode = matchLength ? matchLength - MIN_MATCH : 0;
+  unsigned char * token = out++;
+  *token = (unsigned char)((std::min(literalCount, 15ul) << 4) |
+                           std::min(matchCode, 15ul));
+  if (literalCount >= 15) out = putLength(out, literalCount - 15);
+  memcpy(out, literals, literalCount);
+  out += literalCount;
+  if (matchLength) {
+    *out++ = (unsigned char)offset;
+    *out++ = (unsigned char)(offset >> 8);
+    if (matchCode >= 15) out = putLength(out, matchCode - 15);
+  }
+  return out;
+}
+
+/**
+ * Compresses "size" bytes at "source" into "dest", which has room
+ * for getMaxCompressedSize(size). Returns the compressed size. */
+inline unsigned long compressBlock(const char * source, unsigned long size,
+                                   char * dest) {
+  const unsigned char * in = (const unsigned char *)source;
+  unsigned char * out = (unsigned char *)dest;
+  uint32_t positions[1 << HASH_BITS];  // last position of 4 bytes
+  memset(positions, 0, sizeof(positions));
+
+  unsigned long anchor = 0, pos = 0;
+  unsigned long limit = size > MIN_MATCH ? size - MIN_MATCH : 0;
+  while (pos < limit) {
+    uint32_t bytes, candidateBytes;
+    memcpy(&bytes, in + pos, sizeof(bytes));
+    uint32_t hash = (bytes * 2654435761u) >> (32 - HASH_BITS);
+    unsigned long candidate = positions[hash];
+    positions[hash] = pos;
+    memcpy(&candidateBytes, in + candidate, sizeof(candidateBytes));
+    if (candidate >= pos || pos - candidate > MAX_OFFSET ||
+        candidateBytes != bytes) {
+      pos++;
+      continue;
+    }
+
+    unsigned long length = MIN_MATCH;
+    while (pos + length < size && in[candidate + length] == in[pos + length]) {
+      length++;
+    }
+    out = putSequence(out, in + anchor, pos - anchor, pos - candidate, length);
+    pos += length;
+    anchor = pos;
+  }
+  out = putSequence(out, in + anchor, size - anchor, 0, 0);
+  return out - (unsigned char *)dest;
+}
+
+/** Loads a length beyond a nibble of 15, false if past "end" */
+inline bool getLength(const unsigned char *& in, const unsigned char * end,
+                      unsigned long & length) {
+  unsigned char byte;
+  do {
+    if (in >= end) return false;
+    byte = *in++;
+    length += byte;
+  } while (byte == 255);
+  return true;
+}
+
+/**
+ * Decompresses "size" bytes at "source" into "dest" of "capacity"
+ * bytes. Returns the decompressed size, or -1 if the block is
+ * corrupt. */
+inline long decompressBlock(const char * source, unsigned long size,
+                            char * dest, unsigned long capacity) {
+  const unsigned char * in = (const unsigned char *)source;
+  const unsigned char * end = in + size;
+  unsigned char * out = (unsigned char *)dest;
+  unsigned char * outEnd = out + capacity;
+
+  while (in < end) {
+    unsigned char token = *in++;
+    unsigned long literalCount = token >> 4;
+    if (literalCount == 15 && !getLength(in, end, literalCount)) return -1;
+    if ((unsigned long)(end - in) < literalCount ||
+        (unsigned long)(outEnd - out) < literalCount) {
+      return -1;
+    }
+    memcpy(out, in, literalCount);
+    in += literalCount;
+    out += literalCount;
+    if (in == end) break; // the last sequence
+
+    if (end - in < 2) return -1;
+    unsigned long offset = in[0] | (in[1] << 8);
+    in += 2;
+    unsigned long length = token & 15;
+    if (length == 15 && !getLength(in, end, length)) return -1;
+    length += MIN_MATCH;
+    if (offset == 0 || offset > (unsigned long)(out - (unsigned char *)dest) ||
+        (unsigned long)(outEnd - out) < length) {
+      return -1;
+    }
+    const unsigned char * match = out - offset;
+    for (unsigned long i = 0; i < length; i++) out[i] = match[i]; // overlaps
+    out += length;
+  }
+  return out - (unsigned char *)dest;
+}
+} // end namespace compress
+} // end namespace tasksan
+
+#endif // end BlockCompressor.h
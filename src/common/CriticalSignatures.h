@@ -28,6 +28,14 @@ inline std::string getStartCriticalSignature() {
 inline std::string getEndCriticalSignature() {
   return "TASKSAN:EndCriticalSection";
 }
+
+/*
+ * Returns a string signature which, followed by the name of a
+ * function, starts the critical sections of the function
+ */
+inline std::string getFunctionSignature() {
+  return "TASKSAN:Function ";
+}
 } // end namespace
 
 #endif
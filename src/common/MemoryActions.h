@@ -12,6 +12,8 @@
 //
 // This class holds the first action to a memory location and the last
 // write action. Every new write action replaces the previous write.
+// The checker keeps these per shadow cell of 8 bytes, with a mask of
+// the bytes of the cell the action accessed.
 
 #ifndef _COMMON_MEMORYACTIONS_H_
 #define _COMMON_MEMORYACTIONS_H_
@@ -26,6 +28,7 @@ class MemoryActions {
 
     int taskId;
     ADDRESS addr;     // destination address
+    unsigned char mask = 0; // bytes of the shadow cell accessed
 
     // Default constructor
     MemoryActions() {
@@ -0,0 +1,40 @@
+/////////////////////////////////////////////////////////////////
+//  TaskSanitizer: a lightweight determinacy race checking
+//          tool for OpenMP task applications
+//
+//    Copyright (c) 2015 - 2018 Hassan Salehe Matar
+//      Copying or using this code by any means whatsoever
+//      without consent of the owner is strictly prohibited.
+//
+//   Contact: hassansalehe-at-gmail-dot-com
+//
+/////////////////////////////////////////////////////////////////
+
+// Defines the bits of the thread-local runtime state word shared by
+// the instrumentation pass and the runtime. Instrumented code loads
+// the word before each memory access callback and calls the runtime
+// only if the word equals STATE_CHECKING.
+
+#ifndef _COMMON_RUNTIMESTATE_H_
+#define _COMMON_RUNTIMESTATE_H_
+
+namespace tasksan {
+
+enum RuntimeState : unsigned {
+  STATE_ENABLED     = 1u << 0,  // the tool is not disabled
+  STATE_TASK_ACTIVE = 1u << 1,  // the thread runs an active task
+  STATE_IGNORED     = 1u << 2,  // the thread is in an ignored region
+
+  // accesses are checked only in this state
+  STATE_CHECKING    = STATE_ENABLED | STATE_TASK_ACTIVE
+};
+
+/**
+ * Returns the name of the thread-local state word
+ */
+inline const char * getStateWordName() {
+  return "__tasksan_state";
+}
+} // end namespace
+
+#endif
@@ -0,0 +1,208 @@
+/////////////////////////////////////////////////////////////////
+//  TaskSanitizer: a lightweight determinacy race checking
+//          tool for OpenMP task applications
+//
+//    Copyright (c) 2015 - 2018 Hassan Salehe Matar
+//      Copying or using this code by any means whatsoever
+//      without consent of the owner is strictly prohibited.
+//
+//   Contact: hassansalehe-at-gmail-dot-com
+//
+/////////////////////////////////////////////////////////////////
+
+// Defines suppression files, shared by the instrumentation pass and
+// the runtime. Each line of a file is a rule, blank lines and lines
+// starting with '#' aside:
+//   fun:<function glob>[:<lines>]
+//   src:<file glob>[:<lines>]
+// where <lines> is a line or a range <first>-<last>, all lines if
+// omitted. Globs match demangled function names, as in reports, and
+// absolute source paths with '*' and '?'. The pass leaves accesses of
+// rules uninstrumented. The runtime knows no source files, so it
+// applies fun: rules only: each function is compiled once into a
+// bitmap of its suppressed lines, which accesses test.
+
+#ifndef _COMMON_SUPPRESSIONS_H_
+#define _COMMON_SUPPRESSIONS_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace tasksan {
+namespace suppress {
+
+/**
+ * Returns true if "text" matches "glob", where '*' matches any
+ * characters and '?' any one character */
+inline bool matchGlob(const char * glob, const char * text) {
+  const char * star = NULL;  // last '*' seen, and where it resumes
+  const char * resume = NULL;
+  while (*text) {
+    if (*glob == '*') {
+      star = glob++;
+      resume = text;
+    } else if (*glob == '?' || *glob == *text) {
+      glob++;
+      text++;
+    } else if (star) {
+      glob = star + 1;
+      text = ++resume;
+    } else {
+      return false;
+    }
+  }
+  while (*glob == '*') glob++;
+  return *glob == '\0';
+}
+
+// the suppressed lines of a function
+struct SiteBitmap {
+  bool allLines = false;
+  std::vector<uint64_t> words;
+
+  inline bool test(long line) const {
+    if (allLines) return true;
+    unsigned long word = (unsigned long)line >> 6;
+    return word < words.size() && (words[word] >> (line & 63)) & 1;
+  }
+
+  void set(unsigned first, unsigned last) {
+    if (words.size() <= last >> 6) words.resize((last >> 6) + 1);
+    for (unsigned line = first; line <= last; line++) {
+      words[line >> 6] |= 1ull << (line & 63);
+    }
+  }
+};
+
+class SuppressionList {
+  public:
+    /**
+     * Loads the rules of file "fileName". Returns false and sets
+     * "error" if the file cannot be read or has a bad rule. */
+    bool load(const std::string & fileName, std::string & error) {
+      std::ifstream file(fileName);
+      if (!file) {
+        error = "cannot read " + fileName;
+        return false;
+      }
+      std::string text;
+      for (unsigned lineNo = 1; std::getline(file, text); lineNo++) {
+        size_t start = text.find_first_not_of(" \t");
+        if (start == std::string::npos || text[start] == '#') continue;
+        size_t end = text.find_last_not_of(" \t\r");
+        if ( !parseRule(text.substr(start, end - start + 1)) ) {
+          error = fileName + ":" + std::to_string(lineNo) +
+                  ": bad rule \"" + text + "\"";
+          return false;
+        }
+      }
+      return true;
+    }
+
+    bool empty() const { return rules.empty(); }
+
+    /**
+     * Returns true if all lines of function "funcName" in file
+     * "fileName" are suppressed */
+    bool suppressesFunction(const std::string & funcName,
+                            const std::string & fileName) const {
+      for (const Rule & rule : rules) {
+        if (rule.first == 0 && rule.last == ALL_LINES &&
+            matches(rule, funcName, fileName)) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    /**
+     * Returns true if line "line" of function "funcName" in file
+     * "fileName" is suppressed */
+    bool suppressesLine(const std::string & funcName,
+                        const std::string & fileName, unsigned line) const {
+      for (const Rule & rule : rules) {
+        if (line >= rule.first && line <= rule.last &&
+            matches(rule, funcName, fileName)) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    /**
+     * Compiles the fun: rules of function "funcName" into "bitmap".
+     * Returns false if no line of it is suppressed. */
+    bool compileFunction(const std::string & funcName,
+                         SiteBitmap & bitmap) const {
+      bool suppressed = false;
+      for (const Rule & rule : rules) {
+        if (rule.isFile ||
+            !matchGlob(rule.glob.c_str(), funcName.c_str())) {
+          continue;
+        }
+        if (rule.first == 0 && rule.last == ALL_LINES) {
+          bitmap.allLines = true;
+        } else {
+          bitmap.set(rule.first, rule.last);
+        }
+        suppressed = true;
+      }
+      return suppressed;
+    }
+
+  private:
+    static const unsigned ALL_LINES = ~0u;
+
+    struct Rule {
+      bool isFile;       // src: rather than fun:
+      std::string glob;
+      unsigned first;    // lines suppressed
+      unsigned last;
+    };
+
+    static bool matches(const Rule & rule, const std::string & funcName,
+                        const std::string & fileName) {
+      return matchGlob(rule.glob.c_str(),
+                       rule.isFile ? fileName.c_str() : funcName.c_str());
+    }
+
+    /** Adds rule "text", or returns false if it is malformed */
+    bool parseRule(const std::string & text) {
+      Rule rule;
+      if (text.compare(0, 4, "fun:") == 0) {
+        rule.isFile = false;
+      } else if (text.compare(0, 4, "src:") == 0) {
+        rule.isFile = true;
+      } else {
+        return false;
+      }
+      rule.glob = text.substr(4);
+      rule.first = 0;
+      rule.last = ALL_LINES;
+
+      // the lines follow the last ':' if only digits and '-' follow it
+      size_t colon = rule.glob.rfind(':');
+      if (colon != std::string::npos && colon + 1 < rule.glob.size() &&
+          rule.glob.find_first_not_of("0123456789-", colon + 1) ==
+          std::string::npos) {
+        std::string lines = rule.glob.substr(colon + 1);
+        rule.glob.erase(colon);
+        char * end;
+        rule.first = strtoul(lines.c_str(), &end, 10);
+        rule.last = *end == '-' ? strtoul(end + 1, &end, 10) : rule.first;
+        if (*end || rule.first == 0 || rule.last < rule.first) return false;
+      }
+      if ( rule.glob.empty() ) return false;
+      rules.push_back( rule );
+      return true;
+    }
+
+    std::vector<Rule> rules;
+};
+} // end namespace suppress
+} // end namespace tasksan
+
+#endif // end Suppressions.h
@@ -0,0 +1,140 @@
+/////////////////////////////////////////////////////////////////
+//  TaskSanitizer: a lightweight determinacy race checking
+//          tool for OpenMP task applications
+//
+//    Copyright (c) 2015 - 2018 Hassan Salehe Matar
+//      Copying or using this code by any means whatsoever
+//      without consent of the owner is strictly prohibited.
+//
+//   Contact: hassansalehe-at-gmail-dot-com
+//
+/////////////////////////////////////////////////////////////////
+
+// Defines the binary traces written in record mode, i.e. when the
+// program runs with TASKSAN_RECORD=<path prefix>. Every thread writes
+// its own file <prefix>.<thread>.trace: the magic bytes, version and
+// flags, then events. An event is an EventType byte followed by its
+// fields, as listed below: v is a varint (7 bits per byte, lowest
+// first), z a zigzag varint of a signed value, and d a z of the
+// difference to the same field of the previous access. Events which
+// order tasks carry a sequence number from a counter shared by all
+// threads, so that the traces can be merged, and reset the previous
+// access to 0. Accesses and lock events belong to the task of the
+// last EVENT_SWITCH in the same trace, which carries the counter as it
+// was, i.e. they follow events with lower numbers.
+// With FLAG_COMPRESSED, events are stored in blocks, each a u32 size
+// of its events, a u32 size of the stored bytes and the bytes, which
+// are compressed with common/BlockCompressor.h unless of equal size.
+
+#ifndef _COMMON_TRACEFORMAT_H_
+#define _COMMON_TRACEFORMAT_H_
+
+#include "common/defs.h"
+#include <stdint.h>
+#include <string.h>
+
+namespace tasksan {
+namespace trace {
+
+const char MAGIC[8] = { 'T', 'S', 'A', 'N', 'T', 'R', 'C', 'E' };
+const unsigned VERSION = 3;
+
+// flags of a trace, after the version
+const unsigned FLAG_COMPRESSED = 1;
+
+// the most bytes of events per compressed block
+const unsigned BLOCK_SIZE = 64 << 10;
+
+enum EventType : unsigned char {
+  EVENT_FUNCTION = 1, // v funcID, v length, name
+  EVENT_SITE,         // v siteID, v funcID, z line
+  EVENT_TASK_BEGIN,   // v seq, v taskID
+  EVENT_TASK_END,     // v seq, v taskID
+  EVENT_DEPENDENCE,   // v seq, v parentID, v childID
+  EVENT_JOIN,         // v seq, v childID, v taskID
+  EVENT_SWITCH,       // v seq, v taskID
+  EVENT_READ,         // d addr, d siteID, v size
+  EVENT_WRITE,        // d addr, z value, d siteID, v size | update << 5
+  EVENT_LOCK_ACQUIRE, // v lock
+  EVENT_LOCK_RELEASE, // v lock
+  EVENT_CLEAR,        // v seq, v addr, v size
+  EVENT_IIR_FILE      // v funcID, v length, file name
+};
+
+// the largest event with fixed fields, i.e. all but names
+const unsigned MAX_EVENT_SIZE = 32;
+
+// the previous access, which accesses are encoded against
+struct DeltaState {
+  uint64_t addr = 0;
+  uint64_t site = 0;
+};
+
+/**
+ * Numbers the update of writes in "size | update << 5", with 0 for
+ * plain writes so that their sizes fit a byte */
+inline unsigned encodeUpdate(OPERATION update) {
+  return update == OTHER ? 0 : update + 1;
+}
+inline OPERATION decodeUpdate(unsigned code) {
+  return code == 0 ? OTHER : (OPERATION)(code - 1);
+}
+
+/**
+ * Stores "value" at "buffer" and returns the end of it */
+template<typename T>
+inline char * put(char * buffer, T value) {
+  memcpy(buffer, &value, sizeof(T));
+  return buffer + sizeof(T);
+}
+
+/**
+ * Loads "value" from "buffer" and returns the end of it */
+template<typename T>
+inline const char * get(const char * buffer, T & value) {
+  memcpy(&value, buffer, sizeof(T));
+  return buffer + sizeof(T);
+}
+
+/**
+ * Stores "value" at "buffer" as a varint and returns the end of it */
+inline char * putVarint(char * buffer, uint64_t value) {
+  while (value >= 0x80) {
+    *buffer++ = (char)(value | 0x80);
+    value >>= 7;
+  }
+  *buffer++ = (char)value;
+  return buffer;
+}
+
+/**
+ * Loads varint "value" from "buffer". Returns the end of it, NULL
+ * if it does not end before "end" */
+inline const char * getVarint(const char * buffer, const char * end,
+                              uint64_t & value) {
+  value = 0;
+  for (unsigned shift = 0; buffer < end && shift < 64; shift += 7) {
+    unsigned char byte = *buffer++;
+    value |= (uint64_t)(byte & 0x7f) << shift;
+    if ( !(byte & 0x80) ) return buffer;
+  }
+  return NULL;
+}
+
+/** Maps signed values to varints of similar magnitude */
+inline uint64_t zigzag(int64_t value) {
+  return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+inline int64_t unzigzag(uint64_t value) {
+  return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+/**
+ * Returns the extension of trace files */
+inline const char * getTraceExtension() {
+  return ".trace";
+}
+} // end namespace trace
+} // end namespace tasksan
+
+#endif // end TraceFormat.h
@@ -26,9 +26,12 @@ class Action {
   ADDRESS addr;          // destination address
   VALUE value;           // value written
   VALUE lineNo;          // source-line number
+  uint size = 1;         // number of bytes accessed
   INTEGER funcId;        // the identifier of corresponding function
   std::string funcName;  // source-function name
   bool isWrite;          // true if this action is "write"
+  int lockSetID = 0;     // ID of the set of locks held (see lockSets.h)
+  OPERATION update = OTHER; // kind of atomic update, OTHER if plain
 
   Action(INTEGER tskId, VALUE val, VALUE ln, INTEGER fuId):
     taskId(tskId), value(val), lineNo(ln), funcId(fuId) {}
@@ -71,6 +71,14 @@ enum OPERATION {
   MUL,
   DIV,
   SHL,
+  AND,
+  OR,
+  XOR,
+  MIN,
+  MAX,
+  CMP,
+  SELECT,
+  OTHER,
 };
 
 static std::string OperRepresentation(OPERATION op) {
@@ -89,6 +97,13 @@ static std::string OperRepresentation(OPERATION op) {
     case MUL: return "MUL";
     case DIV: return "DIV";
     case SHL: return "SHL";
+    case AND: return "AND";
+    case OR: return "OR";
+    case XOR: return "XOR";
+    case MIN: return "MIN";
+    case MAX: return "MAX";
+    case CMP: return "CMP";
+    case SELECT: return "SELECT";
     default:
       return "UNKNOWN";
   }
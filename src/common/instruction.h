@@ -26,6 +26,8 @@ class Instruction {
   OPERATION oper;
   std::string operand1;
   std::string operand2;
+  std::string condition;  // i1 condition of a select
+  std::string predicate;  // predicate of a comparison
 
   // raw representation of instruction
   std::string raw;
@@ -33,16 +35,22 @@ class Instruction {
   /**
    * Default constructor
    */
-  Instruction() {}
+  Instruction(): lineNo(0), oper(OTHER) {}
   /**
    * This constructor takes in IIR representation of an
    * instruction and constructs an object representaion of it. */
   Instruction(std::string stmt) {
 
     raw = trim( stmt );
+    oper = OTHER;
     std::vector<std::string> contents = splitInstruction( raw );
 
-    if (contents[0] == "store") {
+    if (contents[0] == "call" || contents[0] == "tail" ||
+        contents[0] == "notail" || contents[0] == "musttail") {
+      oper = CALL;
+    } else if (contents.size() < 3) {
+      // e.g. "ret void", not relevant for commutativity
+    } else if (contents[0] == "store") {
       oper = STORE;
       destination = contents[4];
       operand1 = contents[2];
@@ -98,8 +106,48 @@ class Instruction {
       oper = BITCAST;
       operand1 = contents[4];
       operand2 = contents[4];
-    } else if (contents[0] == "call") {
-      oper = CALL;
+    } else if (contents[2] == "and" || contents[2] == "or" ||
+               contents[2] == "xor") {
+      // <result> = and <ty> <op1>, <op2>          ; yields {ty}:result
+      size_t k = skipFlags(contents, 3);
+      destination = contents[0];
+      oper = (contents[2] == "and") ? AND :
+               ((contents[2] == "or") ? OR : XOR);
+      type = at(contents, k);
+      operand1 = at(contents, k + 1);
+      operand2 = at(contents, k + 2);
+    } else if (contents[2] == "icmp" || contents[2] == "fcmp") {
+      // <result> = icmp <cond> <ty> <op1>, <op2>  ; yields i1:result
+      size_t k = skipFlags(contents, 3);
+      destination = contents[0];
+      oper = CMP;
+      predicate = at(contents, k);
+      type = at(contents, k + 1);
+      operand1 = at(contents, k + 2);
+      operand2 = at(contents, k + 3);
+    } else if (contents[2] == "select") {
+      // <result> = select i1 <cond>, <ty> <val1>, <ty> <val2>
+      size_t k = skipFlags(contents, 3);
+      destination = contents[0];
+      oper = SELECT;
+      condition = at(contents, k + 1);
+      type = at(contents, k + 2);
+      operand1 = at(contents, k + 3);
+      operand2 = at(contents, k + 5);
+    } else if (contents[2] == "call" || contents[2] == "tail" ||
+               contents[2] == "notail" || contents[2] == "musttail") {
+      // <result> = call <ty> @llvm.smax.i32(<ty> <op1>, <ty> <op2>)
+      destination = contents[0];
+      oper = getMinMaxIntrinsic();
+      if (oper != CALL) {
+        std::vector<std::string> args = getCallArguments();
+        if (args.size() == 2) {
+          operand1 = args[0];
+          operand2 = args[1];
+        } else {
+          oper = CALL;
+        }
+      }
     }
 
   /*
@@ -143,6 +191,63 @@ class Instruction {
     << std::endl;
   }
 
+  /**
+   * Returns MIN or MAX if this is a call to a minimum or maximum
+   * intrinsic, otherwise CALL. */
+  OPERATION getMinMaxIntrinsic() const {
+    static const std::vector<std::string> maxNames =
+      { "@llvm.smax.", "@llvm.umax.", "@llvm.maxnum.", "@llvm.maximum." };
+    static const std::vector<std::string> minNames =
+      { "@llvm.smin.", "@llvm.umin.", "@llvm.minnum.", "@llvm.minimum." };
+    for (auto & name : maxNames) {
+      if (raw.find(name) != std::string::npos) return MAX;
+    }
+    for (auto & name : minNames) {
+      if (raw.find(name) != std::string::npos) return MIN;
+    }
+    return CALL;
+  }
+
+  /**
+   * Returns the argument values of a call, e.g.
+   * "%1" and "%2" for "call i32 @f(i32 %1, i32 %2)". */
+  std::vector<std::string> getCallArguments() const {
+    std::vector<std::string> args;
+    size_t callee = raw.find('@');
+    if (callee == std::string::npos) return args;
+    size_t open = raw.find('(', callee);
+    size_t close = raw.find(')', open);
+    if (open == std::string::npos || close == std::string::npos) return args;
+
+    std::stringstream ss( raw.substr(open + 1, close - open - 1) );
+    std::string arg;
+    while ( getline(ss, arg, ',') ) {
+      if (arg.find_first_not_of(' ') == std::string::npos) continue;
+      arg = trim( arg );
+      args.push_back( arg.substr(arg.find_last_of(' ') + 1) );
+    }
+    return args;
+  }
+
+  /**
+   * Returns the index of the first token from "k" which is not an
+   * instruction flag such as nuw, nsw, exact or a fast-math flag. */
+  static size_t skipFlags(const std::vector<std::string> & contents,
+                          size_t k) {
+    static const std::set<std::string> flags =
+      { "nuw", "nsw", "exact", "disjoint", "fast", "nnan", "ninf",
+        "nsz", "arcp", "contract", "afn", "reassoc" };
+    while (k < contents.size() && flags.count(contents[k])) k++;
+    return k;
+  }
+
+  /**
+   * Returns token at index "k", or an empty string if missing. */
+  static std::string at(const std::vector<std::string> & contents,
+                        size_t k) {
+    return k < contents.size() ? contents[k] : std::string();
+  }
+
   /**
    * Trims the left and right spaces from a std::string. */
   static std::string trim(std::string sentence) {
@@ -18,17 +18,37 @@
 #include "detector/determinacy/report.h"
 
 /**
- * Parses IIR representation file for critical sections
+ * Registers the .iir file which holds critical sections of a
+ * function. The file is parsed on the first conflict in the function.
  */
-VOID CommutativityChecker::parseTasksIR(char * IRlogName) {
+VOID CommutativityChecker::registerIIRfile(const char * IRlogName,
+                                           const char * funcName) {
+  std::lock_guard<std::mutex> guard( getRegistryLock() );
+  getIIRRegistry().registerFunction(IRlogName, funcName);
+}
+
+/**
+ * Parses IIR representation file for critical sections of its
+ * registered functions
+ */
+VOID CommutativityChecker::parseTasksIR(tasksan::commute::IIRFile & IRlog) {
   std::vector<Instruction>  currentTask;
   std::string               sttmt;             // program statement
-  std::ifstream             IRcode(IRlogName); // open IRlog file
+  std::ifstream             IRcode(IRlog.fileName); // open IRlog file
+  tasksan::commute::CriticalSections * Tasks = nullptr; // of a function
+  size_t                    sectionCount = 0;
 
   while ( getline(IRcode, sttmt) ) {
     if ( isEmpty(sttmt) ) continue;            // skip empty line
     if ( isDebugCall(sttmt) ) continue;        // skip debug call
 
+    if ( isFunctionStart(sttmt) ) {            // sections of a function
+      Tasks = IRlog.find(
+          sttmt.substr(tasksan::getFunctionSignature().size()) );
+      continue;
+    }
+    if (nullptr == Tasks) continue;            // unregistered function
+
     sttmt = Instruction::trim( sttmt );        // trim spaces
     if ( isValidStatement(sttmt) ) {           // check if normal statement
       INTEGER lineNo = getLineNumber( sttmt );
@@ -48,19 +68,24 @@ VOID CommutativityChecker::parseTasksIR(char * IRlogName) {
     }
 
     if ( isCriticalSectionEnd(sttmt) ) {        // end critical sec.
-      Tasks.insert( currentTask );
+      size_t size = Tasks->getSize();
+      Tasks->insert( currentTask );
+      sectionCount += Tasks->getSize() - size;
     }
   } // end while
   IRcode.close();
-  std::cout << "No. of critical sections in IIR: " 
-            << Tasks.getSize() << std::endl;
+  IRlog.loaded = true;
+  std::cout << "No. of critical sections in IIR: "
+            << sectionCount << " (" << IRlog.fileName << ")" << std::endl;
 }
 
 /**
  * Checks for commutative critical sections operations which have been
  * flagged as conflicts.
  */
-bool CommutativityChecker::isCommutative(const Conflict & conflict) {
+bool CommutativityChecker::isCommutative(const Conflict & conflict,
+                                         const std::string & IRlogName1,
+                                         const std::string & IRlogName2) {
 
   // skip commutativity check if read-write conflict
   if (conflict.action1.isWrite != conflict.action2.isWrite) {
@@ -68,114 +93,115 @@ bool CommutativityChecker::isCommutative(const Conflict & conflict) {
   }
   INTEGER line1 = conflict.action1.lineNo;
   INTEGER line2 = conflict.action2.lineNo;
-  operationSet.clear(); // clear set of commuting operations
+  OperationSet operationSet; // set of commuting operations
+  std::lock_guard<std::mutex> guard( getRegistryLock() );
 
   // check if line1 operations commute & line2 operations commute
-  if ( involveSimpleOperations( /*function ID*/ line1 ) &&
-       involveSimpleOperations( /*function ID*/ line2 ) ) {
-    return true;
+  if ( involveSimpleOperations( IRlogName1, conflict.action1.funcName,
+                                line1, operationSet ) &&
+       involveSimpleOperations( IRlogName2, conflict.action2.funcName,
+                                line2, operationSet ) ) {
+    // and if operations of both lines commute with each other
+    return operationSet.isCommutative();
   } else {
     return false;
   }
 }
 
 BOOL CommutativityChecker::involveSimpleOperations(
-    /*std::string taskName,*/
-    INTEGER lineNumber) {
+    const std::string & IRlogName,
+    const std::string & funcName,
+    INTEGER lineNumber,
+    OperationSet & operationSet) {
+
+  // get the .iir file of the function, load it on first use
+  tasksan::commute::IIRFile *IRlog =
+      getIIRRegistry().find(IRlogName, funcName);
+  if (nullptr == IRlog) return false;
+  if ( !IRlog->loaded ) parseTasksIR( *IRlog );
 
   // get the instructions of a task
-  tasksan::commute::CriticalSectionBody *taskBody = Tasks.find(lineNumber);
+  tasksan::commute::CriticalSectionBody *taskBody =
+      IRlog->find(funcName)->find(lineNumber);
   if (nullptr == taskBody) return false;
 
-  Instruction instr;
-  INTEGER index = -1;
-
-  for (auto i = taskBody->begin(); i != taskBody->end(); i++) {
-     if (i->lineNo > lineNumber) break;
-     if (i->lineNo == lineNumber) instr  = *i;
-     index++;
-  }
-  
   // expected to be a store
-  if (instr.oper == STORE) {
-    return isSafe(taskBody->getCriticalSectionBody(),
-        index, instr.operand1);
-    //bool r1 = isOnsimpleOperations(lineNumber - 1, istr.destination);
-    //bool r2 = isOnsimpleOperations(lineNumber - 1, istr.operand1);
+  tasksan::commute::DefUseGraph & graph = taskBody->getGraph();
+  int index = graph.getLastOnLine( lineNumber );
+  if (index >= 0 && graph.getNode( index ).oper == STORE &&
+      isSafe(graph, index)) {
+    operationSet.appendOperations( graph.getStoreOperations(index) );
+    return true;
   }
   return false;
 }
 
+/**
+ * Checks whether the value stored by instruction "store" is computed
+ * only with operations which commute with each other. Walks the
+ * def-use graph of the critical section once, iteratively, and
+ * memoizes the result in the graph.
+ */
 bool CommutativityChecker::isSafe(
-    const std::vector<Instruction> & taskBody,
-    INTEGER loc,
-    std::string operand) {
-
-  if (loc < 0) {
-    if ( !operationSet.size() )              return false;
-    else if ( operationSet.isCommutative() ) return true;
-    else                                     return false;
-  }
-  
-  Instruction instr = taskBody.at(loc);
-  if (instr.oper == ALLOCA && instr.destination == operand) {
-      return true;
-  }
-
-  if (instr.oper == BITCAST) {
-    // destination has been casted from a different address
-    if (instr.destination == operand) {
-      return isSafe(taskBody, loc-1, instr.operand1);
-    } else {
-      return isSafe(taskBody, loc-1, operand);
-    }
-  }
+    tasksan::commute::DefUseGraph & graph,
+    int store) {
 
-  // used as parameter somewhere and might be a pointer
-  if (instr.oper == CALL) {
-    if (instr.raw.find(operand) != std::string::npos) {
-      return false;
-    } else {
-      return isSafe(taskBody, loc-1, operand);
-    }
-  }
-
-  // ADD or SUB or MUL or DIV
-  if (instr.oper == ADD || instr.oper == SUB ||
-      instr.oper == MUL || instr.oper == DIV) {
-    if (instr.destination == operand) {
-
-      // return immediately is operation can not
-      // commute with previous operations
-      if ( !operationSet.isCommutative(instr.oper ) ) {
-        return false;
-      }
-      // append the commutative operation
-      operationSet.appendOperation( instr.oper );
-
-      bool t1 = isSafe(taskBody, loc-1, instr.operand1);
-      bool t2 = isSafe(taskBody, loc-1, instr.operand2);
-      return t1 && t2;
-    } else {
-      return isSafe(taskBody, loc-1, operand);
-    }
+  typedef tasksan::commute::DefUseGraph DefUseGraph;
+  if (graph.getStoreState(store) != DefUseGraph::UNKNOWN_STORE) {
+    return graph.getStoreState(store) == DefUseGraph::SAFE_STORE;
   }
 
-  // STORE
-  if (instr.oper == STORE) {
-    if (instr.destination == operand) {
-      return isSafe(taskBody, loc-1, instr.operand1);
+  OperationSet operationSet;
+  std::vector<bool> visited(graph.getValueCount(), false);
+  std::vector<int> worklist = graph.getNode(store).operands;
+  bool safe = true;
+
+  while (safe && !worklist.empty()) {
+    int valueID = worklist.back();
+    worklist.pop_back();
+    if (visited[valueID]) continue;
+    visited[valueID] = true;
+
+    // used as parameter somewhere and might be a pointer
+    const DefUseGraph::Value & value = graph.getValue(valueID);
+    if (value.firstCallUse < store) {
+      safe = false;
+      break;
     }
-    return isSafe(taskBody, loc-1, operand);
-  }
-
-  // load
-  if (instr.oper == LOAD) {
-    if (instr.destination == operand) {
-      return isSafe(taskBody, loc-1, instr.operand1);
+    // defined outside the critical section
+    if (value.definition < 0) continue;
+
+    const DefUseGraph::Node & def = graph.getNode(value.definition);
+    switch (def.oper) {
+      case ADD: case SUB: case MUL: case DIV:
+      case AND: case OR:  case XOR: case MIN: case MAX:
+        // stop immediately if operation can not
+        // commute with previous operations
+        if ( !operationSet.isCommutative( def.oper ) ) {
+          safe = false;
+          break;
+        }
+        operationSet.appendOperation( def.oper );
+        worklist.insert(worklist.end(),
+                        def.operands.begin(), def.operands.end());
+        break;
+      case CALL:     // result of unknown function
+      case CMP:      // stored value depends on a comparison
+      case SELECT:
+      case SHL:
+        safe = false;
+        break;
+      case ALLOCA:   // local memory of the task
+        break;
+      default:       // LOAD, BITCAST and others forward their operands
+        worklist.insert(worklist.end(),
+                        def.operands.begin(), def.operands.end());
     }
   }
 
-  return isSafe(taskBody, loc-1, operand);
-  // GETEMEMENTSPTR
+  safe = safe && operationSet.size() && operationSet.isCommutative();
+  if (safe) graph.getStoreOperations(store) = operationSet;
+  graph.setStoreState(store, safe ? DefUseGraph::SAFE_STORE
+                                  : DefUseGraph::UNSAFE_STORE);
+  return safe;
 }
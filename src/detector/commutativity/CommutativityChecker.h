@@ -24,21 +24,40 @@
 #include "detector/determinacy/conflict.h"
 #include "detector/determinacy/report.h"
 #include "detector/commutativity/CriticalSections.h"
+#include "detector/commutativity/IIRRegistry.h"
 
 class CommutativityChecker {
 
   public:
-    VOID parseTasksIR(char * IRlogName);
-    bool isCommutative(const Conflict & conflict);
+    static VOID registerIIRfile(const char * IRlogName,
+                                const char * funcName);
+    bool isCommutative(const Conflict & conflict,
+                       const std::string & IRlogName1,
+                       const std::string & IRlogName2);
 
   private:
-    tasksan::commute::CriticalSections Tasks;
-    bool involveSimpleOperations(/*std::string task1, */INTEGER line1);
-    bool isSafe(const std::vector<Instruction> & trace, INTEGER loc,
-                std::string operand);
-    //INTEGER getLineNumber(const std::string & statement);
+    // Registry of .iir files of all instrumented modules. It is a
+    // function-local static since modules register their files from
+    // constructors which may run before any other static is ready.
+    static tasksan::commute::IIRRegistry & getIIRRegistry() {
+      static tasksan::commute::IIRRegistry registry;
+      return registry;
+    }
 
-    OperationSet operationSet;
+    // protects the registry, whose files are loaded on first use,
+    // when checkers run on several threads as in tasksan-check
+    static std::mutex & getRegistryLock() {
+      static std::mutex registryLock;
+      return registryLock;
+    }
+
+    VOID parseTasksIR(tasksan::commute::IIRFile & IRlog);
+    bool involveSimpleOperations(const std::string & IRlogName,
+                                 const std::string & funcName,
+                                 INTEGER line1,
+                                 OperationSet & operationSet);
+    bool isSafe(tasksan::commute::DefUseGraph & graph, int store);
+    //INTEGER getLineNumber(const std::string & statement);
 
     // Helper functions
     inline bool isEmpty(const std::string& statement) {
@@ -61,6 +80,11 @@ class CommutativityChecker {
     inline bool isCriticalSectionEnd(const std::string& sttmt) {
       return tasksan::getEndCriticalSignature() == sttmt;
     }
+
+    inline bool isFunctionStart(const std::string& sttmt) {
+      return sttmt.compare(0, tasksan::getFunctionSignature().size(),
+                           tasksan::getFunctionSignature()) == 0;
+    }
     /**
      * Returns the line number from the IR statement std::string
      */
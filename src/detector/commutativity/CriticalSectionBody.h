@@ -14,6 +14,7 @@
 #define _DETECTOR_COMMUTATIVITY_CRITICALSECTIONBODY_H_
 
 #include "common/instruction.h"
+#include "detector/commutativity/DefUseGraph.h"
 #include <vector>
 #include <string>
 #include <cassert>
@@ -27,6 +28,7 @@ private:
   int                        startLineNo;
   int                        endLineNo;
   std::vector<Instruction>   body;
+  DefUseGraph                graph;
 
 public:
   CriticalSectionBody() {
@@ -39,6 +41,7 @@ public:
       setStartLineNo( _body.front().lineNo );
       setEndLineNo  ( _body.back().lineNo  );
       body = _body;
+      graph.build( body );
     } else {
       throw "Critical section must contain at least one statement";
     }
@@ -53,11 +56,15 @@ public:
 
   void setCriticalSectionBody(std::vector<Instruction> cbody) {
     body = cbody;
+    graph.build( body );
   }
-  std::vector<Instruction> getCriticalSectionBody() {
+  const std::vector<Instruction> & getCriticalSectionBody() const {
     return body;
   }
 
+  // def-use graph of the body, built when the body is set
+  DefUseGraph & getGraph() { return graph; }
+
   std::vector<Instruction>::iterator begin() { return body.begin(); }
   std::vector<Instruction>::iterator   end() { return body.end(); }
 
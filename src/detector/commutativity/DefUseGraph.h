@@ -0,0 +1,199 @@
+/////////////////////////////////////////////////////////////////
+//  TaskSanitizer: a lightweight determinacy race checking
+//          tool for OpenMP task applications
+//
+//    Copyright (c) 2015 - 2018 Hassan Salehe Matar
+//      Copying or using this code by any means whatsoever
+//      without consent of the owner is strictly prohibited.
+//
+//   Contact: hassansalehe-at-gmail-dot-com
+//
+/////////////////////////////////////////////////////////////////
+
+// Defines the def-use graph of a critical section. The graph is
+// built once when the critical section is loaded. SSA names are
+// mapped to integer value IDs so that commutativity queries do
+// not compare strings.
+
+#ifndef _DETECTOR_COMMUTATIVITY_DEFUSEGRAPH_H_
+#define _DETECTOR_COMMUTATIVITY_DEFUSEGRAPH_H_
+
+#include "common/instruction.h"
+#include "detector/determinacy/operationSet.h"
+#include <climits>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace tasksan {
+
+namespace commute {
+
+class DefUseGraph {
+public:
+  // a value (SSA name, global or constant) used in the section
+  struct Value {
+    int definition   = -1;       // defining instruction, -1 if outside
+    int firstCallUse = INT_MAX;  // first call taking it as argument
+  };
+
+  // an instruction of the section
+  struct Node {
+    OPERATION          oper = OTHER;
+    int                destination = -1;  // value ID defined
+    std::vector<int>   operands;          // value IDs it depends on
+  };
+
+  // memoized commutativity results of store instructions
+  enum StoreState : char { UNKNOWN_STORE, SAFE_STORE, UNSAFE_STORE };
+
+  void build(const std::vector<Instruction> & body) {
+    values.clear();
+    nodes.assign(body.size(), Node());
+    lastOnLine.clear();
+    storeStates.assign(body.size(), UNKNOWN_STORE);
+    storeOperations.assign(body.size(), OperationSet());
+    std::unordered_map<std::string, int> ids;
+    std::unordered_map<int, int> lastStoreTo; // pointer ID -> store
+
+    for (size_t i = 0; i < body.size(); i++) {
+      const Instruction & instr = body[i];
+      Node & node = nodes[i];
+      node.oper = instr.oper;
+      lastOnLine[instr.lineNo] = i;
+
+      switch (instr.oper) {
+        case STORE: {
+          // operands: stored value; remember it for later loads
+          int pointer = getValueID(ids, instr.destination);
+          node.operands.push_back( getValueID(ids, instr.operand1) );
+          lastStoreTo[pointer] = i;
+          break;
+        }
+        case LOAD: {
+          // a load reads the value of the last store to the
+          // same pointer in the section, or the pointer itself
+          int pointer = getValueID(ids, instr.operand1);
+          auto store = lastStoreTo.find(pointer);
+          if (store != lastStoreTo.end()) {
+            node.operands = nodes[store->second].operands;
+          } else {
+            node.operands.push_back( pointer );
+          }
+          break;
+        }
+        case SELECT:
+          node.operands.push_back( getValueID(ids, instr.operand1) );
+          node.operands.push_back( getValueID(ids, instr.operand2) );
+          node.oper = getMinMax(body, ids, instr);
+          break;
+        case BITCAST:
+          node.operands.push_back( getValueID(ids, instr.operand1) );
+          break;
+        case CALL:
+          // debug intrinsics do not let values escape
+          if (instr.raw.find("@llvm.dbg.") != std::string::npos) break;
+          for (auto & arg : getNames(instr.raw)) {
+            Value & value = values[ getValueID(ids, arg) ];
+            if (value.firstCallUse == INT_MAX) value.firstCallUse = i;
+          }
+          break;
+        default:
+          if ( !instr.operand1.empty() ) {
+            node.operands.push_back( getValueID(ids, instr.operand1) );
+          }
+          if ( !instr.operand2.empty() ) {
+            node.operands.push_back( getValueID(ids, instr.operand2) );
+          }
+      }
+
+      if ( !instr.destination.empty() && instr.oper != STORE ) {
+        node.destination = getValueID(ids, instr.destination);
+        values[node.destination].definition = i;
+      }
+    }
+  }
+
+  size_t getValueCount() const        { return values.size(); }
+  const Value & getValue(int id) const { return values[id];    }
+  const Node  & getNode(int index) const { return nodes[index]; }
+
+  /**
+   * Returns index of the last instruction on line "lineNo",
+   * -1 if the line is not in the section. */
+  int getLastOnLine(INTEGER lineNo) const {
+    auto last = lastOnLine.find(lineNo);
+    return last == lastOnLine.end() ? -1 : last->second;
+  }
+
+  StoreState getStoreState(int index) const { return storeStates[index]; }
+  void setStoreState(int index, StoreState state) {
+    storeStates[index] = state;
+  }
+
+  // operations computing the value of a safe store
+  OperationSet & getStoreOperations(int index) {
+    return storeOperations[index];
+  }
+
+private:
+  std::vector<Value>                 values;
+  std::vector<Node>                  nodes;
+  std::unordered_map<INTEGER, int>   lastOnLine;
+  std::vector<StoreState>            storeStates;
+  std::vector<OperationSet>          storeOperations;
+
+  int getValueID(std::unordered_map<std::string, int> & ids,
+                 const std::string & name) {
+    auto id = ids.find(name);
+    if (id != ids.end()) return id->second;
+    ids[name] = values.size();
+    values.push_back( Value() );
+    return values.size() - 1;
+  }
+
+  /**
+   * Recognizes "select (cmp a, b), a, b" as MIN or MAX.
+   * Returns SELECT if the select is not a minimum or maximum. */
+  OPERATION getMinMax(const std::vector<Instruction> & body,
+                      std::unordered_map<std::string, int> & ids,
+                      const Instruction & select) {
+    auto cond = ids.find(select.condition);
+    if (cond == ids.end()) return SELECT;
+    int def = values[cond->second].definition;
+    if (def < 0 || body[def].oper != CMP) return SELECT;
+
+    const Instruction & cmp = body[def];
+    bool isLess    = cmp.predicate.find("lt") != std::string::npos ||
+                     cmp.predicate.find("le") != std::string::npos;
+    bool isGreater = cmp.predicate.find("gt") != std::string::npos ||
+                     cmp.predicate.find("ge") != std::string::npos;
+    if (!isLess && !isGreater) return SELECT;
+
+    if (cmp.operand1 == select.operand1 && cmp.operand2 == select.operand2)
+      return isLess ? MIN : MAX;
+    if (cmp.operand1 == select.operand2 && cmp.operand2 == select.operand1)
+      return isLess ? MAX : MIN;
+    return SELECT;
+  }
+
+  /**
+   * Returns the local (%) and global (@) names in a statement. */
+  static std::vector<std::string> getNames(const std::string & raw) {
+    std::vector<std::string> names;
+    for (size_t i = 0; i < raw.size(); i++) {
+      if (raw[i] != '%' && raw[i] != '@') continue;
+      size_t end = raw.find_first_of(" ,()", i);
+      if (end == std::string::npos) end = raw.size();
+      names.push_back( raw.substr(i, end - i) );
+      i = end;
+    }
+    return names;
+  }
+}; // class
+
+} // end commute
+
+} // end tasksan
+
+#endif // end def-use graph
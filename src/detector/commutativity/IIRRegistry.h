@@ -0,0 +1,89 @@
+/////////////////////////////////////////////////////////////////
+//  TaskSanitizer: a lightweight determinacy race checking
+//          tool for OpenMP task applications
+//
+//    Copyright (c) 2015 - 2018 Hassan Salehe Matar
+//      Copying or using this code by any means whatsoever
+//      without consent of the owner is strictly prohibited.
+//
+//   Contact: hassansalehe-at-gmail-dot-com
+//
+/////////////////////////////////////////////////////////////////
+
+// Defines a registry of .iir files registered by instrumented
+// modules. Each file is parsed only when a conflict in one of
+// its functions needs a commutativity check.
+
+#ifndef _DETECTOR_COMMUTATIVITY_IIRREGISTRY_H_
+#define _DETECTOR_COMMUTATIVITY_IIRREGISTRY_H_
+
+#include "detector/commutativity/CriticalSections.h"
+#include <map>
+#include <string>
+
+namespace tasksan {
+
+namespace commute {
+
+// Critical sections of a single .iir file, by function
+class IIRFile {
+public:
+  std::string        fileName;
+  bool               loaded;
+  std::map<std::string, CriticalSections> functions;
+
+  IIRFile(): loaded(false) {}
+  explicit IIRFile(const std::string & name):
+    fileName(name), loaded(false) {}
+
+  /**
+   * Returns critical sections of function "funcName" in the
+   * file, nullptr if the function is not registered. */
+  CriticalSections *find(const std::string & funcName) {
+    auto function = functions.find( funcName );
+    if (function == functions.end()) return nullptr;
+    return &function->second;
+  }
+};
+
+class IIRRegistry {
+private:
+  // registered files, by .iir file name
+  std::map<std::string, IIRFile>                  files;
+
+public:
+  /**
+   * Records that critical sections of function "funcName"
+   * are logged in .iir file "fileName". Functions of the same
+   * name in other files, e.g. static functions of other modules,
+   * are kept apart, and registering again changes nothing. */
+  void registerFunction(const std::string & fileName,
+                        const std::string & funcName) {
+    auto file = files.find( fileName );
+    if (file == files.end()) {
+      file = files.emplace(fileName, IIRFile(fileName)).first;
+    }
+    file->second.functions.emplace(funcName, CriticalSections());
+  }
+
+  /**
+   * Returns .iir file "fileName" if it holds critical sections
+   * of function "funcName", nullptr otherwise. */
+  IIRFile *find(const std::string & fileName,
+                const std::string & funcName) {
+    auto file = files.find( fileName );
+    if (file == files.end() || !file->second.find( funcName )) {
+      return nullptr;
+    }
+    return &file->second;
+  }
+
+  size_t getSize() { return files.size(); }
+
+}; // class
+
+} // end commute
+
+} // end tasksan
+
+#endif // end IIR registry
@@ -18,10 +18,47 @@
 #define VERBOSE
 #define CONC_THREASHOLD 5
 
-// Saves the function name/signature for reporting determinacy races
-void Checker::registerFuncSignature(std::string funcName, int funcID) {
+// the most actions kept per shadow cell, i.e. per byte of the cell
+#define CELL_THREASHOLD (CONC_THREASHOLD * SHADOW_CELL_SIZE)
+
+/**
+ * Returns the mask of the bytes of the shadow cell at "cell"
+ * which an access of bytes [start, end) covers */
+static inline unsigned char getByteMask(ulong cell, ulong start, ulong end) {
+  ulong first = std::max(start, cell) - cell;
+  ulong last  = std::min(end, cell + SHADOW_CELL_SIZE) - cell;
+  return (unsigned char)(((1u << last) - 1) & ~((1u << first) - 1));
+}
+
+/**
+ * Checks if two writes store the same value to the same bytes.
+ * Values of writes with different addresses or sizes are not
+ * comparable, hence such writes are treated as different. */
+static inline bool isSameWrite(const Action& write1, const Action& write2) {
+  return write1.addr  == write2.addr &&
+         write1.size  == write2.size &&
+         write1.value == write2.value;
+}
+
+// Saves the function name/signature for reporting determinacy races,
+// and the .iir file of its critical sections if it has any
+void Checker::registerFuncSignature(std::string funcName, int funcID,
+                                    std::string iirFile) {
   assert(functions.find(funcID) == functions.end());
   functions[funcID] = funcName;
+  if ( !iirFile.empty() ) {
+    CommutativityChecker::registerIIRfile(iirFile.c_str(), funcName.c_str());
+    functionFiles[funcID] = iirFile;
+  }
+}
+
+/**
+ * Returns the .iir file of function "funcID", an empty string if it
+ * has no critical sections */
+const std::string & Checker::getFunctionFile(INTEGER funcID) const {
+  static const std::string none;
+  auto file = functionFiles.find( funcID );
+  return file == functionFiles.end() ? none : file->second;
 }
 
 // Executed when a new task is created
@@ -110,10 +147,16 @@ void Checker::saveHappensBeforeEdge(int parentId, int siblingId) {
 void Checker::detectRaceOnMem(
     int taskID,
     std::string operation,
-    std::stringstream & ssin) {
+    std::stringstream & ssin,
+    uint size,
+    int lockSetID,
+    OPERATION update) {
 
   Action action;
   action.taskId = taskID;
+  action.size = size;
+  action.lockSetID = lockSetID;
+  action.update = update;
   constructMemoryAction(ssin, operation, action);
 
   if (action.funcId == 0) {
@@ -128,6 +171,8 @@ void Checker::detectRaceOnMem(
     ssin >> taskID;
     Action lastWAction;
     lastWAction.taskId = taskID;
+    lastWAction.size = size;
+    lastWAction.lockSetID = lockSetID;
     ssin >> operation;
     constructMemoryAction(ssin, operation, lastWAction);
     memActions.storeAction( lastWAction ); // save second action
@@ -135,11 +180,45 @@ void Checker::detectRaceOnMem(
   saveTaskActions( memActions ); // save the actions
 }
 
+/**
+ * Checks and saves the actions in every shadow cell the
+ * accessed bytes overlap, usually a single cell. */
 void Checker::saveTaskActions( const MemoryActions & taskActions ) {
+  ulong start = (ulong)taskActions.addr;
+  ulong end   = start + std::max(taskActions.action.size, 1u);
+
+  ulong cell = start & ~(SHADOW_CELL_SIZE - 1);
+  while (cell < end && !ownsCell(cell)) cell += SHADOW_CELL_SIZE;
+  if (cell >= end) return; // in pages of other partitions
+
+  if (sampleEvery > 1 && !writes.count((ADDRESS)cell) &&
+      ++sampleCount % sampleEvery) {
+    return; // sampling: not recorded, and there is nothing to check
+  }
+  if (budget.getStage() >= MemoryBudget::SHORT_HISTORY) {
+    pageUses[cell / HISTORY_PAGE_SIZE] = ++accessTick;
+  }
+
+  for (; cell < end; cell += SHADOW_CELL_SIZE) {
+    if ( !ownsCell(cell) ) continue;
+    MemoryActions cellActions = taskActions;
+    cellActions.mask = getByteMask(cell, start, end);
+    saveCellActions((ADDRESS)cell, cellActions);
+  }
+
+  if ( budget.isExceeded(ShadowMemory::get().getBytesInUse()) ) {
+    degradeHistory();
+  }
+}
+
+void Checker::saveCellActions(ADDRESS cell,
+                              const MemoryActions & taskActions) {
 
   // CASES
+  // 0. previous action on other bytes of the cell -> no conflict
   // 1. first action -> just save
-  // 2. nth write of the same task -> just save
+  // 2. nth action of the same task -> replace its previous action
+  //    on the same bytes, else just save
   // 3. a previous write in a happens-before -> just save
   // 4. previous write is parallel:
   //    4.1 but same value -> append new write
@@ -147,15 +226,30 @@ void Checker::saveTaskActions( const MemoryActions & taskActions ) {
   //        write in the parallel writes,update and take it forward
   //        4.2.1 check conflicts with other parallel tasks
 
-  auto perAddrActions = writes.find( taskActions.addr );
-  if (perAddrActions == writes.end()) {// 1. first action
-     writes[taskActions.addr] = std::list<MemoryActions>();
-  }
-  std::list<MemoryActions> & AddrActions = writes[taskActions.addr];
-  for (auto lastWrt = AddrActions.begin();
-       lastWrt != AddrActions.end(); lastWrt++) {
+  CellHistory & CellActions = writes[cell]; // 1. if new
+  auto sameAccess = CellActions.end();
+
+  // whether the history holds only writes of this write's value
+  bool sameWrites = writeStamps && taskActions.action.isWrite &&
+                    taskActions.action.update == OTHER;
+  for (auto lastWrt = CellActions.begin();
+       lastWrt != CellActions.end(); lastWrt++) {
+    sameWrites = sameWrites && lastWrt->action.isWrite &&
+                 lastWrt->action.update == OTHER &&
+                 isSameWrite(taskActions.action, lastWrt->action);
+
+    // 0. the actions access different bytes
+    if ( !(taskActions.mask & lastWrt->mask) ) continue;
+
     // actions of same task
-    if (taskActions.taskId == lastWrt->taskId) continue;
+    if (taskActions.taskId == lastWrt->taskId) {
+      if (taskActions.addr == lastWrt->addr &&
+          taskActions.action.size == lastWrt->action.size &&
+          taskActions.action.isWrite == lastWrt->action.isWrite) {
+        sameAccess = lastWrt;
+      }
+      continue;
+    }
 
     auto HBfound = serial_bags[taskActions.taskId]->HB.find(lastWrt->taskId);
     auto end     = serial_bags[taskActions.taskId]->HB.end();
@@ -166,7 +260,7 @@ void Checker::saveTaskActions( const MemoryActions & taskActions ) {
     // check write-write case (different values written)
     // 4.1 both write to shared memory
     if ( (taskActions.action.isWrite && lastWrt->action.isWrite) &&
-         (taskActions.action.value != lastWrt->action.value) ) {
+         !isSameWrite(taskActions.action, lastWrt->action) ) {
       // write different values, code for recording errors
       saveDeterminacyRaceReport( taskActions.action, lastWrt->action );
     } else if ((!taskActions.action.isWrite) && lastWrt->action.isWrite) {
@@ -181,13 +275,203 @@ void Checker::saveTaskActions( const MemoryActions & taskActions ) {
     }
   } // end for
 
-  if (AddrActions.size() >= CONC_THREASHOLD) {
-    AddrActions.pop_front(); // remove oldest element
+  // 2. the task accessed the same bytes the same way before:
+  // keep the first read and the last write
+  if (sameAccess != CellActions.end()) {
+    if (taskActions.action.isWrite) *sameAccess = taskActions;
+    updateStamp((ulong)cell, sameWrites);
+    return;
+  }
+
+  if (CellActions.size() >= historyDepth) {
+    // remove the oldest action, of this task if it has any
+    auto oldest = CellActions.begin();
+    for (auto it = CellActions.begin(); it != CellActions.end(); it++) {
+      if (it->taskId == taskActions.taskId) {
+        oldest = it;
+        break;
+      }
+    }
+    CellActions.erase(oldest);
+    sameWrites = false;  // its task may repeat the write dropped
+  }
+
+  CellActions.push_back( taskActions ); // save
+  updateStamp((ulong)cell, sameWrites);
+}
+
+/**
+ * Allocates the stamps of cells, see loadWriteStamp */
+VOID Checker::enableWriteStamps() {
+  if (writeStamps) return;
+  writeStamps.reset( new std::atomic<uint64_t>[WRITE_STAMPS]() );
+  stampCells.reset( new ulong[WRITE_STAMPS]() );
+}
+
+/**
+ * Returns the stamp of the cell of access ("addr", "size") if the
+ * history of the cell holds only writes of one value to the same
+ * bytes, else 0. A task which wrote that value there before, with
+ * the cell at the same stamp, repeats a write which cannot race and
+ * changes no history. Call with the lock held. */
+uint64_t Checker::getCellStamp(ADDRESS addr, ulong size) const {
+  ulong start = (ulong)addr;
+  ulong cell  = start & ~(SHADOW_CELL_SIZE - 1);
+  if (!writeStamps || start + std::max(size, 1ul) > cell + SHADOW_CELL_SIZE)
+    return 0;
+  ulong slot = getStampSlot(cell);
+  if (stampCells[slot] != cell) return 0;
+  return writeStamps[slot].load(std::memory_order_relaxed);
+}
+
+/**
+ * Gives cell "cell" a new stamp when its history starts to hold only
+ * writes of one value to the same bytes, as "sameWrites" tells. The
+ * stamp stays while writes of that value are added, and is dropped
+ * by any other change of the history. */
+VOID Checker::updateStamp(ulong cell, bool sameWrites) {
+  if (!writeStamps) return;
+  if (!sameWrites) {
+    invalidateStamp(cell);
+    return;
+  }
+  ulong slot = getStampSlot(cell);
+  if (stampCells[slot] == cell &&
+      writeStamps[slot].load(std::memory_order_relaxed)) return;
+  stampCells[slot] = cell;
+  writeStamps[slot].store(++lastStamp, std::memory_order_release);
+}
+
+VOID Checker::invalidateStamp(ulong cell) {
+  ulong slot = getStampSlot(cell);
+  if (writeStamps && stampCells[slot] == cell) {
+    writeStamps[slot].store(0, std::memory_order_release);
+  }
+}
+
+
+/**
+ * Drops the history of bytes [start, start + size), e.g. of freed
+ * heap memory or of stack frames of a completed task, so that a
+ * later reuse of the memory is not checked against it. */
+void Checker::clearRange(ADDRESS start, ulong size) {
+  ulong begin = (ulong)start;
+  ulong end   = begin + size;
+  ulong first = begin & ~(SHADOW_CELL_SIZE - 1);
+  if (end <= begin) return;
+
+  if ((end - first) / SHADOW_CELL_SIZE > writes.size()) {
+    // fewer cells have history than the range has cells
+    for (auto cell = writes.begin(); cell != writes.end(); ) {
+      ulong cellAddr = (ulong)cell->first;
+      if (cellAddr + SHADOW_CELL_SIZE > begin && cellAddr < end &&
+          clearCell(cell->second, cellAddr, begin, end)) {
+        cell = writes.erase(cell);
+      } else {
+        cell++;
+      }
+    }
+    return;
   }
 
-  writes[taskActions.addr].push_back( taskActions ); // save
+  for (ulong cellAddr = first; cellAddr < end; cellAddr += SHADOW_CELL_SIZE) {
+    auto cell = writes.find((ADDRESS)cellAddr);
+    if (cell != writes.end() &&
+        clearCell(cell->second, cellAddr, begin, end)) {
+      writes.erase(cell);
+    }
+  }
+}
+
+/**
+ * Removes bytes [start, end) from the actions on shadow cell "cell".
+ * Returns true if no action is left, i.e. the cell can be dropped. */
+bool Checker::clearCell(CellHistory & cellActions, ulong cell,
+                        ulong start, ulong end) {
+  unsigned char cleared = getByteMask(cell, start, end);
+  invalidateStamp(cell);
+  for (auto action = cellActions.begin(); action != cellActions.end(); ) {
+    action->mask &= ~cleared;
+    if (action->mask) {
+      action++;
+    } else {
+      action = cellActions.erase(action);
+    }
+  }
+  return cellActions.empty();
 }
 
+/**
+ * Degrades checking as shadow memory approaches the budget, in
+ * stages: keeps fewer actions per cell, evicts the history of the
+ * least recently used pages, then records only a sample of the
+ * accesses to cells without history, a smaller one each time. */
+VOID Checker::degradeHistory() {
+  ShadowMemory & memory = ShadowMemory::get();
+  ulong used = memory.getBytesInUse();
+
+  if (budget.getStage() < MemoryBudget::SHORT_HISTORY &&
+      used >= budget.getThreshold(MemoryBudget::SHORT_HISTORY)) {
+    historyDepth = CONC_THREASHOLD;
+    trimHistory();
+    budget.degrade(MemoryBudget::SHORT_HISTORY, "history shortened to " +
+        std::to_string(historyDepth) + " actions per cell", used);
+    used = memory.getBytesInUse();
+  }
+
+  if (used >= budget.getThreshold(MemoryBudget::EVICTING)) {
+    ulong evicted = evictColdPages( budget.getEvictionTarget() );
+    budget.degrade(MemoryBudget::EVICTING, "evicted history of " +
+        std::to_string(evicted) + " least recently used pages", used);
+    used = memory.getBytesInUse();
+  }
+
+  if (used >= budget.getThreshold(MemoryBudget::SAMPLING)) {
+    sampleEvery *= 2;
+    budget.degrade(MemoryBudget::SAMPLING, "recording 1 in " +
+        std::to_string(sampleEvery) + " accesses to new cells", used);
+  }
+  budget.setNextCheck(used);
+}
+
+/**
+ * Drops the oldest actions of cells with more than historyDepth */
+VOID Checker::trimHistory() {
+  for (auto & cell : writes) {
+    if (cell.second.size() > historyDepth) {
+      invalidateStamp((ulong)cell.first);
+    }
+    while (cell.second.size() > historyDepth) cell.second.pop_front();
+  }
+}
+
+/**
+ * Drops the history of pages, least recently used first, until
+ * shadow memory is down to "target" bytes. Pages not used since
+ * uses were tracked come first. Returns the number of pages. */
+ulong Checker::evictColdPages(ulong target) {
+  std::unordered_set<ulong> pages;
+  for (auto & cell : writes) {
+    pages.insert((ulong)cell.first / HISTORY_PAGE_SIZE);
+  }
+
+  std::vector<std::pair<ulong, ulong>> pagesByUse; // (last use, page)
+  for (ulong page : pages) {
+    auto use = pageUses.find(page);
+    pagesByUse.push_back(std::make_pair(
+        use == pageUses.end() ? 0 : use->second, page));
+  }
+  std::sort(pagesByUse.begin(), pagesByUse.end());
+
+  ulong evicted = 0;
+  for (auto & page : pagesByUse) {
+    if (ShadowMemory::get().getBytesInUse() <= target) break;
+    clearRange((ADDRESS)(page.second * HISTORY_PAGE_SIZE), HISTORY_PAGE_SIZE);
+    pageUses.erase(page.second);
+    evicted++;
+  }
+  return evicted;
+}
 
 /**
  * Records the determinacy race warning to the conflicts table.
@@ -195,19 +479,62 @@ void Checker::saveTaskActions( const MemoryActions & taskActions ) {
  */
 VOID Checker::saveDeterminacyRaceReport(const Action& curMemAction,
                                        const Action& prevMemAction) {
-  Conflict aConflict(curMemAction, prevMemAction);
 
   // store only if conflict is not commutative
-  if ( !commutativeChecker.isCommutative(aConflict) ) {
+  if ( isCommutativeUpdate(curMemAction, prevMemAction) ) return;
+
+  Conflict aConflict(curMemAction, prevMemAction);
+
+  // code for recording errors
+  std::pair<int, int> linePair =
+      {
+        std::min(curMemAction.lineNo, prevMemAction.lineNo),
+        std::max(curMemAction.lineNo, prevMemAction.lineNo)
+      };
+  conflictTable[linePair].insert( aConflict );
+}
 
-    // code for recording errors
-    std::pair<int, int> linePair =
-        {
-          std::min(curMemAction.lineNo, prevMemAction.lineNo),
-          std::max(curMemAction.lineNo, prevMemAction.lineNo)
-        };
-    conflictTable[linePair].insert( aConflict );
+/**
+ * Checks if two concurrent actions are commutative atomic updates
+ * or commutative updates in critical sections. Actions which hold
+ * no common lock are not protected updates and are not checked for
+ * commutativity.
+ * Results are cached per pair of source lines.
+ */
+bool Checker::isCommutativeUpdate(const Action& curMemAction,
+                                  const Action& prevMemAction) {
+  // skip commutativity check if read-write conflict
+  if (curMemAction.isWrite != prevMemAction.isWrite) return false;
+
+  // atomic updates commute only with updates of the same kind,
+  // e.g. fetch_add with fetch_sub but not with exchange
+  if (curMemAction.update != OTHER || prevMemAction.update != OTHER) {
+    return curMemAction.update == prevMemAction.update;
+  }
+
+  // the runtime reports locks, so check mutual exclusion first
+  if ( lockSets.isTracking() &&
+       !lockSets.shareLock(curMemAction.lockSetID,
+                           prevMemAction.lockSetID) ) {
+    return false;
   }
+
+  SITE site1 = std::make_pair(curMemAction.funcId, curMemAction.lineNo);
+  SITE site2 = std::make_pair(prevMemAction.funcId, prevMemAction.lineNo);
+  auto key = std::make_pair(std::min(site1, site2), std::max(site1, site2));
+  auto known = commutativeSites.find( key );
+  if (known != commutativeSites.end()) return known->second;
+
+  Conflict aConflict(curMemAction, prevMemAction);
+  // functions and their .iir files locate the conflicting lines
+  aConflict.action1.funcName = functions[curMemAction.funcId];
+  aConflict.action2.funcName = functions[prevMemAction.funcId];
+
+  bool commutative = commutativeChecker.isCommutative(aConflict,
+      getFunctionFile(curMemAction.funcId),
+      getFunctionFile(prevMemAction.funcId));
+  commutativeSites[key] = commutative;
+  return commutative;
 }
 
 
@@ -254,12 +581,25 @@ void Checker::constructMemoryAction(std::stringstream & ssin,
 #endif
 }
 
+/**
+ * Adds the conflicts found by the checker of another partition of
+ * memory. Partitions hold disjoint cells, hence disjoint conflicts. */
+VOID Checker::mergeResults(const Checker & partition) {
+  for (auto & lines : partition.conflictTable) {
+    conflictTable[lines.first].insert(lines.second.begin(),
+                                      lines.second.end());
+  }
+  budget.merge( partition.budget );
+}
+
 void Checker::checkCommutativeOperations(CommutativityChecker & validator) {
   // a pair of conflicting task body with a set of line numbers
   for (auto it = conflictTable.begin(); it != conflictTable.end(); ) {
     for ( auto aConflict = it->second.begin();
         aConflict != it->second.end(); ) {
-      if ( validator.isCommutative( *aConflict ) ) {
+      if ( validator.isCommutative( *aConflict,
+              getFunctionFile(aConflict->action1.funcId),
+              getFunctionFile(aConflict->action2.funcId) ) ) {
         aConflict = it->second.erase(aConflict);
         if ( 0 == it->second.size() ) {
            it = conflictTable.erase(it);
@@ -329,6 +669,7 @@ VOID Checker::reportConflicts() {
   }
 
   std::cout << emptyLine     << std::endl;
+  budget.printSummary(std::cout);
   std::cout << borderLine    << std::endl;
 }
 
@@ -337,7 +678,7 @@ VOID Checker::testing() {
      std::cout << it->first << ": Bucket {" << it->second.size();
      std::cout <<"} "<< std::endl;
   }
-  std::cout << "Total Addresses: " << writes.size() << std::endl;
+  std::cout << "Total shadow cells: " << writes.size() << std::endl;
 
   // testing
   std::cout << "====================" << std::endl;
@@ -352,6 +693,8 @@ VOID Checker::testing() {
 }
 
 
+Checker::Checker(): historyDepth(CELL_THREASHOLD) {}
+
 /**
  * implementation of the checker destructor frees
  * the memory dynamically generated for S-bags */
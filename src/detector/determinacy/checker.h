@@ -21,13 +21,22 @@
 #include "common/MemoryActions.h"
 #include "detector/determinacy/conflict.h"
 #include "detector/determinacy/report.h"
+#include "detector/determinacy/lockSets.h"
+#include "detector/determinacy/shadowMemory.h"
+#include "detector/determinacy/memoryBudget.h"
 #include "detector/commutativity/CommutativityChecker.h"
+#include <atomic>
 #include <list>
+#include <memory>
+
+// a set of task IDs in shadow memory
+typedef std::unordered_set<int, std::hash<int>, std::equal_to<int>,
+                           ShadowAllocator<int>> TASK_SET;
 
 // a bag to hold the tasks that happened-before
 typedef struct SerialBag {
   int outBufferCount;
-  UNORD_INTSET HB;  // unordered int set
+  TASK_SET HB;  // unordered int set
 
   SerialBag(): outBufferCount(0){}
 } SerialBag;
@@ -35,36 +44,96 @@ typedef struct SerialBag {
 // for constructing happans-before between tasks
 typedef struct Task {
   int taskID;     // identity of the task
-  UNORD_INTSET inEdges;  // incoming data streams
-  UNORD_INTSET outEdges; // outgoing data streams
+  TASK_SET inEdges;  // incoming data streams
+  TASK_SET outEdges; // outgoing data streams
 } Task;
 
 typedef SerialBag * SerialBagPtr;
 
+// accesses are checked per shadow cell of this many aligned bytes
+const ulong SHADOW_CELL_SIZE = 8;
+
+// recent actions of tasks on a shadow cell, in shadow memory
+typedef std::list<MemoryActions, ShadowAllocator<MemoryActions>> CellHistory;
+
+// conflicts per pair of source lines, in shadow memory
+typedef std::set<Conflict, std::less<Conflict>,
+                 ShadowAllocator<Conflict>> CONFLICT_SET;
+typedef std::map<std::pair<int, int>, CONFLICT_SET,
+    std::less<std::pair<int, int>>,
+    ShadowAllocator<std::pair<const std::pair<int, int>, CONFLICT_SET>>>
+    CONFLICT_TABLE;
+
+// history is evicted in pages of this many bytes
+const ulong HISTORY_PAGE_SIZE = 4096;
+
 class Checker {
   public:
   VOID addTaskNode(std::string & logLine);
   VOID saveTaskActions(const MemoryActions & taskActions);
 
+  // drops the history of "size" bytes at "start", e.g. freed memory
+  VOID clearRange(ADDRESS start, ulong size);
+
   // a pair of conflicting task body with a set of line numbers
   VOID checkCommutativeOperations(CommutativityChecker & validator);
 
-  VOID registerFuncSignature(std::string funcName, int funcID);
+  VOID registerFuncSignature(std::string funcName, int funcID,
+                             std::string iirFile = "");
+  const std::string & getFunctionFile(INTEGER funcID) const;
   VOID onTaskCreate(int taskID);
   VOID saveHappensBeforeEdge(int parentId, int siblingId);
   VOID detectRaceOnMem(int taskID,
                                  std::string operation,
-                                 std::stringstream & ssin);
+                                 std::stringstream & ssin,
+                                 uint size,
+                                 int lockSetID = LockSets::EMPTY,
+                                 OPERATION update = OTHER);
+
+  // lock set of a task after acquiring or releasing a lock
+  int acquireLock(int lockSetID, LockSets::LOCK lock) {
+    return lockSets.acquire(lockSetID, lock);
+  }
+  int releaseLock(int lockSetID, LockSets::LOCK lock) {
+    return lockSets.release(lockSetID, lock);
+  }
 
-  std::map<std::pair<int, int>, std::set<Conflict>> & getConflicts() {
+  CONFLICT_TABLE & getConflicts() {
     return conflictTable;
   }
 
-  VOID initializeCommutativityChecker(char *fileName) {
-    commutativeChecker.parseTasksIR(fileName);
+  // checks only cells in pages of partition "index" of "count",
+  // within a share of the memory budget
+  VOID setPartition(uint index, uint count) {
+    partitionIndex = index;
+    partitionCount = count;
+    budget.share(count);
   }
+
+  // checks without degrading, whatever TASKSAN_MEMORY_LIMIT says
+  VOID disableBudget() { budget.disable(); }
+  bool ownsCell(ulong cell) const {
+    return partitionCount == 1 ||
+           (cell / HISTORY_PAGE_SIZE) % partitionCount == partitionIndex;
+  }
+
+  // adds the conflicts and budget steps of a checker of a partition
+  VOID mergeResults(const Checker & partition);
+
+  // stamps of cells whose history holds only writes of one value to
+  // the same bytes, which the runtime reads without the lock to skip
+  // writes a task repeats; off unless enabled
+  VOID enableWriteStamps();
+  uint64_t loadWriteStamp(ADDRESS addr) const {
+    if (!writeStamps) return 0;
+    return writeStamps[getStampSlot((ulong)addr)].load(
+        std::memory_order_acquire);
+  }
+  uint64_t getCellStamp(ADDRESS addr, ulong size) const;
+
   VOID reportConflicts();
   VOID testing();
+  Checker();
   ~Checker();
 
   private:
@@ -72,22 +141,75 @@ class Checker {
     VOID constructMemoryAction(std::stringstream & ssin,
                                std::string & opType,
                                Action & action);
+    VOID saveCellActions(ADDRESS cell, const MemoryActions & cellActions);
+    VOID updateStamp(ulong cell, bool sameWrites);
+    VOID invalidateStamp(ulong cell);
+    static ulong getStampSlot(ulong addr) {
+      return (addr / SHADOW_CELL_SIZE) & (WRITE_STAMPS - 1);
+    }
+    bool clearCell(CellHistory & cellActions, ulong cell,
+                   ulong start, ulong end);
+
+    // degrade checking as shadow memory approaches the budget
+    VOID degradeHistory();
+    VOID trimHistory();
+    ulong evictColdPages(ulong target);
     VOID saveDeterminacyRaceReport(const Action& curWrite,
                                   const Action& write);
+    bool isCommutativeUpdate(const Action& curMemAction,
+                             const Action& prevMemAction);
 
     // hold bags of tasks
-    std::unordered_map <INTEGER, SerialBagPtr> serial_bags;
-    std::unordered_map<INTEGER, Task> graph;  // in and out edges
-    // for write actions
-    std::unordered_map<ADDRESS, std::list<MemoryActions>> writes;
-    std::map<std::pair<int, int>, std::set<Conflict>> conflictTable;
+    std::unordered_map<INTEGER, SerialBagPtr, std::hash<INTEGER>,
+        std::equal_to<INTEGER>,
+        ShadowAllocator<std::pair<const INTEGER, SerialBagPtr>>> serial_bags;
+    std::unordered_map<INTEGER, Task, std::hash<INTEGER>,
+        std::equal_to<INTEGER>,
+        ShadowAllocator<std::pair<const INTEGER, Task>>> graph; // edges
+    // recent actions of tasks per shadow cell address
+    std::unordered_map<ADDRESS, CellHistory, std::hash<ADDRESS>,
+        std::equal_to<ADDRESS>,
+        ShadowAllocator<std::pair<const ADDRESS, CellHistory>>> writes;
+    CONFLICT_TABLE conflictTable;
     CONFLICT_PAIRS conflictTasksAndLines;
 
     // For holding function signatures.
     std::unordered_map<INTEGER, std::string> functions;
 
+    // .iir files of functions with critical sections
+    std::unordered_map<INTEGER, std::string> functionFiles;
+
     // the commutativity checker
    CommutativityChecker commutativeChecker;
+
+    // lock sets held by tasks while accessing memory
+    LockSets lockSets;
+
+    // commutativity of pairs of (function ID, line) in critical sections
+    typedef std::pair<INTEGER, VALUE> SITE;
+    std::map<std::pair<SITE, SITE>, bool> commutativeSites;
+
+    // limit on shadow memory set with TASKSAN_MEMORY_LIMIT
+    MemoryBudget budget;
+    ulong historyDepth;     // the most actions kept per cell
+    ulong sampleEvery = 1;  // new cells are recorded for 1 in this
+    ulong sampleCount = 0;  // accesses to owned cells without history
+    ulong accessTick  = 0;  // clock of the last uses of pages
+
+    // pages of history checked, all unless set by setPartition
+    uint partitionIndex = 0;
+    uint partitionCount = 1;
+
+    // a slot of writeStamps holds the stamp of the cell in the same
+    // slot of stampCells, or 0. Stamps are never reused.
+    static const ulong WRITE_STAMPS = 1 << 16;
+    std::unique_ptr<std::atomic<uint64_t>[]> writeStamps;
+    std::unique_ptr<ulong[]> stampCells;
+    uint64_t lastStamp = 0;
+
+    // last use of pages of history, tracked once memory runs short
+    std::unordered_map<ulong, ulong, std::hash<ulong>, std::equal_to<ulong>,
+        ShadowAllocator<std::pair<const ulong, ulong>>> pageUses;
 };
 
 #endif // end checker.h
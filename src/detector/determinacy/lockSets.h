@@ -0,0 +1,99 @@
+/////////////////////////////////////////////////////////////////
+//  TaskSanitizer: a lightweight determinacy race checking
+//          tool for OpenMP task applications
+//
+//    Copyright (c) 2015 - 2018 Hassan Salehe Matar
+//      Copying or using this code by any means whatsoever
+//      without consent of the owner is strictly prohibited.
+//
+//   Contact: hassansalehe-at-gmail-dot-com
+//
+/////////////////////////////////////////////////////////////////
+
+// Defines the LockSets class which interns sets of locks held by
+// tasks into compact IDs. Memory actions store the ID of the lock
+// set held, so that checking whether two actions are protected by
+// a common lock is a cached lookup.
+
+#ifndef _DETECTOR_DETERMINACY_LOCKSETS_H_
+#define _DETECTOR_DETERMINACY_LOCKSETS_H_
+
+// includes and definitions
+#include "common/defs.h"
+
+class LockSets {
+  public:
+    typedef unsigned long LOCK;
+
+    // ID of the set of no locks
+    static const int EMPTY = 0;
+
+    LockSets() {
+      sets.push_back( std::vector<LOCK>() );
+      setIDs[ std::vector<LOCK>() ] = EMPTY;
+    }
+
+    /**
+     * Returns ID of lock set "setID" with "lock" added. */
+    int acquire(int setID, LOCK lock) {
+      std::vector<LOCK> locks = sets[setID];
+      auto pos = std::lower_bound(locks.begin(), locks.end(), lock);
+      if (pos != locks.end() && *pos == lock) return setID;
+      locks.insert(pos, lock);
+      return getID( locks );
+    }
+
+    /**
+     * Returns ID of lock set "setID" with "lock" removed. */
+    int release(int setID, LOCK lock) {
+      std::vector<LOCK> locks = sets[setID];
+      auto pos = std::lower_bound(locks.begin(), locks.end(), lock);
+      if (pos == locks.end() || *pos != lock) return setID;
+      locks.erase(pos);
+      return getID( locks );
+    }
+
+    /**
+     * Checks if lock sets "setID1" and "setID2" have a common lock. */
+    bool shareLock(int setID1, int setID2) {
+      if (setID1 == EMPTY || setID2 == EMPTY) return false;
+      if (setID1 == setID2) return true;
+      if (setID1 > setID2) std::swap(setID1, setID2);
+
+      unsigned long key = ((unsigned long)setID1 << 32) | (uint)setID2;
+      auto shared = sharedLocks.find( key );
+      if (shared != sharedLocks.end()) return shared->second;
+
+      const std::vector<LOCK> & locks1 = sets[setID1];
+      const std::vector<LOCK> & locks2 = sets[setID2];
+      bool share = false;
+      auto l1 = locks1.begin(), l2 = locks2.begin();
+      while (!share && l1 != locks1.end() && l2 != locks2.end()) {
+        if      (*l1 < *l2) l1++;
+        else if (*l2 < *l1) l2++;
+        else                share = true;
+      }
+      sharedLocks[key] = share;
+      return share;
+    }
+
+    /**
+     * Tells whether any lock has been acquired, i.e. whether
+     * the OpenMP runtime reports mutex events. */
+    bool isTracking() { return sets.size() > 1; }
+
+  private:
+    int getID(const std::vector<LOCK> & locks) {
+      auto id = setIDs.find( locks );
+      if (id != setIDs.end()) return id->second;
+      sets.push_back( locks );
+      setIDs[locks] = sets.size() - 1;
+      return sets.size() - 1;
+    }
+
+    std::vector<std::vector<LOCK>>        sets;    // sorted locks by ID
+    std::map<std::vector<LOCK>, int>      setIDs;
+    std::unordered_map<unsigned long, bool> sharedLocks;
+};
+
+#endif // end lockSets.h
@@ -0,0 +1,157 @@
+/////////////////////////////////////////////////////////////////
+//  TaskSanitizer: a lightweight determinacy race checking
+//          tool for OpenMP task applications
+//
+//    Copyright (c) 2015 - 2018 Hassan Salehe Matar
+//      Copying or using this code by any means whatsoever
+//      without consent of the owner is strictly prohibited.
+//
+//   Contact: hassansalehe-at-gmail-dot-com
+//
+/////////////////////////////////////////////////////////////////
+
+// Defines the MemoryBudget class which holds the limit set with
+// TASKSAN_MEMORY_LIMIT (bytes, or with a K, M or G suffix) on the
+// shadow memory of the checker. As usage approaches the limit, the
+// checker degrades in stages instead of running out of memory:
+// it shortens the history of cells, evicts the least recently used
+// pages of history and finally records only a sample of new cells.
+// The budget logs each step for the summary.
+
+#ifndef _DETECTOR_DETERMINACY_MEMORYBUDGET_H_
+#define _DETECTOR_DETERMINACY_MEMORYBUDGET_H_
+
+// includes and definitions
+#include "common/defs.h"
+#include <iostream>
+
+class MemoryBudget {
+  public:
+    enum Stage { FULL_HISTORY, SHORT_HISTORY, EVICTING, SAMPLING };
+
+    MemoryBudget(): start( std::chrono::steady_clock::now() ) {
+      const char * limitEnv = getenv("TASKSAN_MEMORY_LIMIT");
+      limit = limitEnv ? parseSize(limitEnv) : 0;
+      nextCheck = limit ? getThreshold(SHORT_HISTORY) : ~0ul;
+    }
+
+    /**
+     * Keeps 1 in "count" of the limit, for the checker of one of
+     * "count" partitions of memory */
+    void share(uint count) {
+      limit /= std::max(count, 1u);
+      nextCheck = limit ? getThreshold(SHORT_HISTORY) : ~0ul;
+    }
+
+    /** Removes the limit, hence checking is never degraded */
+    void disable() {
+      limit = 0;
+      nextCheck = ~0ul;
+    }
+
+    /** Returns true if no limit was set */
+    bool isUnlimited() const { return limit == 0; }
+
+    /** Checks if "used" bytes call for degrading the checker further */
+    bool isExceeded(ulong used) const { return used >= nextCheck; }
+
+    /** Returns the usage at which "stage" starts */
+    ulong getThreshold(Stage stage) const {
+      switch (stage) {
+        case SHORT_HISTORY: return limit / 10 * 6;
+        case EVICTING:      return limit / 4 * 3;
+        case SAMPLING:      return limit / 10 * 9;
+        default:            return 0;
+      }
+    }
+
+    /** Returns the usage eviction brings the memory down to */
+    ulong getEvictionTarget() const { return limit / 2; }
+
+    Stage getStage() const { return stage; }
+
+    /**
+     * Moves to "newStage" and logs "what" was degraded at "used" bytes */
+    void degrade(Stage newStage, const std::string & what, ulong used) {
+      stage = std::max(stage, newStage);
+      double seconds = std::chrono::duration<double>(
+          std::chrono::steady_clock::now() - start ).count();
+      if (events.size() >= MAX_EVENTS) {
+        droppedEvents++;
+        return;
+      }
+      std::ostringstream event;
+      event << "at " << seconds << " s, " << formatSize(used) << " used: "
+            << what;
+      events.push_back( event.str() );
+    }
+
+    /**
+     * Sets the usage to degrade at next, after handling usage "used":
+     * the next stage, eviction again, or a twentieth more memory */
+    void setNextCheck(ulong used) {
+      if (stage == FULL_HISTORY) {
+        nextCheck = getThreshold(SHORT_HISTORY);
+      } else if (stage == SHORT_HISTORY || used < getThreshold(EVICTING)) {
+        nextCheck = std::max(used + 1, getThreshold(EVICTING));
+      } else {
+        nextCheck = used + limit / 20;
+      }
+    }
+
+    /**
+     * Adds the steps "other" took, e.g. a checker of a partition */
+    void merge(const MemoryBudget & other) {
+      stage = std::max(stage, other.stage);
+      for (auto & event : other.events) {
+        if (events.size() < MAX_EVENTS) events.push_back( event );
+        else droppedEvents++;
+      }
+      droppedEvents += other.droppedEvents;
+    }
+
+    /** Prints the limit and the degradation steps taken */
+    void printSummary(std::ostream & os) const {
+      if (isUnlimited()) return;
+      os << " Memory limit: " << formatSize(limit);
+      if (events.empty()) {
+        os << ", not approached" << std::endl;
+        return;
+      }
+      os << ", degraded checking:" << std::endl;
+      for (auto & event : events) os << "    " << event << std::endl;
+      if (droppedEvents) {
+        os << "    and " << droppedEvents << " more steps" << std::endl;
+      }
+    }
+
+  private:
+    /** Formats "size" bytes in MB, or in KB if smaller */
+    static std::string formatSize(ulong size) {
+      if (size < (1ul << 20)) return std::to_string(size >> 10) + " KB";
+      return std::to_string(size >> 20) + " MB";
+    }
+
+    /** Parses sizes such as 4096, 512K, 64M and 2G */
+    static ulong parseSize(const char * text) {
+      char * suffix = NULL;
+      ulong size = strtoul(text, &suffix, 10);
+      switch (suffix ? toupper(*suffix) : 0) {
+        case 'G': size <<= 10; // fall through
+        case 'M': size <<= 10; // fall through
+        case 'K': size <<= 10;
+        default:  break;
+      }
+      return size;
+    }
+
+    ulong limit;                    // bytes, 0 if unlimited
+    ulong nextCheck;                // usage to degrade at next
+    Stage stage = FULL_HISTORY;
+    std::chrono::steady_clock::time_point start;
+    std::vector<std::string> events; // degradation steps
+    ulong droppedEvents = 0;         // steps after MAX_EVENTS
+    static const unsigned MAX_EVENTS = 32;
+};
+
+#endif // end memoryBudget.h
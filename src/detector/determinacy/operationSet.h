@@ -27,6 +27,10 @@ class OperationSet {
       operations.insert( op );
     }
 
+    void appendOperations(const OperationSet & other) {
+      operations.insert( other.operations.begin(), other.operations.end() );
+    }
+
     /**
      * Checks if operation "op" commutes with previous
      * operations which manipulate a shared memory location. */
@@ -43,6 +47,14 @@ class OperationSet {
         case DIV:
           if (i != MUL && i != DIV)  return false;
           break;
+        case AND:
+        case OR:
+        case XOR:
+        case MIN:
+        case MAX:
+          // each commutes only with itself
+          if (i != op)  return false;
+          break;
         default:
           return false;
         }
@@ -0,0 +1,291 @@
+/////////////////////////////////////////////////////////////////
+//  TaskSanitizer: a lightweight determinacy race checking
+//          tool for OpenMP task applications
+//
+//    Copyright (c) 2015 - 2018 Hassan Salehe Matar
+//      Copying or using this code by any means whatsoever
+//      without consent of the owner is strictly prohibited.
+//
+//   Contact: hassansalehe-at-gmail-dot-com
+//
+/////////////////////////////////////////////////////////////////
+
+// Defines the memory which backs the access history of the checker.
+// History is allocated from 2 MB chunks mapped per NUMA node, so that
+// the history of a shadow cell lives on the node of the thread which
+// first accessed the cell. Chunks can be backed by transparent or
+// explicit huge pages. The environment variables below configure it:
+//   TASKSAN_HUGE_PAGES=0|1|2  none, transparent (default), explicit
+//   TASKSAN_NUMA_BIND=1       bind chunks to the node, not first-touch
+//   TASKSAN_SHADOW_STATS=1    print per-node statistics at the end
+
+#ifndef _DETECTOR_DETERMINACY_SHADOWMEMORY_H_
+#define _DETECTOR_DETERMINACY_SHADOWMEMORY_H_
+
+// includes and definitions
+#include "common/defs.h"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <iostream>
+#include <new>
+
+class ShadowMemory {
+  public:
+    enum HugePages { NO_HUGE_PAGES, TRANSPARENT, EXPLICIT };
+
+    // size and alignment of chunks, the size of a huge page
+    static const ulong CHUNK_SIZE = 2ul << 20;
+
+    // allocations up to this size come from chunks, larger
+    // ones, e.g. bucket arrays of hash maps, are mapped alone
+    static const ulong MAX_SMALL_SIZE = 512;
+    static const ulong SIZE_CLASS = 16;
+
+    // usage of memory on a NUMA node
+    struct NodeStats {
+      ulong chunks      = 0;  // chunks mapped
+      ulong hugeMaps    = 0;  // mappings backed by huge pages
+      ulong largeBytes  = 0;  // bytes of large allocations mapped
+      ulong bytesInUse  = 0;  // bytes of live allocations
+      ulong peakInUse   = 0;  // the most bytes in use at once
+    };
+
+    /**
+     * Returns the shadow memory, configured from the environment on
+     * first use. It is never destroyed since the checker, a static
+     * object, frees its history after other statics are destroyed. */
+    static ShadowMemory & get() {
+      ShadowMemory * threadMemory = getThreadMemory();
+      if (threadMemory) return *threadMemory;
+      static ShadowMemory * shadowMemory = new ShadowMemory();
+      return *shadowMemory;
+    }
+
+    /**
+     * Gives the calling thread shadow memory of its own, for checkers
+     * which each run on a single thread, e.g. in tasksan-check. */
+    static void useThreadMemory() {
+      if (!getThreadMemory()) getThreadMemory() = new ShadowMemory();
+    }
+
+    /**
+     * Allocates "size" bytes on the node of the calling thread.
+     * Not thread-safe: callers hold the lock of the checker. */
+    void * allocate(ulong size) {
+      size = std::max(size, (ulong)SIZE_CLASS);
+      unsigned node = getThreadNode();
+      NodeArena & arena = getArena(node);
+
+      void * block = nullptr;
+      if (size > MAX_SMALL_SIZE) {
+        size = roundUp(size, (ulong)getpagesize());
+        block = mapMemory(size, node, arena.stats);
+        largeNodes[(ulong)block] = node;
+        arena.stats.largeBytes += size;
+      } else {
+        size = roundUp(size, SIZE_CLASS);
+        std::vector<void *> & freeList = arena.freeLists[size / SIZE_CLASS];
+        if ( !freeList.empty() ) {
+          block = freeList.back();
+          freeList.pop_back();
+        } else {
+          if (arena.next + size > arena.end) addChunk(node, arena);
+          block = (void *)arena.next;
+          arena.next += size;
+        }
+      }
+      arena.stats.bytesInUse += size;
+      totalInUse += size;
+      arena.stats.peakInUse = std::max(arena.stats.peakInUse,
+                                       arena.stats.bytesInUse);
+      return block;
+    }
+
+    /**
+     * Frees "size" bytes at "block" into the arena of its node */
+    void deallocate(void * block, ulong size) {
+      size = std::max(size, (ulong)SIZE_CLASS);
+      if (size > MAX_SMALL_SIZE) {
+        size = roundUp(size, (ulong)getpagesize());
+        NodeArena & arena = getArena( largeNodes[(ulong)block] );
+        largeNodes.erase((ulong)block);
+        munmap(block, size);
+        arena.stats.largeBytes -= size;
+        arena.stats.bytesInUse -= size;
+        totalInUse -= size;
+        return;
+      }
+      size = roundUp(size, SIZE_CLASS);
+      NodeArena & arena =
+          getArena( chunkNodes[(ulong)block & ~(CHUNK_SIZE - 1)] );
+      arena.freeLists[size / SIZE_CLASS].push_back(block);
+      arena.stats.bytesInUse -= size;
+      totalInUse -= size;
+    }
+
+    /** Returns the bytes of live allocations on all nodes */
+    ulong getBytesInUse() const { return totalInUse; }
+
+    /**
+     * Prints per-node statistics if TASKSAN_SHADOW_STATS=1 */
+    void printStats(std::ostream & os) {
+      if (!printsStats) return;
+      const char * hugePageNames[] = { "none", "transparent", "explicit" };
+      os << " Shadow memory (huge pages: " << hugePageNames[hugePages]
+         << ", NUMA binding: " << (bindToNode ? "on" : "off") << ")"
+         << std::endl;
+      for (auto & arena : arenas) {
+        const NodeStats & stats = arena.second.stats;
+        os << "    node " << arena.first << ": "
+           << stats.chunks << " chunks, "
+           << stats.hugeMaps << " huge-page mappings, "
+           << (stats.largeBytes >> 10) << " KB large, "
+           << (stats.bytesInUse >> 10) << " KB in use, "
+           << (stats.peakInUse >> 10) << " KB peak" << std::endl;
+      }
+    }
+
+  private:
+    // the chunks and free blocks of a node
+    struct NodeArena {
+      char * next = nullptr;  // free space of the last chunk
+      char * end  = nullptr;
+      std::vector<void *> freeLists[MAX_SMALL_SIZE / SIZE_CLASS + 1];
+      NodeStats stats;
+    };
+
+    ShadowMemory() {
+      const char * huge = getenv("TASKSAN_HUGE_PAGES");
+      hugePages = huge ? (HugePages)std::min(atoi(huge), (int)EXPLICIT)
+                       : TRANSPARENT;
+      const char * bind = getenv("TASKSAN_NUMA_BIND");
+      bindToNode = bind && atoi(bind);
+      const char * stats = getenv("TASKSAN_SHADOW_STATS");
+      printsStats = stats && atoi(stats);
+    }
+
+    static ShadowMemory *& getThreadMemory() {
+      static __thread ShadowMemory * threadMemory = nullptr;
+      return threadMemory;
+    }
+
+    static inline ulong roundUp(ulong size, ulong unit) {
+      return (size + unit - 1) & ~(unit - 1);
+    }
+
+    /**
+     * Returns the NUMA node of the calling thread. It is looked up
+     * once per thread since OpenMP threads are usually bound. */
+    static unsigned getThreadNode() {
+      static __thread int threadNode = -1;
+      if (threadNode < 0) {
+        unsigned cpu = 0, node = 0;
+        if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0) node = 0;
+        threadNode = node;
+      }
+      return threadNode;
+    }
+
+    NodeArena & getArena(unsigned node) {
+      return arenas[node];
+    }
+
+    /**
+     * Maps a new chunk on "node" for the small allocations */
+    void addChunk(unsigned node, NodeArena & arena) {
+      char * chunk = (char *)mapMemory(CHUNK_SIZE, node, arena.stats);
+      chunkNodes[(ulong)chunk] = node;
+      arena.next = chunk;
+      arena.end  = chunk + CHUNK_SIZE;
+      arena.stats.chunks++;
+    }
+
+    /**
+     * Maps "size" bytes, aligned to CHUNK_SIZE if at least that
+     * large, with the configured huge pages and NUMA policy. */
+    void * mapMemory(ulong size, unsigned node, NodeStats & stats) {
+      void * memory = MAP_FAILED;
+      bool huge = false;
+#ifdef MAP_HUGETLB
+      if (hugePages == EXPLICIT && size % CHUNK_SIZE == 0) {
+        memory = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        huge = memory != MAP_FAILED;
+      }
+#endif
+      if (memory == MAP_FAILED) {
+        // map more to trim the memory to an aligned chunk
+        ulong mapped = size < CHUNK_SIZE ? size : size + CHUNK_SIZE;
+        char * raw = (char *)mmap(nullptr, mapped, PROT_READ | PROT_WRITE,
+                                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) throw std::bad_alloc();
+        char * aligned = raw;
+        if (mapped > size) {
+          aligned = (char *)roundUp((ulong)raw, CHUNK_SIZE);
+          if (aligned > raw) munmap(raw, aligned - raw);
+          ulong tail = (raw + mapped) - (aligned + size);
+          if (tail) munmap(aligned + size, tail);
+        }
+        memory = aligned;
+#ifdef MADV_HUGEPAGE
+        // explicit huge pages fall back to transparent ones
+        if (hugePages != NO_HUGE_PAGES && size >= CHUNK_SIZE) {
+          huge = madvise(memory, size, MADV_HUGEPAGE) == 0;
+        }
+#endif
+      }
+      if (huge) stats.hugeMaps++;
+      if (bindToNode) bindMemory(memory, size, node);
+      return memory;
+    }
+
+    /**
+     * Prefers "node" for the pages of "memory". Without binding, a
+     * page is placed by the first thread touching it, i.e. the one
+     * which allocated it. MPOL_PREFERRED is 1 in linux/mempolicy.h. */
+    static void bindMemory(void * memory, ulong size, unsigned node) {
+      const int MPOL_PREFERRED_POLICY = 1;
+      ulong nodeMask[4] = { 0, 0, 0, 0 };
+      if (node >= sizeof(nodeMask) * 8) return;
+      nodeMask[node / 64] = 1ul << (node % 64);
+      syscall(SYS_mbind, memory, size, MPOL_PREFERRED_POLICY,
+              nodeMask, sizeof(nodeMask) * 8, 0);
+    }
+
+    HugePages hugePages;
+    ulong totalInUse = 0;
+    bool bindToNode;
+    bool printsStats;
+
+    std::map<unsigned, NodeArena> arenas;           // node -> arena
+    std::unordered_map<ulong, unsigned> chunkNodes;  // chunk -> node
+    std::unordered_map<ulong, unsigned> largeNodes;  // large block -> node
+};
+
+/**
+ * An allocator for containers of the checker which allocates
+ * from the shadow memory */
+template<typename T>
+struct ShadowAllocator {
+  typedef T value_type;
+
+  ShadowAllocator() {}
+  template<typename U> ShadowAllocator(const ShadowAllocator<U> &) {}
+
+  T * allocate(std::size_t n) {
+    return (T *)ShadowMemory::get().allocate(n * sizeof(T));
+  }
+  void deallocate(T * block, std::size_t n) {
+    ShadowMemory::get().deallocate(block, n * sizeof(T));
+  }
+
+  template<typename U> bool operator==(const ShadowAllocator<U> &) const {
+    return true;
+  }
+  template<typename U> bool operator!=(const ShadowAllocator<U> &) const {
+    return false;
+  }
+};
+
+#endif // end shadowMemory.h
@@ -0,0 +1,417 @@
+/////////////////////////////////////////////////////////////////
+//  TaskSanitizer: a lightweight determinacy race checking
+//          tool for OpenMP task applications
+//
+//    Copyright (c) 2015 - 2018 Hassan Salehe Matar
+//      Copying or using this code by any means whatsoever
+//      without consent of the owner is strictly prohibited.
+//
+//   Contact: hassansalehe-at-gmail-dot-com
+//
+/////////////////////////////////////////////////////////////////
+
+// this file implements checking of recorded traces.
+#include "detector/offline/TraceChecker.h"  // header
+#include "common/BlockCompressor.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <atomic>
+#include <thread>
+
+using namespace tasksan::trace;
+
+// bytes of the magic, version and flags at the start of traces
+static const ulong HEADER_SIZE = sizeof(MAGIC) + 2 * sizeof(uint32_t);
+
+/**
+ * Runs "work" on "count" threads, passing each its index */
+template<typename Work>
+static void runThreads(uint count, Work work) {
+  std::vector<std::thread> threads;
+  for (uint i = 0; i < count; i++) threads.emplace_back(work, i);
+  for (auto & thread : threads) thread.join();
+}
+
+/**
+ * Decodes a name at "event". Returns the end of it, NULL if the
+ * trace ends before it. */
+static const char * decodeName(const char * event, const char * end,
+                               std::string & name) {
+  uint64_t length;
+  event = getVarint(event, end, length);
+  if (!event || (ulong)(end - event) < length) return NULL;
+  name.assign(event, length);
+  return event + length;
+}
+
+TraceChecker::~TraceChecker() {
+  for (auto & trace : traces) {
+    munmap((void *)trace.data, trace.mapped);
+    if (trace.inflated) munmap(trace.inflated, trace.inflatedSize);
+  }
+}
+
+/**
+ * Decompresses the blocks of "trace" into memory of its own. Stops
+ * at a truncated or corrupt block. */
+VOID TraceChecker::inflate(Trace & trace) {
+  const char * end = trace.data + trace.mapped;
+  const char * block = trace.data + HEADER_SIZE;
+  const ulong BLOCK_HEADER_SIZE = 2 * sizeof(uint32_t);
+
+  ulong size = 0;  // of the events of complete blocks
+  for (; end - block >= (long)BLOCK_HEADER_SIZE; ) {
+    uint32_t rawSize, storedSize;
+    get(get(block, rawSize), storedSize);
+    if ((ulong)(end - block) < BLOCK_HEADER_SIZE + storedSize) break;
+    size += rawSize;
+    block += BLOCK_HEADER_SIZE + storedSize;
+  }
+  trace.inflatedSize = std::max(size, 1ul);
+  void * memory = mmap(NULL, trace.inflatedSize, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (memory == MAP_FAILED) throw std::bad_alloc();
+  trace.inflated = (char *)memory;
+
+  char * events = trace.inflated;
+  block = trace.data + HEADER_SIZE;
+  for (ulong done = 0; done < size; ) {
+    uint32_t rawSize, storedSize;
+    block = get(get(block, rawSize), storedSize);
+    long decoded = rawSize;
+    if (storedSize == rawSize) {
+      memcpy(events + done, block, rawSize);
+    } else {
+      decoded = tasksan::compress::decompressBlock(block, storedSize,
+                                                   events + done, rawSize);
+    }
+    if (decoded != (long)rawSize) {
+      std::cerr << "tasksan-check: " << trace.fileName
+                << " has a corrupt block" << std::endl;
+      size = done;
+      break;
+    }
+    done += rawSize;
+    block += storedSize;
+  }
+  trace.events = trace.inflated;
+  trace.size = size;
+}
+
+bool TraceChecker::addTrace(const std::string & fileName) {
+  int fd = open(fileName.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+  struct stat status;
+  if (fstat(fd, &status) != 0 || (ulong)status.st_size < HEADER_SIZE) {
+    close(fd);
+    return false;
+  }
+
+  Trace trace;
+  trace.fileName = fileName;
+  trace.mapped = status.st_size;
+  void * data = mmap(NULL, trace.mapped, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) return false;
+  madvise(data, trace.mapped, MADV_SEQUENTIAL);
+  trace.data = (const char *)data;
+
+  uint32_t version = 0, flags = 0;
+  get(get(trace.data + sizeof(MAGIC), version), flags);
+  if (memcmp(trace.data, MAGIC, sizeof(MAGIC)) != 0 || version != VERSION) {
+    munmap(data, trace.mapped);
+    return false;
+  }
+  if (flags & FLAG_COMPRESSED) {
+    inflate(trace);
+  } else {
+    trace.events = trace.data + HEADER_SIZE;
+    trace.size = trace.mapped - HEADER_SIZE;
+  }
+  traces.push_back( trace );
+  return true;
+}
+
+ulong TraceChecker::getTraceBytes() const {
+  ulong bytes = 0;
+  for (auto & trace : traces) bytes += trace.mapped;
+  return bytes;
+}
+
+/**
+ * Tells whether events of "type" carry a sequence number */
+bool TraceChecker::isOrdered(EventType type) {
+  return type == EVENT_TASK_BEGIN || type == EVENT_TASK_END ||
+         type == EVENT_DEPENDENCE || type == EVENT_JOIN ||
+         type == EVENT_SWITCH || type == EVENT_CLEAR;
+}
+
+/**
+ * Decodes the event at "event" into "decoded", relative to the
+ * previous access in "delta". Returns the end of the event, NULL if
+ * the trace ends before it, e.g. if the program was killed while
+ * writing it. */
+const char * TraceChecker::decode(const char * event, const char * end,
+                                  Event & decoded, DeltaState & delta) {
+  if (event >= end || !*event || (unsigned char)*event > EVENT_IIR_FILE) {
+    return NULL;
+  }
+  decoded.type = (EventType)*event++;
+  if ( isOrdered(decoded.type) ) delta = DeltaState();
+
+  uint64_t value = 0;
+  switch (decoded.type) {
+    case EVENT_FUNCTION:
+      event = getVarint(event, end, value);
+      decoded.first = value;
+      return event ? decodeName(event, end, decoded.name1) : NULL;
+    case EVENT_SITE:
+      event = getVarint(event, end, value);
+      decoded.first = value;
+      if (event) event = getVarint(event, end, value);
+      decoded.second = value;
+      if (event) event = getVarint(event, end, value);
+      decoded.value = unzigzag(value);
+      return event;
+    case EVENT_TASK_BEGIN:
+    case EVENT_TASK_END:
+    case EVENT_SWITCH:
+      event = getVarint(event, end, decoded.seq);
+      if (event) event = getVarint(event, end, value);
+      decoded.first = value;
+      return event;
+    case EVENT_DEPENDENCE:
+    case EVENT_JOIN:
+      event = getVarint(event, end, decoded.seq);
+      if (event) event = getVarint(event, end, value);
+      decoded.first = value;
+      if (event) event = getVarint(event, end, value);
+      decoded.second = value;
+      return event;
+    case EVENT_READ:
+    case EVENT_WRITE:
+      event = getVarint(event, end, value);
+      decoded.addr = delta.addr += unzigzag(value);
+      decoded.value = 0;
+      if (event && decoded.type == EVENT_WRITE) {
+        event = getVarint(event, end, value);
+        decoded.value = unzigzag(value);
+      }
+      if (event) event = getVarint(event, end, value);
+      decoded.first = delta.site += unzigzag(value);
+      if (event) event = getVarint(event, end, value);
+      decoded.size = value & 31;
+      decoded.update = decodeUpdate(value >> 5);
+      return event;
+    case EVENT_LOCK_ACQUIRE:
+    case EVENT_LOCK_RELEASE:
+      return getVarint(event, end, decoded.addr);
+    case EVENT_CLEAR:
+      event = getVarint(event, end, decoded.seq);
+      if (event) event = getVarint(event, end, decoded.addr);
+      if (event) event = getVarint(event, end, decoded.size);
+      return event;
+    case EVENT_IIR_FILE:
+      event = getVarint(event, end, value);
+      decoded.first = value;
+      return event ? decodeName(event, end, decoded.name1) : NULL;
+  }
+  return NULL;
+}
+
+/**
+ * Scans trace "index" once: collects its sites, functions, .iir
+ * files and the events with sequence numbers. A truncated trace is
+ * checked up to its last complete event. */
+VOID TraceChecker::scanTrace(uint index, std::vector<OrderedEvent> & ordered) {
+  Trace & trace = traces[index];
+  const char * end = trace.events + trace.size;
+  const char * event = trace.events;
+  Event decoded;
+  DeltaState delta;
+
+  while (event < end) {
+    const char * next = decode(event, end, decoded, delta);
+    if (!next) {
+      std::cerr << "tasksan-check: " << trace.fileName
+                << " is truncated" << std::endl;
+      break;
+    }
+    ulong offset = event - trace.events;
+    if ( isOrdered(decoded.type) ) {
+      if ( !ordered.empty() ) ordered.back().runEnd = offset;
+      ordered.push_back( OrderedEvent{decoded.seq,
+          decoded.type == EVENT_SWITCH, index, offset, 0} );
+    } else if (decoded.type == EVENT_SITE) {
+      if (trace.sites.size() <= decoded.first) {
+        trace.sites.resize(decoded.first + 1);
+      }
+      trace.sites[decoded.first] =
+          std::make_pair((INTEGER)decoded.second, (INTEGER)decoded.value);
+    } else if (decoded.type == EVENT_FUNCTION ||
+               decoded.type == EVENT_IIR_FILE) {
+      trace.functions.push_back( decoded );
+    }
+    event = next;
+  }
+
+  trace.size = event - trace.events; // drops a truncated event
+  trace.firstOrdered = ordered.empty() ? trace.size : ordered[0].offset;
+  if ( !ordered.empty() ) ordered.back().runEnd = trace.size;
+}
+
+/**
+ * Applies an event with a sequence number to checker "target" */
+VOID TraceChecker::replayOrdered(Checker & target, const Event & event) {
+  switch (event.type) {
+    case EVENT_TASK_BEGIN:
+      target.onTaskCreate(event.first);
+      break;
+    case EVENT_DEPENDENCE:
+    case EVENT_JOIN:
+      target.saveHappensBeforeEdge(event.first, event.second);
+      break;
+    case EVENT_CLEAR:
+      target.clearRange((ADDRESS)event.addr, event.size);
+      break;
+    default:
+      break;
+  }
+}
+
+/**
+ * Registers the functions of all traces with checker "target",
+ * together with the .iir files of those with critical sections */
+VOID TraceChecker::registerFunctions(Checker & target) {
+  std::unordered_map<INTEGER, std::string> files;
+  for (auto & trace : traces) {
+    for (auto & function : trace.functions) {
+      if (function.type == EVENT_IIR_FILE) {
+        files[function.first] = function.name1;
+      }
+    }
+  }
+  for (auto & trace : traces) {
+    for (auto & function : trace.functions) {
+      if (function.type == EVENT_FUNCTION) {
+        auto file = files.find( function.first );
+        target.registerFuncSignature(function.name1, function.first,
+            file == files.end() ? std::string() : file->second);
+      }
+    }
+  }
+}
+
+/**
+ * Replays all traces with checker "partition" of partition "index".
+ * Every worker replays the same order: events with sequence numbers
+ * by number, each followed by the events after it in its trace. Only
+ * accesses to pages of the partition are checked. */
+VOID TraceChecker::checkPartition(uint index, Checker * partition) {
+  partition->setPartition(index, workerCount);
+  partition->disableBudget();
+  registerFunctions( *partition );
+
+  std::unordered_map<uint, int> lockSets; // task -> ID of its lock set
+  std::vector<uint> currentTasks(traces.size(), 0);
+  Event event;
+
+  auto replayRun = [&](uint t, ulong begin, ulong runEnd) {
+    const Trace & trace = traces[t];
+    const char * end = trace.events + runEnd;
+    const char * next = trace.events + begin;
+    uint taskID = currentTasks[t];
+    DeltaState delta;
+    while (next < end && (next = decode(next, end, event, delta))) {
+      switch (event.type) {
+        case EVENT_LOCK_ACQUIRE:
+          lockSets[taskID] = partition->acquireLock(lockSets[taskID],
+                                                    event.addr);
+          break;
+        case EVENT_LOCK_RELEASE:
+          lockSets[taskID] = partition->releaseLock(lockSets[taskID],
+                                                    event.addr);
+          break;
+        case EVENT_READ:
+        case EVENT_WRITE: {
+          ulong cell = event.addr & ~(SHADOW_CELL_SIZE - 1);
+          ulong last = (event.addr + std::max(event.size, 1ul) - 1) &
+                       ~(SHADOW_CELL_SIZE - 1);
+          if ((!partition->ownsCell(cell) && !partition->ownsCell(last)) ||
+              event.first >= trace.sites.size()) {
+            break;
+          }
+          auto lockSet = lockSets.find(taskID);
+          auto & site = trace.sites[event.first]; // (function, line)
+          Action action(taskID, (ADDRESS)event.addr, event.value,
+                        site.second, site.first);
+          action.size = event.size;
+          action.isWrite = event.type == EVENT_WRITE;
+          action.lockSetID = lockSet == lockSets.end() ? LockSets::EMPTY
+                                                       : lockSet->second;
+          action.update = (OPERATION)event.update;
+          partition->saveTaskActions( MemoryActions(action) );
+          break;
+        }
+        default:
+          break;
+      }
+    }
+  };
+
+  for (uint t = 0; t < traces.size(); t++) {
+    replayRun(t, 0, traces[t].firstOrdered);
+  }
+  DeltaState delta;
+  for (auto & ordered : orderedEvents) {
+    const Trace & trace = traces[ordered.trace];
+    const char * next = decode(trace.events + ordered.offset,
+                               trace.events + trace.size, event, delta);
+    if (event.type == EVENT_SWITCH) currentTasks[ordered.trace] = event.first;
+    else replayOrdered(*partition, event);
+    replayRun(ordered.trace, next - trace.events, ordered.runEnd);
+  }
+}
+
+/**
+ * Checks the traces: scans them in parallel, reconstructs the task
+ * graph, checks the partitions of memory in parallel and merges
+ * their conflicts. */
+VOID TraceChecker::check() {
+  checker.disableBudget();
+  std::vector<std::vector<OrderedEvent>> ordered(traces.size());
+  std::atomic<uint> nextTrace{ 0 };
+  runThreads(std::min(workerCount, (uint)traces.size()), [&](uint) {
+    for (uint t; (t = nextTrace.fetch_add(1)) < traces.size(); ) {
+      scanTrace(t, ordered[t]);
+    }
+  });
+  for (auto & events : ordered) {
+    orderedEvents.insert(orderedEvents.end(), events.begin(), events.end());
+  }
+  std::sort(orderedEvents.begin(), orderedEvents.end());
+
+  registerFunctions( checker );
+
+  // the task graph, for the report
+  Event event;
+  DeltaState delta;
+  for (auto & ordered : orderedEvents) {
+    const Trace & trace = traces[ordered.trace];
+    decode(trace.events + ordered.offset, trace.events + trace.size,
+           event, delta);
+    if (event.type != EVENT_CLEAR) replayOrdered(checker, event);
+  }
+
+  // checkers of partitions use shadow memory of their threads, hence
+  // they are not destroyed here but freed with the process
+  std::vector<Checker *> partitions(workerCount);
+  runThreads(workerCount, [&](uint index) {
+    ShadowMemory::useThreadMemory();
+    partitions[index] = new Checker();
+    checkPartition(index, partitions[index]);
+  });
+  for (Checker * partition : partitions) checker.mergeResults(*partition);
+}
@@ -0,0 +1,109 @@
+/////////////////////////////////////////////////////////////////
+//  TaskSanitizer: a lightweight determinacy race checking
+//          tool for OpenMP task applications
+//
+//    Copyright (c) 2015 - 2018 Hassan Salehe Matar
+//      Copying or using this code by any means whatsoever
+//      without consent of the owner is strictly prohibited.
+//
+//   Contact: hassansalehe-at-gmail-dot-com
+//
+/////////////////////////////////////////////////////////////////
+
+// Defines the TraceChecker class which checks traces recorded with
+// TASKSAN_RECORD after the run. It maps the traces, reconstructs the
+// task graph and checks accesses in parallel: each worker replays
+// the traces with a Checker of its own which keeps the history of a
+// partition of the pages of memory. The conflicts of the partitions
+// are then merged and reported as the online checker would. Checking
+// is never degraded by TASKSAN_MEMORY_LIMIT, since how much memory a
+// partition uses depends on the number of workers, and the report
+// must not.
+
+#ifndef _DETECTOR_OFFLINE_TRACECHECKER_H_
+#define _DETECTOR_OFFLINE_TRACECHECKER_H_
+
+#include "common/defs.h"
+#include "common/TraceFormat.h"
+#include "detector/determinacy/checker.h"
+
+class TraceChecker {
+  public:
+    TraceChecker(uint workers): workerCount(std::max(workers, 1u)) {}
+    ~TraceChecker();
+
+    /**
+     * Maps trace "fileName". Returns false if it is not a trace */
+    bool addTrace(const std::string & fileName);
+
+    /** Checks the traces added, with workerCount threads */
+    VOID check();
+
+    /** Prints the conflicts as Checker::reportConflicts does */
+    VOID reportConflicts() { checker.reportConflicts(); }
+
+    ulong getTraceBytes() const;
+
+  private:
+    // a decoded event of a trace
+    struct Event {
+      tasksan::trace::EventType type;
+      uint64_t seq = 0;
+      uint32_t first = 0;       // task, function or site ID
+      uint32_t second = 0;      // task ID of edges, function of sites
+      uint64_t addr = 0;        // address, or lock
+      uint64_t size = 0;
+      int64_t value = 0;        // value written, or line of sites
+      uint8_t update = OTHER;
+      std::string name1;        // name of a function or .iir file
+    };
+
+    // a mapped trace, and what the first scan found in it
+    struct Trace {
+      std::string fileName;
+      const char * data = NULL;
+      ulong mapped = 0;         // bytes mapped
+      const char * events = NULL;
+      ulong size = 0;           // bytes of complete events
+      char * inflated = NULL;   // events of compressed traces
+      ulong inflatedSize = 0;
+      std::vector<std::pair<INTEGER, INTEGER>> sites; // (func, line)
+      std::vector<Event> functions;                   // and .iir files
+      ulong firstOrdered = 0; // offset of the first event with a seq
+    };
+
+    // an event with a sequence number and the events after it in the
+    // same trace, up to the next such event. Switches precede the
+    // event with the number they carry.
+    struct OrderedEvent {
+      uint64_t seq;
+      bool isSwitch;
+      uint trace;
+      ulong offset;
+      ulong runEnd;
+      bool operator<(const OrderedEvent & other) const {
+        if (seq != other.seq) return seq < other.seq;
+        if (isSwitch != other.isSwitch) return isSwitch;
+        if (trace != other.trace) return trace < other.trace;
+        return offset < other.offset;
+      }
+    };
+
+    static bool isOrdered(tasksan::trace::EventType type);
+    static const char * decode(const char * event, const char * end,
+                               Event & decoded,
+                               tasksan::trace::DeltaState & delta);
+    VOID inflate(Trace & trace);
+
+    VOID scanTrace(uint index, std::vector<OrderedEvent> & ordered);
+    VOID replayOrdered(Checker & target, const Event & event);
+    VOID checkPartition(uint index, Checker * partition);
+    VOID registerFunctions(Checker & target);
+
+    uint workerCount;
+    std::vector<Trace> traces;
+    std::vector<OrderedEvent> orderedEvents; // sorted by seq
+    Checker checker;                         // graph and merged conflicts
+};
+
+#endif // end TraceChecker.h
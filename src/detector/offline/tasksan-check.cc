@@ -0,0 +1,89 @@
+/////////////////////////////////////////////////////////////////
+//  TaskSanitizer: a lightweight determinacy race checking
+//          tool for OpenMP task applications
+//
+//    Copyright (c) 2015 - 2018 Hassan Salehe Matar
+//      Copying or using this code by any means whatsoever
+//      without consent of the owner is strictly prohibited.
+//
+//   Contact: hassansalehe-at-gmail-dot-com
+//
+/////////////////////////////////////////////////////////////////
+
+// Checks the traces a program recorded with TASKSAN_RECORD=<prefix>:
+//   tasksan-check [-j <workers>] <prefix | trace files...>
+// A prefix stands for all traces <prefix>.<thread>.trace. The report
+// is printed to standard output as the online checker prints it.
+
+#include "detector/offline/TraceChecker.h"
+#include <sys/stat.h>
+#include <thread>
+
+static void printUsage() {
+  std::cerr << "usage: tasksan-check [-j <workers>] "
+            << "<trace prefix | trace files...>" << std::endl;
+}
+
+static bool isFile(const std::string & fileName) {
+  struct stat status;
+  return stat(fileName.c_str(), &status) == 0 && S_ISREG(status.st_mode);
+}
+
+int main(int argc, char * argv[]) {
+  uint workers = std::max(std::thread::hardware_concurrency(), 1u);
+  std::vector<std::string> inputs;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "-j" && i + 1 < argc) {
+      workers = std::max(atoi(argv[++i]), 1);
+    } else if (arg.compare(0, 2, "-j") == 0 && arg.size() > 2) {
+      workers = std::max(atoi(arg.c_str() + 2), 1);
+    } else {
+      inputs.push_back( arg );
+    }
+  }
+  if ( inputs.empty() ) {
+    printUsage();
+    return 1;
+  }
+
+  TraceChecker traceChecker(workers);
+  for (auto & input : inputs) {
+    if ( isFile(input) ) {
+      if ( !traceChecker.addTrace(input) ) {
+        std::cerr << "tasksan-check: " << input << " is not a trace"
+                  << std::endl;
+        return 1;
+      }
+      continue;
+    }
+    // a prefix: traces of threads are numbered from 0
+    uint thread = 0;
+    std::string fileName;
+    while ( isFile(fileName = input + "." + std::to_string(thread) +
+                   tasksan::trace::getTraceExtension()) ) {
+      if ( !traceChecker.addTrace(fileName) ) {
+        std::cerr << "tasksan-check: " << fileName << " is not a trace"
+                  << std::endl;
+        return 1;
+      }
+      thread++;
+    }
+    if (thread == 0) {
+      std::cerr << "tasksan-check: no traces " << input << ".*"
+                << tasksan::trace::getTraceExtension() << std::endl;
+      return 1;
+    }
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  traceChecker.check();
+  double seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start ).count();
+
+  traceChecker.reportConflicts();
+  std::cerr << "tasksan-check: checked " << (traceChecker.getTraceBytes() >> 20)
+            << " MB of traces with " << workers << " workers in "
+            << seconds << " s" << std::endl;
+  return 0;
+}
@@ -16,6 +16,8 @@
 #include <thread>
 #include <cassert>
 #include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
 #include "instrumentor/callbacks/OMPTCallbacks.h"
 #include "instrumentor/callbacks/InstrumentationCallbacks.h"
 
@@ -33,6 +35,27 @@ lint getMemoryValue( address addr, ulong size ) {
   return *(static_cast<long long *>(addr));
 }
 
+// nesting depth of parallel regions the thread is running in
+__thread int __tasksan_in_task = 0;
+
+// checking state of the thread, updated when it switches tasks
+__thread unsigned __tasksan_state = 0;
+
+// accesses logged in batches by instrumented code
+__thread tasksan::AccessRecord
+    __tasksan_access_buffer[tasksan::ACCESS_BUFFER_SIZE];
+
+// depth of the nested ignored regions the thread is in
+static __thread unsigned ignoreDepth = 0;
+
+/**
+ * Returns true if the calling thread is in an ignored region. Checked
+ * before anything else by access callbacks, which instrumented code
+ * calls regardless of the state word without the fast-path guard. */
+static inline bool isThreadIgnored() {
+  return __tasksan_state & tasksan::STATE_IGNORED;
+}
+
 // to initialize the logger
 void __tasksan_init() {
   INS::InitTaskSanitizerRuntime();
@@ -71,14 +94,14 @@ inline void INS_MemRead(
     int lineNo,
     address funcName) {
 
-  if (!lineNo) return;
+  if (!lineNo || isThreadIgnored()) return;
 
   TaskInfo * taskInfo = getTaskInfo();
   //lint value = getMemoryValue( addr, size );
   //uint threadID = (uint)pthread_self();
 
   if ( taskInfo && taskInfo->active ) {
-    INS::Read(*taskInfo, addr, lineNo, (char*)funcName);
+    INS::Read(*taskInfo, addr, size, lineNo, (char*)funcName);
 #ifdef DEBUG
     std::stringstream ss;
     ss << std::hex << addr;
@@ -93,17 +116,18 @@ inline void INS_MemRead(
  * Callbacks for store operations  */
 inline void INS_MemWrite(
     address addr,
+    ulong size,
     lint value,
     int lineNo,
     address funcName ) {
 
-  if (!lineNo) return;
+  if (!lineNo || isThreadIgnored()) return;
 
   TaskInfo * taskInfo = getTaskInfo();
   //uint threadID = (uint)pthread_self();
 
   if ( taskInfo && taskInfo->active ) {
-    INS::Write(*taskInfo, addr, (lint)value, lineNo, (char*)funcName );
+    INS::Write(*taskInfo, addr, size, (lint)value, lineNo, (char*)funcName );
 #ifdef DEBUG
     std::stringstream ss;
     ss << std::hex << addr;
@@ -117,6 +141,20 @@ inline void INS_MemWrite(
 }
 
 
+/**
+ * Checks a batch of accesses of function "funcName" which
+ * instrumented code stored into the thread's access buffer */
+void __tasksan_flush_accesses(unsigned count, address funcName) {
+  if ( isThreadIgnored() ) return;
+  if (count > tasksan::ACCESS_BUFFER_SIZE) count = tasksan::ACCESS_BUFFER_SIZE;
+
+  TaskInfo * taskInfo = getTaskInfo();
+  if ( taskInfo && taskInfo->active ) {
+    INS::ProcessAccesses(*taskInfo, __tasksan_access_buffer, count,
+                         (char*)funcName);
+  }
+}
+
 /**
  * A callback for memory writes of floats */
 void __tasksan_write_float(
@@ -124,11 +162,38 @@ void __tasksan_write_float(
     float value,
     int lineNo,
     address funcName) {
-  INS_MemWrite(addr, (lint)value, lineNo, funcName);
+  uint32_t bits;  // the exact value, so that e.g. 0.5 and 0.7 differ
+  memcpy(&bits, &value, sizeof(bits));
+  INS_MemWrite(addr, sizeof(float), (lint)bits, lineNo, funcName);
+}
+
+// glibc's free, called by the interposed free below
+extern "C" void __libc_free(void *ptr);
+
+// set while free records a range, whose buffer may itself be freed
+static __thread bool isRecordingFree = false;
+
+/**
+ * Interposes free, and operator delete which calls it, to drop the
+ * history of freed heap memory before it is reused. The range is
+ * recorded before the memory can be reused and cleared from the
+ * history before the next access is checked. */
+void free(void *ptr) __THROW {
+  if ( ptr && !isRecordingFree &&
+       INS::isOMPTinitialized && INS::isToolEnabled ) {
+    isRecordingFree = true;
+    INS::recordFree( (ADDRESS)ptr, malloc_usable_size(ptr) );
+    isRecordingFree = false;
+  }
+  __libc_free(ptr);
+}
+
+void __tasksan_register_iir_file(void * fileName, void * funcName) {
+  INS::registerIIRfile( (char *)fileName, (char *)funcName );
 }
 
-void __tasksan_register_iir_file(void * fileName) {
-  INS::initCommutativityChecker( (char *)fileName );
+void __tasksan_register_read_only(void * addr, unsigned long size) {
+  INS::registerReadOnly( (ADDRESS)addr, size );
 }
 
 /**
@@ -138,7 +203,9 @@ void __tasksan_write_double(
     double value,
     int lineNo,
     address funcName) {
-  INS_MemWrite(addr, (lint)value, lineNo, funcName);
+  uint64_t bits;  // the exact value
+  memcpy(&bits, &value, sizeof(bits));
+  INS_MemWrite(addr, sizeof(double), (lint)bits, lineNo, funcName);
 }
 
 void __tasksan_flush_memory() {
@@ -165,23 +232,23 @@ void __tasksan_read16(void *addr, int lineNo, address funcName) {
 }
 
 void __tasksan_write1(void *addr, lint value, int lineNo, address funcName) {
-  INS_MemWrite((address)addr, value, lineNo, funcName);
+  INS_MemWrite((address)addr, 1, value, lineNo, funcName);
 }
 
 void __tasksan_write2(void *addr, lint value, int lineNo, address funcName) {
-  INS_MemWrite((address)addr, value, lineNo, funcName);
+  INS_MemWrite((address)addr, 2, value, lineNo, funcName);
 }
 
 void __tasksan_write4(void *addr, lint value, int lineNo, address funcName) {
-  INS_MemWrite((address)addr, value, lineNo, funcName);
+  INS_MemWrite((address)addr, 4, value, lineNo, funcName);
 }
 
 void __tasksan_write8(void *addr, lint value, int lineNo, address funcName) {
-  INS_MemWrite((address)addr, value, lineNo, funcName);
+  INS_MemWrite((address)addr, 8, value, lineNo, funcName);
 }
 
 void __tasksan_write16(void *addr, lint value, int lineNo, address funcName) {
-  INS_MemWrite((address)addr, value, lineNo, funcName);
+  INS_MemWrite((address)addr, 16, value, lineNo, funcName);
 }
 
 void __tasksan_unaligned_read2(const void *addr) {
@@ -263,11 +330,29 @@ void __tasksan_func_exit(void * funcPtr) {
       + std::string((char *)funcPtr));
 }
 
+/**
+ * Starts a region of the calling thread whose accesses are not
+ * checked. Setting STATE_IGNORED fails the inline guard of
+ * instrumented code, so accesses in the region call no callback.
+ * Task events are still tracked. Regions nest. */
+void tasksan_disable() {
+  if (ignoreDepth++ == 0) __tasksan_state |= tasksan::STATE_IGNORED;
+}
+
+/** Ends the innermost ignored region of the calling thread */
+void tasksan_enable() {
+  if (ignoreDepth && --ignoreDepth == 0) {
+    __tasksan_state &= ~tasksan::STATE_IGNORED;
+  }
+}
+
 void __tasksan_ignore_thread_begin() {
   PRINT_DEBUG("  TaskSanitizer: __tasksan_ignore_thread_begin");
+  tasksan_disable();
 }
 void __tasksan_ignore_thread_end() {
   PRINT_DEBUG("  TaskSanitizer: __tasksan_ignore_thread_end");
+  tasksan_enable();
 }
 
 void *__tasksan_external_register_tag(const char *object_type) {
@@ -288,365 +373,299 @@ void __tasksan_external_write(void *addr, void *caller_pc, void *tag) {
 }
 
 
-void __tasksan_read_range(void *addr, unsigned long size) {
-  PRINT_DEBUG("  TaskSanitizer: __tasksan_read_range");
-}  // NOLINT
-
-void __tasksan_write_range(void *addr, unsigned long size) {
-  PRINT_DEBUG("  TaskSanitizer: __tasksan_write_range");
-}  // NOLINT
-
-a8 __tasksan_atomic8_load(const volatile a8 *a, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: __tasksan_atomic8_load");
-  return *a;
-}
-
-a16 __tasksan_atomic16_load(const volatile a16 *a, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: __tasksan_atomic16_load");
-  return *a;
-}
-
-a32 __tasksan_atomic32_load(const volatile a32 *a, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: __tasksan_atomic32_load");
-  return *a;
-}
-
-a64 __tasksan_atomic64_load(const volatile a64 *a, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: __tasksan_atomic64_load");
-  return *a;
-}
-#if __TSAN_HAS_INT128
-
-a128 __tasksan_atomic128_load(const volatile a128 *a, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: ");
-  return *a;
-}
-#endif
-
-
-void __tasksan_atomic8_store(volatile a8 *a, a8 v, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: ");
-}
-
-void __tasksan_atomic16_store(volatile a16 *a, a16 v, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: ");
-}
-
-void __tasksan_atomic32_store(volatile a32 *a, a32 v, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: ");
-}
-
-void __tasksan_atomic64_store(volatile a64 *a, a64 v, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: ");
-}
-#if __TSAN_HAS_INT128
-
-void __tasksan_atomic128_store(volatile a128 *a, a128 v, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: ");
-}
-#endif
-
-
-a8 __tasksan_atomic8_exchange(volatile a8 *a, a8 v, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: atomic8 echange");
-  return v;
-}
-
-a16 __tasksan_atomic16_exchange(volatile a16 *a, a16 v, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: atomic exchange");
-  return v;
-}
-
-a32 __tasksan_atomic32_exchange(volatile a32 *a, a32 v, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: atomic exchange");
-  return v;
-}
-
-a64 __tasksan_atomic64_exchange(volatile a64 *a, a64 v, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: atomic exchange");
-  return v;
-}
-#if __TSAN_HAS_INT128
-
-a128 __tasksan_atomic128_exchange(volatile a128 *a, a128 v, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: atomic exchange");
-  return v;
-}
-#endif
-
-
-a8 __tasksan_atomic8_fetch_add(volatile a8 *a, a8 v, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: atomic8 fetch_add");
-  return v;
-}
-
-a16 __tasksan_atomic16_fetch_add(volatile a16 *a, a16 v, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: atomic16 fetch_add");
-  return v;
-}
-
-a32 __tasksan_atomic32_fetch_add(volatile a32 *a, a32 v, morder mo) {
-  // Fetch and add is commutative among tasks.
-  // Therefore. no need to check for determinacy race.
-  return __sync_fetch_and_add(a, v);
-}
-
-a64 __tasksan_atomic64_fetch_add(volatile a64 *a, a64 v, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: atomic64 fetch_add");
-  return v;
-}
-#if __TSAN_HAS_INT128
-
-a128 __tasksan_atomic128_fetch_add(volatile a128 *a, a128 v, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: atomic 128 fetch_add");
-  return v;
-}
-#endif
-
-
-a8 __tasksan_atomic8_fetch_sub(volatile a8 *a, a8 v, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: ");
-  return v;
-}
-
-a16 __tasksan_atomic16_fetch_sub(volatile a16 *a, a16 v, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: ");
-  return v;
-}
-
-a32 __tasksan_atomic32_fetch_sub(volatile a32 *a, a32 v, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: ");
-  return v;
-}
-
-a64 __tasksan_atomic64_fetch_sub(volatile a64 *a, a64 v, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: ");
-  return v;
-}
-#if __TSAN_HAS_INT128
-
-a128 __tasksan_atomic128_fetch_sub(volatile a128 *a, a128 v, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: ");
-  return v;
-}
-#endif
-
-
-a8 __tasksan_atomic8_fetch_and(volatile a8 *a, a8 v, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: ");
-  return v;
-}
-
-a16 __tasksan_atomic16_fetch_and(volatile a16 *a, a16 v, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: ");
-  return v;
-}
-
-a32 __tasksan_atomic32_fetch_and(volatile a32 *a, a32 v, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: ");
-  return v;
-}
-
-a64 __tasksan_atomic64_fetch_and(volatile a64 *a, a64 v, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: ");
-  return v;
-}
-#if __TSAN_HAS_INT128
-
-a128 __tasksan_atomic128_fetch_and(volatile a128 *a, a128 v, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: ");
-  return v;
-}
-#endif
-
-
-a8 __tasksan_atomic8_fetch_or(volatile a8 *a, a8 v, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: ");
-  return v;
-}
-
-a16 __tasksan_atomic16_fetch_or(volatile a16 *a, a16 v, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: ");
-  return v;
-}
+/**
+ * Checks "size" bytes from "addr" as elements of "elemSize" bytes.
+ * The elements are checked in batches of access records, so that the
+ * function is looked up and the lock taken once per batch. */
+static inline void INS_MemRange(
+    address addr,
+    ulong size,
+    uint elemSize,
+    int lineNo,
+    address funcName,
+    bool isWrite) {
 
-a32 __tasksan_atomic32_fetch_or(volatile a32 *a, a32 v, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: ");
-  return v;
-}
+  if (!lineNo || !elemSize || elemSize > sizeof(lint)) return;
+  if ( isThreadIgnored() ) return;
 
-a64 __tasksan_atomic64_fetch_or(volatile a64 *a, a64 v, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: ");
-  return v;
+  TaskInfo * taskInfo = getTaskInfo();
+  if ( !taskInfo || !taskInfo->active ) return;
+
+  tasksan::AccessRecord records[tasksan::ACCESS_BUFFER_SIZE];
+  unsigned count = 0;
+  for (ulong offset = 0; offset + elemSize <= size; offset += elemSize) {
+    tasksan::AccessRecord & record = records[count++];
+    record.addr   = (char *)addr + offset;
+    record.value  = 0;
+    record.lineNo = lineNo;
+    record.kind   = elemSize | (isWrite ? tasksan::ACCESS_WRITE : 0);
+    // the bytes written, zero-extended like values of batched writes
+    if (isWrite) memcpy(&record.value, record.addr, elemSize);
+
+    if (count == tasksan::ACCESS_BUFFER_SIZE) {
+      INS::ProcessAccesses(*taskInfo, records, count, (char*)funcName);
+      count = 0;
+    }
+  }
+  if (count) INS::ProcessAccesses(*taskInfo, records, count, (char*)funcName);
 }
-#if __TSAN_HAS_INT128
 
-a128 __tasksan_atomic128_fetch_or(volatile a128 *a, a128 v, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: ");
-  return v;
-}
-#endif
+void __tasksan_read_range(void *addr, unsigned long size,
+    unsigned elemSize, int lineNo, address funcName) {
+  INS_MemRange(addr, size, elemSize, lineNo, funcName, false);
+}  // NOLINT
 
+void __tasksan_write_range(void *addr, unsigned long size,
+    unsigned elemSize, int lineNo, address funcName) {
+  INS_MemRange(addr, size, elemSize, lineNo, funcName, true);
+}  // NOLINT
 
-a8 __tasksan_atomic8_fetch_xor(volatile a8 *a, a8 v, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: ");
-  return v;
+/**
+ * Memory orders valid for atomic loads, stores and for the failure
+ * case of compare-and-swap. Orders not allowed by the C++11 memory
+ * model for an operation are strengthened to the nearest valid one. */
+static inline int loadOrder(morder mo) {
+  if (mo == mo_release) return __ATOMIC_ACQUIRE;
+  if (mo == mo_acq_rel) return __ATOMIC_ACQUIRE;
+  return (int)mo;
 }
 
-a16 __tasksan_atomic16_fetch_xor(volatile a16 *a, a16 v, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: ");
-  return v;
+static inline int storeOrder(morder mo) {
+  if (mo == mo_consume || mo == mo_acquire) return __ATOMIC_RELEASE;
+  if (mo == mo_acq_rel) return __ATOMIC_SEQ_CST;
+  return (int)mo;
 }
 
-a32 __tasksan_atomic32_fetch_xor(volatile a32 *a, a32 v, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: ");
-  return v;
+static inline int failureOrder(morder fmo) {
+  if (fmo == mo_release) return __ATOMIC_RELAXED;
+  if (fmo == mo_acq_rel) return __ATOMIC_ACQUIRE;
+  return (int)fmo;
 }
 
-a64 __tasksan_atomic64_fetch_xor(volatile a64 *a, a64 v, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: ");
-  return v;
-}
-#if __TSAN_HAS_INT128
+/**
+ * Atomic read-modify-write operations. "fetch" performs the operation
+ * and returns the old value, "apply" computes the value written from
+ * the old value, and "update" is the kind of update recorded for
+ * determinacy race checking. Additions and subtractions commute with
+ * each other, so both are recorded as ADD. Exchange and nand do not
+ * commute and are recorded as plain writes (OTHER). */
+struct AtomicExchange {
+  static const OPERATION update = OTHER;
+  template<typename T> static T fetch(volatile T *a, T v, int mo) {
+    return __atomic_exchange_n(a, v, mo);
+  }
+  template<typename T> static T apply(T old, T v) { return v; }
+};
 
-a128 __tasksan_atomic128_fetch_xor(volatile a128 *a, a128 v, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: ");
-  return v;
-}
-#endif
+struct AtomicAdd {
+  static const OPERATION update = ADD;
+  template<typename T> static T fetch(volatile T *a, T v, int mo) {
+    return __atomic_fetch_add(a, v, mo);
+  }
+  template<typename T> static T apply(T old, T v) { return old + v; }
+};
 
+struct AtomicSub {
+  static const OPERATION update = ADD;
+  template<typename T> static T fetch(volatile T *a, T v, int mo) {
+    return __atomic_fetch_sub(a, v, mo);
+  }
+  template<typename T> static T apply(T old, T v) { return old - v; }
+};
 
-a8 __tasksan_atomic8_fetch_nand(volatile a8 *a, a8 v, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: ");
-  return v;
-}
+struct AtomicAnd {
+  static const OPERATION update = AND;
+  template<typename T> static T fetch(volatile T *a, T v, int mo) {
+    return __atomic_fetch_and(a, v, mo);
+  }
+  template<typename T> static T apply(T old, T v) { return old & v; }
+};
 
-a16 __tasksan_atomic16_fetch_nand(volatile a16 *a, a16 v, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: ");
-  return v;
-}
+struct AtomicOr {
+  static const OPERATION update = OR;
+  template<typename T> static T fetch(volatile T *a, T v, int mo) {
+    return __atomic_fetch_or(a, v, mo);
+  }
+  template<typename T> static T apply(T old, T v) { return old | v; }
+};
 
-a32 __tasksan_atomic32_fetch_nand(volatile a32 *a, a32 v, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: ");
-  return v;
-}
+struct AtomicXor {
+  static const OPERATION update = XOR;
+  template<typename T> static T fetch(volatile T *a, T v, int mo) {
+    return __atomic_fetch_xor(a, v, mo);
+  }
+  template<typename T> static T apply(T old, T v) { return old ^ v; }
+};
 
-a64 __tasksan_atomic64_fetch_nand(volatile a64 *a, a64 v, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: ");
-  return v;
-}
-#if __TSAN_HAS_INT128
+struct AtomicNand {
+  static const OPERATION update = OTHER;
+  template<typename T> static T fetch(volatile T *a, T v, int mo) {
+    return __atomic_fetch_nand(a, v, mo);
+  }
+  template<typename T> static T apply(T old, T v) { return ~(old & v); }
+};
 
-a128 __tasksan_atomic128_fetch_nand(volatile a128 *a, a128 v, morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: ");
-  return v;
+template<typename T>
+static inline T atomicLoad(const volatile T *a, morder mo) {
+  return __atomic_load_n(a, loadOrder(mo));
 }
-#endif
-
 
-int __tasksan_atomic8_compare_exchange_strong(volatile a8 *a, a8 *c, a8 v,
-                                           morder mo, morder fmo) {
-  PRINT_DEBUG("  TaskSanitizer: ");
-  return v;
+template<typename T>
+static inline void atomicStore(volatile T *a, T v, morder mo) {
+  __atomic_store_n(a, v, storeOrder(mo));
 }
 
-int __tasksan_atomic16_compare_exchange_strong(volatile a16 *a, a16 *c, a16 v,
-                                            morder mo, morder fmo) {
-  PRINT_DEBUG("  TaskSanitizer: ");
-  return v;
+template<typename Op, typename T>
+static inline T atomicRMW(volatile T *a, T v, morder mo) {
+  return Op::fetch(a, v, (int)mo);
 }
 
-int __tasksan_atomic32_compare_exchange_strong(volatile a32 *a, a32 *c, a32 v,
-                                            morder mo, morder fmo) {
-  PRINT_DEBUG("  TaskSanitizer: ");
-  return v;
+/** Returns true if "*a" was "*c" and is now "v", else loads "*a" to "*c" */
+template<typename T>
+static inline bool atomicCAS(volatile T *a, T *c, T v,
+                             morder mo, morder fmo, bool weak) {
+  return __atomic_compare_exchange_n(a, c, v, weak, (int)mo,
+                                     failureOrder(fmo));
 }
 
-int __tasksan_atomic64_compare_exchange_strong(volatile a64 *a, a64 *c, a64 v,
-                                            morder mo, morder fmo) {
-  PRINT_DEBUG("  TaskSanitizer: ");
-  return v;
-}
 #if __TSAN_HAS_INT128
+// 16-byte atomics would need libatomic or a native 16-byte CAS, which
+// is not available on every target. They are rare in task programs,
+// hence they are serialized by a lock chosen by the address.
+static std::mutex atomic128Locks[64];
 
-int __tasksan_atomic128_compare_exchange_strong(volatile a128 *a, a128 *c, a128 v,
-                                             morder mo, morder fmo) {
-  PRINT_DEBUG("  TaskSanitizer: ");
-  return v;
+static inline std::mutex & getAtomic128Lock(const volatile a128 *a) {
+  return atomic128Locks[((unsigned long)a >> 4) % 64];
 }
-#endif
-
 
-int __tasksan_atomic8_compare_exchange_weak(volatile a8 *a, a8 *c, a8 v, morder mo,
-                                         morder fmo) {
-  PRINT_DEBUG("  TaskSanitizer: atomic8 cpex weak");
-  return v;
-}
-
-int __tasksan_atomic16_compare_exchange_weak(volatile a16 *a, a16 *c, a16 v,
-                                          morder mo, morder fmo) {
-  PRINT_DEBUG("  TaskSanitizer: atomic16 cpex weak");
-  return v;
+template<>
+inline a128 atomicLoad<a128>(const volatile a128 *a, morder mo) {
+  std::lock_guard<std::mutex> guard( getAtomic128Lock(a) );
+  return *a;
 }
 
-int __tasksan_atomic32_compare_exchange_weak(volatile a32 *a, a32 *c, a32 v,
-                                          morder mo, morder fmo) {
-  PRINT_DEBUG("  TaskSanitizer: atomic32 cpex weak");
-  return v;
+template<>
+inline void atomicStore<a128>(volatile a128 *a, a128 v, morder mo) {
+  std::lock_guard<std::mutex> guard( getAtomic128Lock(a) );
+  *a = v;
 }
 
-int __tasksan_atomic64_compare_exchange_weak(volatile a64 *a, a64 *c, a64 v,
-                                          morder mo, morder fmo) {
-  PRINT_DEBUG("  TaskSanitizer: atomic64 cpex weak");
-  return v;
+template<typename Op>
+static inline a128 atomicRMW(volatile a128 *a, a128 v, morder mo) {
+  std::lock_guard<std::mutex> guard( getAtomic128Lock(a) );
+  a128 old = *a;
+  *a = Op::apply(old, v);
+  return old;
 }
-#if __TSAN_HAS_INT128
 
-int __tasksan_atomic128_compare_exchange_weak(volatile a128 *a, a128 *c, a128 v,
-                                           morder mo, morder fmo) {
-  PRINT_DEBUG("  TaskSanitizer: atomic128 cpex weak");
-  return v;
+template<>
+inline bool atomicCAS<a128>(volatile a128 *a, a128 *c, a128 v,
+                            morder mo, morder fmo, bool weak) {
+  std::lock_guard<std::mutex> guard( getAtomic128Lock(a) );
+  a128 old = *a;
+  if (old == *c) {
+    *a = v;
+    return true;
+  }
+  *c = old;
+  return false;
 }
 #endif
 
+/**
+ * Records an atomic read-modify-write as a write of the new value.
+ * Concurrent updates of the same kind (e.g. two fetch_adds) commute
+ * and are not reported, see Checker::isCommutativeUpdate. */
+inline void INS_AtomicUpdate(
+    address addr,
+    ulong size,
+    lint value,
+    OPERATION update,
+    int lineNo,
+    address funcName ) {
 
-a8 __tasksan_atomic8_compare_exchange_val(volatile a8 *a, a8 c, a8 v, morder mo,
-                                       morder fmo) {
-  PRINT_DEBUG("  TaskSanitizer: atomic8 cpex");
-  return v;
-}
-
-a16 __tasksan_atomic16_compare_exchange_val(volatile a16 *a, a16 c, a16 v,
-                                         morder mo, morder fmo) {
-  PRINT_DEBUG("  TaskSanitizer: atomic16 cpex");
-  return v;
-}
+  if (!lineNo || isThreadIgnored()) return;
 
-a32 __tasksan_atomic32_compare_exchange_val(volatile a32 *a, a32 c, a32 v,
-                                         morder mo, morder fmo) {
-  PRINT_DEBUG("  TaskSanitizer: atomic32 cpex");
-  return v;
+  TaskInfo * taskInfo = getTaskInfo();
+  if ( taskInfo && taskInfo->active ) {
+    INS::Write(*taskInfo, addr, size, value, lineNo, (char*)funcName, update);
+  }
 }
 
-a64 __tasksan_atomic64_compare_exchange_val(volatile a64 *a, a64 c, a64 v,
-                                         morder mo, morder fmo) {
-  PRINT_DEBUG("  TaskSanitizer: atomic64 cpex");
-  return v;
-}
+#define TASKSAN_ATOMIC_LOAD(size)                                          \
+a##size __tasksan_atomic##size##_load(const volatile a##size *a,          \
+    morder mo, int lineNo, address funcName) {                             \
+  a##size v = atomicLoad(a, mo);                                           \
+  INS_MemRead((address)a, sizeof(a##size), lineNo, funcName);              \
+  return v;                                                                \
+}
+
+#define TASKSAN_ATOMIC_STORE(size)                                         \
+void __tasksan_atomic##size##_store(volatile a##size *a, a##size v,       \
+    morder mo, int lineNo, address funcName) {                             \
+  atomicStore(a, v, mo);                                                   \
+  INS_MemWrite((address)a, sizeof(a##size), (lint)v, lineNo, funcName);    \
+}
+
+#define TASKSAN_ATOMIC_RMW(size, name, Op)                                 \
+a##size __tasksan_atomic##size##_##name(volatile a##size *a, a##size v,   \
+    morder mo, int lineNo, address funcName) {                             \
+  a##size old = atomicRMW<Op>(a, v, mo);                                   \
+  INS_AtomicUpdate((address)a, sizeof(a##size), (lint)Op::apply(old, v),  \
+                   Op::update, lineNo, funcName);                          \
+  return old;                                                              \
+}
+
+// a successful compare-and-swap writes "v", a failed one only reads
+#define TASKSAN_ATOMIC_CAS(size, name, weak)                               \
+int __tasksan_atomic##size##_compare_exchange_##name(volatile a##size *a, \
+    a##size *c, a##size v, morder mo, morder fmo,                          \
+    int lineNo, address funcName) {                                        \
+  bool success = atomicCAS(a, c, v, mo, fmo, weak);                        \
+  if (success) INS_MemWrite((address)a, sizeof(a##size), (lint)v,         \
+                           lineNo, funcName);                              \
+  else INS_MemRead((address)a, sizeof(a##size), lineNo, funcName);         \
+  return success;                                                          \
+}
+
+#define TASKSAN_ATOMIC_CAS_VAL(size)                                       \
+a##size __tasksan_atomic##size##_compare_exchange_val(volatile a##size *a,\
+    a##size c, a##size v, morder mo, morder fmo,                           \
+    int lineNo, address funcName) {                                        \
+  if (atomicCAS(a, &c, v, mo, fmo, false)) {                               \
+    INS_MemWrite((address)a, sizeof(a##size), (lint)v, lineNo, funcName);  \
+  } else {                                                                 \
+    INS_MemRead((address)a, sizeof(a##size), lineNo, funcName);            \
+  }                                                                        \
+  return c;                                                                \
+}
+
+#define TASKSAN_ATOMIC_CALLBACKS(size)                                     \
+  TASKSAN_ATOMIC_LOAD(size)                                                \
+  TASKSAN_ATOMIC_STORE(size)                                               \
+  TASKSAN_ATOMIC_RMW(size, exchange,  AtomicExchange)                      \
+  TASKSAN_ATOMIC_RMW(size, fetch_add, AtomicAdd)                           \
+  TASKSAN_ATOMIC_RMW(size, fetch_sub, AtomicSub)                           \
+  TASKSAN_ATOMIC_RMW(size, fetch_and, AtomicAnd)                           \
+  TASKSAN_ATOMIC_RMW(size, fetch_or,  AtomicOr)                            \
+  TASKSAN_ATOMIC_RMW(size, fetch_xor, AtomicXor)                           \
+  TASKSAN_ATOMIC_RMW(size, fetch_nand, AtomicNand)                         \
+  TASKSAN_ATOMIC_CAS(size, strong, false)                                  \
+  TASKSAN_ATOMIC_CAS(size, weak, true)                                     \
+  TASKSAN_ATOMIC_CAS_VAL(size)
+
+TASKSAN_ATOMIC_CALLBACKS(8)
+TASKSAN_ATOMIC_CALLBACKS(16)
+TASKSAN_ATOMIC_CALLBACKS(32)
+TASKSAN_ATOMIC_CALLBACKS(64)
 #if __TSAN_HAS_INT128
-
-a128 __tasksan_atomic128_compare_exchange_val(volatile a128 *a, a128 c, a128 v,
-                                           morder mo, morder fmo) {
-  PRINT_DEBUG("  TaskSanitizer: atomic128 cpex");
-  return v;
-}
+TASKSAN_ATOMIC_CALLBACKS(128)
 #endif
 
-
 void __tasksan_atomic_thread_fence(morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: __tasksan_atomic_thread_fence");
+  __atomic_thread_fence((int)mo);
 }
 
 void __tasksan_atomic_signal_fence(morder mo) {
-  PRINT_DEBUG("  TaskSanitizer: __tasksan_atomic_signal_fence");
+  __atomic_signal_fence((int)mo);
 }
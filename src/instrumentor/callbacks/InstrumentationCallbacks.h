@@ -16,6 +16,8 @@
 #define _INSTRUMENTOR_CALLBACKS_INSTRUMENTATIONCALLBACKS_H_
 
 #include "common/defs.h"
+#include "common/RuntimeState.h"
+#include "common/AccessBuffer.h"
 #include <iostream>
 #include <pthread.h>
 #include <unordered_map>
@@ -70,7 +72,27 @@ extern "C" {
   // before any instrumented code is executed and before any call to malloc.
   void __tasksan_init();
 
-  void __tasksan_register_iir_file(void *);
+  // registers .iir file of a function, called from module constructors
+  void __tasksan_register_iir_file(void *fileName, void *funcName);
+
+  // registers a global which tasks only read, called from module
+  // constructors; reads from [addr, addr + size) are not checked
+  void __tasksan_register_read_only(void *addr, unsigned long size);
+
+  // nonzero while the thread runs an implicit task of a parallel region;
+  // instrumented functions call their serial clones when it is zero
+  extern __thread int __tasksan_in_task;
+
+  // state word checked by instrumented code before access callbacks,
+  // see common/RuntimeState.h
+  extern __thread unsigned __tasksan_state;
+
+  // records of accesses logged in batches, see common/AccessBuffer.h
+  extern __thread tasksan::AccessRecord
+      __tasksan_access_buffer[tasksan::ACCESS_BUFFER_SIZE];
+
+  // checks the first "count" records of the access buffer
+  void __tasksan_flush_accesses(unsigned count, address funcName);
 
   void __tasksan_flush_memory();
 
@@ -114,6 +136,10 @@ extern "C" {
   void __tasksan_func_entry(void *call_pc);
   void __tasksan_func_exit(void * funcPtr);
 
+  // ignored regions of the calling thread, see tasksan_interface.h;
+  // the pass inserts the latter pair around functions not checked
+  void tasksan_disable();
+  void tasksan_enable();
   void __tasksan_ignore_thread_begin();
   void __tasksan_ignore_thread_end();
 
@@ -122,14 +148,22 @@ extern "C" {
   void __tasksan_external_read(void *addr, void *caller_pc, void *tag);
   void __tasksan_external_write(void *addr, void *caller_pc, void *tag);
 
-  void __tasksan_read_range(void *addr, unsigned long size);  // NOLINT
-  void __tasksan_write_range(void *addr, unsigned long size);  // NOLINT
+  // check "size" bytes from "addr" as consecutive elements of
+  // "elemSize" bytes, e.g. adjacent fields read or written on one line.
+  // Written values are loaded from memory, so writes are checked after
+  // the stores.
+  void __tasksan_read_range(void *addr, unsigned long size,  // NOLINT
+                            unsigned elemSize, int lineNo, address funcName);
+  void __tasksan_write_range(void *addr, unsigned long size,  // NOLINT
+                             unsigned elemSize, int lineNo, address funcName);
 
   #ifdef __cplusplus
   }  // extern "C"
   #endif
 
   // These should match declarations from public tasksan_interface_atomic.h header.
+  // Atomic callbacks additionally take the source line and function name
+  // of the access, like the plain read and write callbacks.
   typedef unsigned char      a8;
   typedef unsigned short     a16;  // NOLINT
   typedef unsigned int       a32;
@@ -155,115 +189,175 @@ extern "C" {
 
   extern "C" {
 
-  a8 __tasksan_atomic8_load(const volatile a8 *a,    morder mo);
-  a16 __tasksan_atomic16_load(const volatile a16 *a, morder mo);
-  a32 __tasksan_atomic32_load(const volatile a32 *a, morder mo);
-  a64 __tasksan_atomic64_load(const volatile a64 *a, morder mo);
+  a8 __tasksan_atomic8_load(const volatile a8 *a,    morder mo,
+      int lineNo, address funcName);
+  a16 __tasksan_atomic16_load(const volatile a16 *a, morder mo,
+      int lineNo, address funcName);
+  a32 __tasksan_atomic32_load(const volatile a32 *a, morder mo,
+      int lineNo, address funcName);
+  a64 __tasksan_atomic64_load(const volatile a64 *a, morder mo,
+      int lineNo, address funcName);
   #if __TSAN_HAS_INT128
-  a128 __tasksan_atomic128_load(const volatile a128 *a, morder mo);
+  a128 __tasksan_atomic128_load(const volatile a128 *a, morder mo,
+      int lineNo, address funcName);
   #endif
 
-  void __tasksan_atomic8_store(volatile a8 *a,   a8 v,  morder mo);
-  void __tasksan_atomic16_store(volatile a16 *a, a16 v, morder mo);
-  void __tasksan_atomic32_store(volatile a32 *a, a32 v, morder mo);
-  void __tasksan_atomic64_store(volatile a64 *a, a64 v, morder mo);
+  void __tasksan_atomic8_store(volatile a8 *a,   a8 v,  morder mo,
+      int lineNo, address funcName);
+  void __tasksan_atomic16_store(volatile a16 *a, a16 v, morder mo,
+      int lineNo, address funcName);
+  void __tasksan_atomic32_store(volatile a32 *a, a32 v, morder mo,
+      int lineNo, address funcName);
+  void __tasksan_atomic64_store(volatile a64 *a, a64 v, morder mo,
+      int lineNo, address funcName);
   #if __TSAN_HAS_INT128
-  void __tasksan_atomic128_store(volatile a128 *a, a128 v, morder mo);
+  void __tasksan_atomic128_store(volatile a128 *a, a128 v, morder mo,
+      int lineNo, address funcName);
   #endif
 
-  a8  __tasksan_atomic8_exchange(volatile a8 *a,    a8 v,  morder mo);
-  a16 __tasksan_atomic16_exchange(volatile a16 *a, a16 v, morder mo);
-  a32 __tasksan_atomic32_exchange(volatile a32 *a, a32 v, morder mo);
-  a64 __tasksan_atomic64_exchange(volatile a64 *a, a64 v, morder mo);
+  a8  __tasksan_atomic8_exchange(volatile a8 *a,    a8 v,  morder mo,
+      int lineNo, address funcName);
+  a16 __tasksan_atomic16_exchange(volatile a16 *a, a16 v, morder mo,
+      int lineNo, address funcName);
+  a32 __tasksan_atomic32_exchange(volatile a32 *a, a32 v, morder mo,
+      int lineNo, address funcName);
+  a64 __tasksan_atomic64_exchange(volatile a64 *a, a64 v, morder mo,
+      int lineNo, address funcName);
   #if __TSAN_HAS_INT128
-  a128 __tasksan_atomic128_exchange(volatile a128 *a, a128 v, morder mo);
+  a128 __tasksan_atomic128_exchange(volatile a128 *a, a128 v, morder mo,
+      int lineNo, address funcName);
   #endif
 
-  a8  __tasksan_atomic8_fetch_add(volatile a8 *a, a8 v, morder mo);
-  a16 __tasksan_atomic16_fetch_add(volatile a16 *a, a16 v, morder mo);
-  a32 __tasksan_atomic32_fetch_add(volatile a32 *a, a32 v, morder mo);
-  a64 __tasksan_atomic64_fetch_add(volatile a64 *a, a64 v, morder mo);
+  a8  __tasksan_atomic8_fetch_add(volatile a8 *a, a8 v, morder mo,
+      int lineNo, address funcName);
+  a16 __tasksan_atomic16_fetch_add(volatile a16 *a, a16 v, morder mo,
+      int lineNo, address funcName);
+  a32 __tasksan_atomic32_fetch_add(volatile a32 *a, a32 v, morder mo,
+      int lineNo, address funcName);
+  a64 __tasksan_atomic64_fetch_add(volatile a64 *a, a64 v, morder mo,
+      int lineNo, address funcName);
   #if __TSAN_HAS_INT128
-  a128 __tasksan_atomic128_fetch_add(volatile a128 *a, a128 v, morder mo);
+  a128 __tasksan_atomic128_fetch_add(volatile a128 *a, a128 v, morder mo,
+      int lineNo, address funcName);
   #endif
 
-  a8  __tasksan_atomic8_fetch_sub(volatile a8 *a, a8 v, morder mo);
-  a16 __tasksan_atomic16_fetch_sub(volatile a16 *a, a16 v, morder mo);
-  a32 __tasksan_atomic32_fetch_sub(volatile a32 *a, a32 v, morder mo);
-  a64 __tasksan_atomic64_fetch_sub(volatile a64 *a, a64 v, morder mo);
+  a8  __tasksan_atomic8_fetch_sub(volatile a8 *a, a8 v, morder mo,
+      int lineNo, address funcName);
+  a16 __tasksan_atomic16_fetch_sub(volatile a16 *a, a16 v, morder mo,
+      int lineNo, address funcName);
+  a32 __tasksan_atomic32_fetch_sub(volatile a32 *a, a32 v, morder mo,
+      int lineNo, address funcName);
+  a64 __tasksan_atomic64_fetch_sub(volatile a64 *a, a64 v, morder mo,
+      int lineNo, address funcName);
   #if __TSAN_HAS_INT128
-  a128 __tasksan_atomic128_fetch_sub(volatile a128 *a, a128 v, morder mo);
+  a128 __tasksan_atomic128_fetch_sub(volatile a128 *a, a128 v, morder mo,
+      int lineNo, address funcName);
   #endif
 
-  a8  __tasksan_atomic8_fetch_and(volatile a8 *a, a8 v, morder mo);
-  a16 __tasksan_atomic16_fetch_and(volatile a16 *a, a16 v, morder mo);
-  a32 __tasksan_atomic32_fetch_and(volatile a32 *a, a32 v, morder mo);
-  a64 __tasksan_atomic64_fetch_and(volatile a64 *a, a64 v, morder mo);
+  a8  __tasksan_atomic8_fetch_and(volatile a8 *a, a8 v, morder mo,
+      int lineNo, address funcName);
+  a16 __tasksan_atomic16_fetch_and(volatile a16 *a, a16 v, morder mo,
+      int lineNo, address funcName);
+  a32 __tasksan_atomic32_fetch_and(volatile a32 *a, a32 v, morder mo,
+      int lineNo, address funcName);
+  a64 __tasksan_atomic64_fetch_and(volatile a64 *a, a64 v, morder mo,
+      int lineNo, address funcName);
   #if __TSAN_HAS_INT128
-  a128 __tasksan_atomic128_fetch_and(volatile a128 *a, a128 v, morder mo);
+  a128 __tasksan_atomic128_fetch_and(volatile a128 *a, a128 v, morder mo,
+      int lineNo, address funcName);
   #endif
 
-  a8  __tasksan_atomic8_fetch_or(volatile a8 *a, a8 v, morder mo);
-  a16 __tasksan_atomic16_fetch_or(volatile a16 *a, a16 v, morder mo);
-  a32 __tasksan_atomic32_fetch_or(volatile a32 *a, a32 v, morder mo);
-  a64 __tasksan_atomic64_fetch_or(volatile a64 *a, a64 v, morder mo);
+  a8  __tasksan_atomic8_fetch_or(volatile a8 *a, a8 v, morder mo,
+      int lineNo, address funcName);
+  a16 __tasksan_atomic16_fetch_or(volatile a16 *a, a16 v, morder mo,
+      int lineNo, address funcName);
+  a32 __tasksan_atomic32_fetch_or(volatile a32 *a, a32 v, morder mo,
+      int lineNo, address funcName);
+  a64 __tasksan_atomic64_fetch_or(volatile a64 *a, a64 v, morder mo,
+      int lineNo, address funcName);
   #if __TSAN_HAS_INT128
-  a128 __tasksan_atomic128_fetch_or(volatile a128 *a, a128 v, morder mo);
+  a128 __tasksan_atomic128_fetch_or(volatile a128 *a, a128 v, morder mo,
+      int lineNo, address funcName);
   #endif
 
-  a8  __tasksan_atomic8_fetch_xor(volatile a8 *a, a8 v, morder mo);
-  a16 __tasksan_atomic16_fetch_xor(volatile a16 *a, a16 v, morder mo);
-  a32 __tasksan_atomic32_fetch_xor(volatile a32 *a, a32 v, morder mo);
-  a64 __tasksan_atomic64_fetch_xor(volatile a64 *a, a64 v, morder mo);
+  a8  __tasksan_atomic8_fetch_xor(volatile a8 *a, a8 v, morder mo,
+      int lineNo, address funcName);
+  a16 __tasksan_atomic16_fetch_xor(volatile a16 *a, a16 v, morder mo,
+      int lineNo, address funcName);
+  a32 __tasksan_atomic32_fetch_xor(volatile a32 *a, a32 v, morder mo,
+      int lineNo, address funcName);
+  a64 __tasksan_atomic64_fetch_xor(volatile a64 *a, a64 v, morder mo,
+      int lineNo, address funcName);
   #if __TSAN_HAS_INT128
-  a128 __tasksan_atomic128_fetch_xor(volatile a128 *a, a128 v, morder mo);
+  a128 __tasksan_atomic128_fetch_xor(volatile a128 *a, a128 v, morder mo,
+      int lineNo, address funcName);
   #endif
 
-  a8  __tasksan_atomic8_fetch_nand(volatile a8 *a, a8 v, morder mo);
-  a16 __tasksan_atomic16_fetch_nand(volatile a16 *a, a16 v, morder mo);
-  a32 __tasksan_atomic32_fetch_nand(volatile a32 *a, a32 v, morder mo);
-  a64 __tasksan_atomic64_fetch_nand(volatile a64 *a, a64 v, morder mo);
+  a8  __tasksan_atomic8_fetch_nand(volatile a8 *a, a8 v, morder mo,
+      int lineNo, address funcName);
+  a16 __tasksan_atomic16_fetch_nand(volatile a16 *a, a16 v, morder mo,
+      int lineNo, address funcName);
+  a32 __tasksan_atomic32_fetch_nand(volatile a32 *a, a32 v, morder mo,
+      int lineNo, address funcName);
+  a64 __tasksan_atomic64_fetch_nand(volatile a64 *a, a64 v, morder mo,
+      int lineNo, address funcName);
   #if __TSAN_HAS_INT128
-  a128 __tasksan_atomic128_fetch_nand(volatile a128 *a, a128 v, morder mo);
+  a128 __tasksan_atomic128_fetch_nand(volatile a128 *a, a128 v, morder mo,
+      int lineNo, address funcName);
   #endif
 
   int __tasksan_atomic8_compare_exchange_strong(volatile a8 *a, a8 *c, a8 v,
-                                             morder mo, morder fmo);
+                                             morder mo, morder fmo,
+      int lineNo, address funcName);
   int __tasksan_atomic16_compare_exchange_strong(volatile a16 *a, a16 *c, a16 v,
-                                              morder mo, morder fmo);
+                                              morder mo, morder fmo,
+      int lineNo, address funcName);
   int __tasksan_atomic32_compare_exchange_strong(volatile a32 *a, a32 *c, a32 v,
-                                              morder mo, morder fmo);
+                                              morder mo, morder fmo,
+      int lineNo, address funcName);
   int __tasksan_atomic64_compare_exchange_strong(volatile a64 *a, a64 *c, a64 v,
-                                              morder mo, morder fmo);
+                                              morder mo, morder fmo,
+      int lineNo, address funcName);
   #if __TSAN_HAS_INT128
   int __tasksan_atomic128_compare_exchange_strong(volatile a128 *a, a128 *c, a128 v,
-                                               morder mo, morder fmo);
+                                               morder mo, morder fmo,
+      int lineNo, address funcName);
   #endif
 
   int __tasksan_atomic8_compare_exchange_weak(volatile a8 *a, a8 *c, a8 v, morder mo,
-                                           morder fmo);
+                                           morder fmo,
+      int lineNo, address funcName);
   int __tasksan_atomic16_compare_exchange_weak(volatile a16 *a, a16 *c, a16 v,
-                                            morder mo, morder fmo);
+                                            morder mo, morder fmo,
+      int lineNo, address funcName);
   int __tasksan_atomic32_compare_exchange_weak(volatile a32 *a, a32 *c, a32 v,
-                                            morder mo, morder fmo);
+                                            morder mo, morder fmo,
+      int lineNo, address funcName);
   int __tasksan_atomic64_compare_exchange_weak(volatile a64 *a, a64 *c, a64 v,
-                                            morder mo, morder fmo);
+                                            morder mo, morder fmo,
+      int lineNo, address funcName);
   #if __TSAN_HAS_INT128
   int __tasksan_atomic128_compare_exchange_weak(volatile a128 *a, a128 *c, a128 v,
-                                             morder mo, morder fmo);
+                                             morder mo, morder fmo,
+      int lineNo, address funcName);
   #endif
 
   a8 __tasksan_atomic8_compare_exchange_val(volatile a8 *a, a8 c, a8 v, morder mo,
-                                         morder fmo);
+                                         morder fmo,
+      int lineNo, address funcName);
   a16 __tasksan_atomic16_compare_exchange_val(volatile a16 *a, a16 c, a16 v,
-                                           morder mo, morder fmo);
+                                           morder mo, morder fmo,
+      int lineNo, address funcName);
   a32 __tasksan_atomic32_compare_exchange_val(volatile a32 *a, a32 c, a32 v,
-                                           morder mo, morder fmo);
+                                           morder mo, morder fmo,
+      int lineNo, address funcName);
   a64 __tasksan_atomic64_compare_exchange_val(volatile a64 *a, a64 c, a64 v,
-                                           morder mo, morder fmo);
+                                           morder mo, morder fmo,
+      int lineNo, address funcName);
   #if __TSAN_HAS_INT128
   a128 __tasksan_atomic128_compare_exchange_val(volatile a128 *a, a128 c, a128 v,
-                                             morder mo, morder fmo);
+                                             morder mo, morder fmo,
+      int lineNo, address funcName);
   #endif
 
   void __tasksan_atomic_thread_fence(morder mo);
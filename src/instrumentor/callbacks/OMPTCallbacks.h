@@ -32,6 +32,55 @@ void INS_TaskFinishFunc( ompt_data_t *task_data ) {
   UTIL::markEndOfTask(task_data);
 }
 
+/**
+ * Updates the runtime state word of the thread which starts or
+ * resumes running task "task_data" */
+static inline void updateRuntimeState(ompt_data_t *task_data) {
+  TaskInfo * taskInfo = task_data ? (TaskInfo *)task_data->ptr : NULL;
+  unsigned state = __tasksan_state &
+      ~(tasksan::STATE_ENABLED | tasksan::STATE_TASK_ACTIVE);
+  if (INS::isToolEnabled) state |= tasksan::STATE_ENABLED;
+  if (taskInfo && taskInfo->active) state |= tasksan::STATE_TASK_ACTIVE;
+  __tasksan_state = state;
+  INS::setRunningTask(state & tasksan::STATE_TASK_ACTIVE ? taskInfo : NULL);
+}
+
+/**
+ * Returns the lowest address of the calling thread's stack */
+static ulong getThreadStackBottom() {
+  static __thread ulong stackBottom = 0;
+  if (!stackBottom) {
+    pthread_attr_t attributes;
+    void * stackAddr = NULL;
+    size_t stackSize = 0;
+    if (pthread_getattr_np(pthread_self(), &attributes) == 0) {
+      pthread_attr_getstack(&attributes, &stackAddr, &stackSize);
+      pthread_attr_destroy(&attributes);
+    }
+    stackBottom = (ulong)stackAddr;
+  }
+  return stackBottom;
+}
+
+/**
+ * Records where the frames of task "task_data" begin when it starts
+ * running on the calling thread. The runtime calls the task from
+ * a frame above the frame of this callback. */
+static void beginTaskStack(ompt_data_t *task_data) {
+  TaskInfo * taskInfo = task_data ? (TaskInfo *)task_data->ptr : NULL;
+  if (taskInfo && getThreadStackBottom()) {
+    INS::TaskStackBegin(*taskInfo, getThreadStackBottom(),
+                        __builtin_frame_address(0));
+  }
+}
+
+/**
+ * Clears the history of the stack frames of completed task "task_data" */
+static void endTaskStack(ompt_data_t *task_data) {
+  TaskInfo * taskInfo = task_data ? (TaskInfo *)task_data->ptr : NULL;
+  if (taskInfo) INS::TaskStackEnd(*taskInfo);
+}
+
 //////////////////////////////////////////////////
 //// OMPT Callback functions
 //////////////////////////////////////////////////
@@ -60,13 +109,19 @@ on_ompt_callback_implicit_task(
   switch( endpoint )
   {
     case ompt_scope_begin:
+      __tasksan_in_task++;
       if (task_data->ptr == NULL) {
         TaskSanitizer_TaskBeginFunc(task_data);
       }
+      beginTaskStack(task_data);
+      updateRuntimeState(task_data);
       break;
     case ompt_scope_end:
       // this is called when the task has ended.
       INS_TaskFinishFunc(task_data);
+      endTaskStack(task_data);
+      if (__tasksan_in_task > 0) __tasksan_in_task--;
+      updateRuntimeState(NULL);
       break;
   }
 }
@@ -139,15 +194,19 @@ on_ompt_callback_task_schedule( // called in the context of the task
     ompt_task_status_t prior_task_status, /* status of prior task  */
     ompt_data_t *next_task_data) {        /* data of next task     */
 
+  if (prior_task_status == ompt_task_complete) {
+    endTaskStack(prior_task_data);
+  }
   if (next_task_data->ptr == NULL) {
     TaskSanitizer_TaskBeginFunc(next_task_data);
   }
+  beginTaskStack(next_task_data);
+  updateRuntimeState(next_task_data);
   PRINT_DEBUG("Task is being scheduled (p:" +
       std::to_string(next_task_data->value) + " t:" +
       std::to_string(prior_task_data->value) +  ")" );
 
   // int tid = ompt_get_thread_data()->value;
-  // if (prior_task_status == ompt_task_complete)
 }
 
 /*
@@ -246,6 +305,49 @@ static void on_ompt_callback_sync_region(
   }
 }
 
+/*
+ * Callbacks for locks and critical regions. They maintain the
+ * set of locks held by the current task. */
+static TaskInfo * getCurrentTaskInfo() {
+  int type;
+  ompt_data_t *task_data = NULL;
+  ompt_frame_t *task_frame;
+  ompt_data_t *parallel_data;
+  int thread_num;
+  if (ompt_get_task_info(0, &type, &task_data, &task_frame,
+                         &parallel_data, &thread_num) && task_data) {
+    return (TaskInfo*)task_data->ptr;
+  }
+  return NULL;
+}
+
+static inline bool isMutualExclusion(ompt_mutex_kind_t kind) {
+  return kind == ompt_mutex_lock || kind == ompt_mutex_nest_lock ||
+         kind == ompt_mutex_critical;
+}
+
+static void
+on_ompt_callback_mutex_acquired(
+    ompt_mutex_kind_t kind,
+    ompt_wait_id_t wait_id,
+    const void *codeptr_ra) {
+  TaskInfo * taskInfo = getCurrentTaskInfo();
+  if (taskInfo && isMutualExclusion(kind)) {
+    INS::AcquireLock(*taskInfo, (unsigned long)wait_id);
+  }
+}
+
+static void
+on_ompt_callback_mutex_released(
+    ompt_mutex_kind_t kind,
+    ompt_wait_id_t wait_id,
+    const void *codeptr_ra) {
+  TaskInfo * taskInfo = getCurrentTaskInfo();
+  if (taskInfo && isMutualExclusion(kind)) {
+    INS::ReleaseLock(*taskInfo, (unsigned long)wait_id);
+  }
+}
+
 /// Initialization and Termination callbacks
 
 static int dfinspec_initialize(
@@ -268,6 +370,8 @@ static int dfinspec_initialize(
   register_callback(ompt_callback_task_dependences);
   register_callback(ompt_callback_task_dependence);
   register_callback(ompt_callback_sync_region);
+  register_callback_t(ompt_callback_mutex_acquired, ompt_callback_mutex_t);
+  register_callback_t(ompt_callback_mutex_released, ompt_callback_mutex_t);
 
   INS::InitTaskSanitizerRuntime();
   PRINT_DEBUG("TaskSanitizer: init");
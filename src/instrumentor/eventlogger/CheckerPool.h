@@ -0,0 +1,197 @@
+/////////////////////////////////////////////////////////////////
+//  TaskSanitizer: a lightweight determinacy race checking
+//          tool for OpenMP task applications
+//
+//    Copyright (c) 2015 - 2018 Hassan Salehe Matar
+//      Copying or using this code by any means whatsoever
+//      without consent of the owner is strictly prohibited.
+//
+//   Contact: hassansalehe-at-gmail-dot-com
+//
+/////////////////////////////////////////////////////////////////
+
+// Checks the access summaries of tasks in parallel while the program
+// runs, with TASKSAN_DEFER_WORKERS threads. As in tasksan-check, each
+// worker keeps a Checker of its own for a partition of the pages of
+// memory and replays every event in the order the runtime submitted
+// them: tasks, happens-before edges, functions, locks, ranges cleared
+// and summaries, of which it checks the accesses to its pages. The
+// conflicts of the partitions are merged at exit.
+
+#ifndef _INSTRUMENTOR_EVENTLOGGER_CHECKERPOOL_H_
+#define _INSTRUMENTOR_EVENTLOGGER_CHECKERPOOL_H_
+
+#include "common/defs.h"
+#include "detector/determinacy/checker.h"
+#include "instrumentor/eventlogger/TaskInfo.h"
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <thread>
+
+class CheckerPool {
+  public:
+    // events queued per worker before submitting waits for it
+    static const unsigned QUEUE_LIMIT = 1 << 12;
+
+    // an event replayed by every worker
+    struct Event {
+      enum Kind { TASK, EDGE, FUNCTION, ACQUIRE, RELEASE, CLEAR, SUMMARY };
+      Kind kind;
+      INTEGER first = 0;   // task, parent task, function or lock set ID
+      INTEGER second = 0;  // child task, or lock
+      ADDRESS addr = NULL; // range cleared
+      ulong size = 0;
+      std::string name;    // of the function
+      std::string file;    // .iir file of the function
+      std::vector<TaskInfo::DeferredAccess> accesses; // of task "first"
+    };
+
+    static bool isRunning() { return !getWorkers().empty(); }
+
+    /** Starts "count" workers */
+    static void start(uint count) {
+      for (uint index = 0; index < count; index++) {
+        Worker * worker = new Worker();
+        getWorkers().push_back( worker );
+        worker->thread = std::thread(run, worker, index, count);
+      }
+    }
+
+    /**
+     * Queues "event" to every worker, which frees it once replayed.
+     * Callers hold the lock of the online checker, which orders the
+     * events. */
+    static void submit(Event * event) {
+      std::shared_ptr<const Event> shared( event );
+      for (Worker * worker : getWorkers()) {
+        std::unique_lock<std::mutex> guard( worker->lock );
+        worker->drained.wait(guard, [worker] {
+          return worker->events.size() < QUEUE_LIMIT;
+        });
+        worker->events.push_back( shared );
+        if (worker->events.size() == 1) worker->ready.notify_one();
+      }
+    }
+
+    static void submit(Event::Kind kind, INTEGER first, INTEGER second) {
+      Event * event = new Event();
+      event->kind = kind;
+      event->first = first;
+      event->second = second;
+      submit( event );
+    }
+
+    static void clear(ADDRESS addr, ulong size) {
+      Event * event = new Event();
+      event->kind = Event::CLEAR;
+      event->addr = addr;
+      event->size = size;
+      submit( event );
+    }
+
+    /**
+     * Waits for the workers to check all events and adds their
+     * conflicts to "target" */
+    static void finish(Checker & target) {
+      for (Worker * worker : getWorkers()) {
+        {
+          std::lock_guard<std::mutex> guard( worker->lock );
+          worker->finishing = true;
+        }
+        worker->ready.notify_one();
+      }
+      for (Worker * worker : getWorkers()) {
+        worker->thread.join();
+        target.mergeResults( *worker->checker );
+      }
+      getWorkers().clear();
+    }
+
+    /** Returns the actions of deferred access "access" of "taskID" */
+    static MemoryActions toMemoryActions(INTEGER taskID,
+        const TaskInfo::DeferredAccess & access) {
+      Action action(taskID, (ADDRESS)access.addr, access.value,
+                    access.lineNo, access.funcID);
+      action.size = access.size;
+      action.isWrite = access.kind == TaskInfo::DeferredAccess::WRITE;
+      action.lockSetID = access.lockSetID;
+      action.update = (OPERATION)access.update;
+      return MemoryActions( action );
+    }
+
+  private:
+    struct Worker {
+      Checker * checker = NULL;
+      std::thread thread;
+      std::mutex lock;
+      std::condition_variable ready;    // events queued, or finishing
+      std::condition_variable drained;  // room in the queue
+      std::deque<std::shared_ptr<const Event>> events;
+      bool finishing = false;
+    };
+
+    // workers are never destroyed since the program may exit without
+    // finishing the pool
+    static std::vector<Worker *> & getWorkers() {
+      static auto * workers = new std::vector<Worker *>();
+      return *workers;
+    }
+
+    /** Replays events with worker "worker" of "count" */
+    static void run(Worker * worker, uint index, uint count) {
+      // the checker uses shadow memory of its thread, hence it is
+      // freed with the process
+      ShadowMemory::useThreadMemory();
+      worker->checker = new Checker();
+      worker->checker->setPartition(index, count);
+
+      std::unique_lock<std::mutex> guard( worker->lock );
+      for (;;) {
+        worker->ready.wait(guard, [worker] {
+          return !worker->events.empty() || worker->finishing;
+        });
+        if ( worker->events.empty() ) return;
+        std::shared_ptr<const Event> event = worker->events.front();
+        worker->events.pop_front();
+        if (worker->events.size() == QUEUE_LIMIT - 1) {
+          worker->drained.notify_all();
+        }
+        guard.unlock();
+        replay(*worker->checker, *event);
+        event.reset();
+        guard.lock();
+      }
+    }
+
+    static void replay(Checker & checker, const Event & event) {
+      switch (event.kind) {
+        case Event::TASK:
+          checker.onTaskCreate(event.first);
+          break;
+        case Event::EDGE:
+          checker.saveHappensBeforeEdge(event.first, event.second);
+          break;
+        case Event::FUNCTION:
+          checker.registerFuncSignature(event.name, event.first,
+                                        event.file);
+          break;
+        case Event::ACQUIRE:
+          checker.acquireLock(event.first, event.second);
+          break;
+        case Event::RELEASE:
+          checker.releaseLock(event.first, event.second);
+          break;
+        case Event::CLEAR:
+          checker.clearRange(event.addr, event.size);
+          break;
+        case Event::SUMMARY:
+          for (const TaskInfo::DeferredAccess & access : event.accesses) {
+            checker.saveTaskActions( toMemoryActions(event.first, access) );
+          }
+          break;
+      }
+    }
+};
+
+#endif // end CheckerPool.h
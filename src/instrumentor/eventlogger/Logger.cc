@@ -16,6 +16,11 @@
 
 // static attributes redefined
 std::mutex INS::guardLock;
+std::mutex INS::freedLock;
+std::atomic<bool> INS::hasFreedRanges{ false };
+ulong INS::freedRangesLimit = 1 << 16;
+bool INS::isDeferring = false;
+__thread TaskInfo * INS::deferringTask = NULL;
 
 std::atomic<INTEGER> INS::taskIDSeed{ 0 };
 std::unordered_map<STRING, INTEGER> INS::funcNames;
@@ -26,4 +31,8 @@ std::unordered_map<ADDRESS, INTEGER> INS::lastWriter;
 std::unordered_map<ADDRESS, INTEGER> INS::lastReader;
 
 bool INS::isOMPTinitialized = false;
+bool INS::isToolEnabled = true;
 Checker INS::onlineChecker;
+tasksan::suppress::SuppressionList INS::suppressions;
+std::unordered_map<INTEGER, tasksan::suppress::SiteBitmap>
+    INS::suppressedLines;
@@ -17,9 +17,13 @@
 #define _INSTRUMENTOR_EVENLOGGER_LOGGER_H_
 
 #include "common/defs.h"
+#include "common/AccessBuffer.h"
 #include "instrumentor/eventlogger/TaskInfo.h"
 #include "detector/determinacy/checker.h"
 #include "detector/commutativity/CommutativityChecker.h"
+#include "instrumentor/eventlogger/TraceRecorder.h"
+#include "instrumentor/eventlogger/SiteSampler.h"
+#include "instrumentor/eventlogger/CheckerPool.h"
 #include <atomic>
 
 struct hash_function {
@@ -61,6 +65,170 @@ class INS {
     // checker instance for detecting determinacy race online
     static Checker onlineChecker;
 
+    // rules of TASKSAN_SUPPRESSIONS, and the suppressed lines of each
+    // registered function they cover
+    static tasksan::suppress::SuppressionList suppressions;
+    static std::unordered_map<INTEGER, tasksan::suppress::SiteBitmap>
+        suppressedLines;
+
+    // address ranges of globals which tasks only read: start -> end.
+    // function-local static since modules register their ranges from
+    // constructors which may run before any other static is ready.
+    static std::map<ulong, ulong> & getReadOnlyRanges() {
+      static std::map<ulong, ulong> readOnlyRanges;
+      return readOnlyRanges;
+    }
+
+    // .iir files of functions with critical sections, by the name
+    // their module passes to callbacks, since functions of different
+    // modules may have the same name. Registered by module
+    // constructors, hence a function-local static.
+    static std::unordered_map<STRING, STRING> & getIIRfiles() {
+      static std::unordered_map<STRING, STRING> iirFiles;
+      return iirFiles;
+    }
+
+    /** checks if "addr" is in a read-only range. Call with guardLock held */
+    static inline bool isReadOnly(ADDRESS addr) {
+      std::map<ulong, ulong> & readOnlyRanges = getReadOnlyRanges();
+      if ( readOnlyRanges.empty() ) return false;
+      auto range = readOnlyRanges.upper_bound( (ulong)addr );
+      if ( range == readOnlyRanges.begin() ) return false;
+      --range;
+      return (ulong)addr < range->second;
+    }
+
+    // ranges of memory the program freed: start -> size. Never
+    // destroyed, since the program frees memory after static
+    // destructors ran. The second buffer takes the ranges while
+    // their history is cleared, so neither buffer is ever freed.
+    static std::vector<std::pair<ulong, ulong>> & getFreedRanges() {
+      static auto * freedRanges = new std::vector<std::pair<ulong, ulong>>();
+      return *freedRanges;
+    }
+    static std::vector<std::pair<ulong, ulong>> & getReclaimedRanges() {
+      static auto * reclaimedRanges =
+          new std::vector<std::pair<ulong, ulong>>();
+      return *reclaimedRanges;
+    }
+
+    // protects the freed ranges, never held while calling the checker
+    static std::mutex freedLock;
+    static std::atomic<bool> hasFreedRanges;
+
+    // the freed ranges are merged when there are this many
+    static ulong freedRangesLimit;
+
+    // with TASKSAN_DEFER, tasks add their accesses to summaries which
+    // are checked when they end. The task running on the thread, if
+    // it may have a summary, which frees of the thread are added to.
+    static bool isDeferring;
+    static __thread TaskInfo * deferringTask;
+
+    /**
+     * merges adjacent and overlapping "ranges" in place. Frees made
+     * outside tasks are not cleared until tasks run again, and
+     * neighbouring heap blocks are often freed together. */
+    static inline void mergeRanges(
+        std::vector<std::pair<ulong, ulong>> & ranges) {
+      std::sort(ranges.begin(), ranges.end());
+      unsigned merged = 0;
+      for (unsigned i = 1; i < ranges.size(); i++) {
+        std::pair<ulong, ulong> & last = ranges[merged];
+        ulong end = ranges[i].first + ranges[i].second;
+        if (ranges[i].first <= last.first + last.second) {
+          last.second = std::max(last.first + last.second, end) - last.first;
+        } else {
+          ranges[++merged] = ranges[i];
+        }
+      }
+      ranges.resize(merged + 1);
+    }
+
+    /**
+     * clears the history of memory freed since the last check, so
+     * that reused memory is not checked against it. Call with
+     * guardLock held, before checking an access. */
+    static inline void reclaimFreedMemory() {
+      if ( !hasFreedRanges.load(std::memory_order_acquire) ) return;
+      std::vector<std::pair<ulong, ulong>> & reclaimed = getReclaimedRanges();
+      freedLock.lock();
+      reclaimed.swap( getFreedRanges() );
+      hasFreedRanges = false;
+      freedLock.unlock();
+
+      for (auto & range : reclaimed) {
+        onlineChecker.clearRange((ADDRESS)range.first, range.second);
+        if ( CheckerPool::isRunning() )
+          CheckerPool::clear((ADDRESS)range.first, range.second);
+      }
+      reclaimed.clear();
+    }
+
+    /**
+     * Returns true if TASKSAN_SAMPLE_RATE sampling skips the access
+     * at site ("funcID", "lineNo") */
+    static inline bool isSampledOut(INTEGER funcID, INTEGER lineNo) {
+      return SiteSampler::isSampling() &&
+             !SiteSampler::shouldCheck(funcID, lineNo);
+    }
+
+    /**
+     * Tells the sampler about a race found at site ("funcID", "lineNo")
+     * if the checker had "conflicts" pairs of lines before the check */
+    static inline void noteSampledRace(ulong conflicts,
+                                       INTEGER funcID, INTEGER lineNo) {
+      if (SiteSampler::isSampling() &&
+          onlineChecker.getConflicts().size() > conflicts)
+        SiteSampler::noteRace(funcID, lineNo);
+    }
+
+    /**
+     * Returns true if the task repeats a plain write of "value" which
+     * is still the only value written to its cell, so that checking
+     * it finds nothing. Reads the stamp of the cell without the lock;
+     * memory freed but not yet reclaimed is checked as usual. */
+    static inline bool isRepeatedWrite(TaskInfo & task, ADDRESS addr,
+                                       ulong size, INTEGER value) {
+      return !hasFreedRanges.load(std::memory_order_acquire) &&
+             task.isCheckedWrite(addr, size, value,
+                                 onlineChecker.loadWriteStamp(addr));
+    }
+
+    /**
+     * Remembers a plain write the task had checked, with the stamp
+     * of its cell. Call with guardLock held, after the check. */
+    static inline void noteCheckedWrite(TaskInfo & task, ADDRESS addr,
+                                        ulong size, INTEGER value) {
+      task.noteCheckedWrite(addr, size, value,
+                            onlineChecker.getCellStamp(addr, size));
+    }
+
+    /**
+     * adds an access of "task", or a free of memory while it runs, to
+     * the summary of the task */
+    static inline void deferAccess(TaskInfo & task, ADDRESS addr,
+        ulong size, TaskInfo::DeferredAccess::Kind kind, INTEGER value,
+        INTEGER funcID, INTEGER lineNo, OPERATION update = OTHER) {
+      TaskInfo::DeferredAccess access = { (ulong)addr, size, value, lineNo,
+          funcID, task.lockSetID, kind, (uint8_t)update };
+      deferringTask = NULL;  // the summary frees memory as it grows
+      task.deferAccess( access );
+      deferringTask = &task;
+    }
+
+    static inline TaskInfo::DeferredAccess::Kind getKind(bool isWrite) {
+      return isWrite ? TaskInfo::DeferredAccess::WRITE
+                     : TaskInfo::DeferredAccess::READ;
+    }
+
+    /** formats "addr" in hex, as the checker parses addresses */
+    static inline std::string addressToString(ADDRESS addr) {
+      char buffer[2 * sizeof(ADDRESS) + 1];
+      snprintf(buffer, sizeof(buffer), "%lx", (ulong)addr);
+      return buffer;
+    }
+
   public:
     // global lock to protect metadata, use this lock
     // when you call any function of this class
@@ -69,6 +237,9 @@ class INS {
     // checks if OPMT is initialized
     static bool isOMPTinitialized;
 
+    // false if checking is disabled with TASKSAN_DISABLE=1
+    static bool isToolEnabled;
+
     // open file for logging.
     static inline VOID InitTaskSanitizerRuntime() {
 
@@ -78,6 +249,26 @@ class INS {
 
       taskIDSeed = 0;
       isOMPTinitialized = true;
+
+      const char * disable = getenv("TASKSAN_DISABLE");
+      isToolEnabled = !(disable && atoi(disable));
+
+      const char * suppressionFile = getenv("TASKSAN_SUPPRESSIONS");
+      std::string error;
+      if ( suppressionFile && *suppressionFile &&
+           !suppressions.load(suppressionFile, error) ) {
+        std::cerr << "TaskSanitizer: TASKSAN_SUPPRESSIONS: " << error
+                  << std::endl;
+      }
+
+      const char * defer = getenv("TASKSAN_DEFER");
+      const char * workers = getenv("TASKSAN_DEFER_WORKERS");
+      int workerCount = workers ? atoi(workers) : 0;
+      if ( TraceRecorder::isRecording() ) return;
+      isDeferring = (defer && atoi(defer)) || workerCount > 0;
+      if (workerCount > 0 && !CheckerPool::isRunning())
+        CheckerPool::start(workerCount);
+      if ( !isDeferring ) onlineChecker.enableWriteStamps();
     }
 
     /*
@@ -87,9 +278,48 @@ class INS {
       return taskID;
     }
 
-    static inline void initCommutativityChecker(char *fname) {
-       onlineChecker.initializeCommutativityChecker(fname);
+    /**
+     * registers the .iir file of a function with critical sections.
+     * The checker learns it when the function is first registered.
+     * Called from module constructors, possibly before OMPT starts. */
+    static inline void registerIIRfile(char *fname, char *funcName) {
+      guardLock.lock();
+      getIIRfiles().emplace(funcName, fname);
+      guardLock.unlock();
+    }
+    /**
+     * registers the address range of a global which tasks never write.
+     * Reads from the range are not checked. Called from module
+     * constructors, possibly before OMPT starts. */
+    static inline void registerReadOnly(ADDRESS addr, ulong size) {
+      guardLock.lock();
+      getReadOnlyRanges()[(ulong)addr] = (ulong)addr + size;
+      guardLock.unlock();
     }
+
+    /**
+     * records that the program freed "size" bytes at "addr". Called
+     * from free, hence it takes no lock which is held while freeing. */
+    static inline void recordFree(ADDRESS addr, ulong size) {
+      if ( TraceRecorder::isRecording() ) {
+        TraceRecorder::clear(addr, size);
+        return;
+      }
+      if ( deferringTask ) {
+        deferAccess(*deferringTask, addr, size,
+                    TaskInfo::DeferredAccess::FREED, 0, 0, 0);
+      }
+      freedLock.lock();
+      std::vector<std::pair<ulong, ulong>> & freed = getFreedRanges();
+      freed.push_back( std::make_pair((ulong)addr, size) );
+      if (freed.size() >= freedRangesLimit) {
+        mergeRanges( freed );
+        freedRangesLimit = std::max(freedRangesLimit, 2 * freed.size());
+      }
+      hasFreedRanges.store(true, std::memory_order_release);
+      freedLock.unlock();
+    }
+
     /**
      * registers the function if not registered yet.
      * Also prints the function to standard output. */
@@ -101,8 +331,27 @@ class INS {
       if ( fd == funcNames.end() ) { // new function
         funcID = funcIDSeed++;
         funcNames[funcName] = funcID;
-        onlineChecker.registerFuncSignature(
-            std::string(funcName), funcID);
+        tasksan::suppress::SiteBitmap lines;
+        if ( suppressions.compileFunction(funcName, lines) )
+          suppressedLines[funcID] = lines;
+        auto iirFile = getIIRfiles().find(funcName);
+        STRING fileName =
+            iirFile == getIIRfiles().end() ? "" : iirFile->second;
+        if ( TraceRecorder::isRecording() ) {
+          TraceRecorder::function(funcID, funcName);
+          if (*fileName) TraceRecorder::iirFile(funcID, fileName);
+        } else {
+          onlineChecker.registerFuncSignature(
+              std::string(funcName), funcID, fileName);
+        }
+        if ( CheckerPool::isRunning() ) {
+          CheckerPool::Event * event = new CheckerPool::Event();
+          event->kind = CheckerPool::Event::FUNCTION;
+          event->first = funcID;
+          event->name = funcName;
+          event->file = fileName;
+          CheckerPool::submit( event );
+        }
       } else {
          funcID = fd->second;
       }
@@ -111,6 +360,23 @@ class INS {
       return funcID;
     }
 
+    /**
+     * Returns function "funcName" of "task", registering it on first
+     * use together with the lines of it which are suppressed */
+    static inline const TaskInfo::Function & getFunction(TaskInfo & task,
+        STRING funcName) {
+      const TaskInfo::Function * function = task.findFunction( funcName );
+      if (function) return *function;
+
+      INTEGER funcID = RegisterFunction( funcName );
+      guardLock.lock();
+      auto lines = suppressedLines.find(funcID);
+      const tasksan::suppress::SiteBitmap * suppressed =
+          lines == suppressedLines.end() ? NULL : &lines->second;
+      guardLock.unlock();
+      return task.registerFunction( funcName, funcID, suppressed );
+    }
+
     /** close file used in logging */
     static inline VOID Finalize() {
       guardLock.lock();
@@ -118,15 +384,32 @@ class INS {
       idMap.clear(); HB.clear();
       lastReader.clear();
       lastWriter.clear();
+      if ( SiteSampler::isSampling() ) SiteSampler::printStats(std::cout);
+      if ( TraceRecorder::isRecording() ) {
+        TraceRecorder::flushAll();
+        std::cout << "TaskSanitizer: recorded traces to "
+                  << getenv("TASKSAN_RECORD") << ".*"
+                  << tasksan::trace::getTraceExtension() << std::endl;
+        guardLock.unlock();
+        return;
+      }
+      if ( CheckerPool::isRunning() ) CheckerPool::finish(onlineChecker);
       //DuplicateManager::removeDuplicates( onlineChecker.getConflicts() );
       onlineChecker.reportConflicts();
+      ShadowMemory::get().printStats(std::cout);
       guardLock.unlock();
     }
 
     /** called when a task begins execution and retrieves parent task id */
     static inline VOID TaskBeginLog(TaskInfo& task) {
+      if ( TraceRecorder::isRecording() ) {
+        TraceRecorder::taskBegin(task.taskID);
+        return;
+      }
       guardLock.lock();
       onlineChecker.onTaskCreate(task.taskID);
+      if ( CheckerPool::isRunning() )
+        CheckerPool::submit(CheckerPool::Event::TASK, task.taskID, 0);
       guardLock.unlock();
     }
 
@@ -145,7 +428,12 @@ class INS {
 
         if (parentID != tid) {
           // there was a bug where a task could send token to itself
-          onlineChecker.saveHappensBeforeEdge(parentID, tid);
+          if ( TraceRecorder::isRecording() )
+            TraceRecorder::dependence(parentID, tid);
+          else
+            onlineChecker.saveHappensBeforeEdge(parentID, tid);
+          if ( CheckerPool::isRunning() )
+            CheckerPool::submit(CheckerPool::Event::EDGE, parentID, tid);
 
           // there is a happens before between taskID and parentID:
           //parentID ---happens-before---> taskID
@@ -163,11 +451,77 @@ class INS {
       guardLock.unlock();
     }
 
+    /**
+     * called when "task" starts running on the calling thread, whose
+     * stack starts at "stackBottom". Frames of the task lie below
+     * "frame", a frame of the runtime which starts the task. */
+    static inline VOID TaskStackBegin(TaskInfo & task,
+        ulong stackBottom, ADDRESS frame) {
+      if (task.stackTop) return; // resumed, not started
+      task.stackBottom = stackBottom;
+      task.stackTop    = (ulong)frame;
+    }
+
+    /**
+     * called when "task" completed. Clears the history of its stack
+     * frames, which later tasks on the thread will reuse. */
+    static inline VOID TaskStackEnd(TaskInfo & task) {
+      CheckSummary(task);
+      if (task.stackLow < task.stackTop && TraceRecorder::isRecording()) {
+        TraceRecorder::clear((ADDRESS)task.stackLow,
+                             task.stackTop - task.stackLow);
+      } else if (task.stackLow < task.stackTop) {
+        guardLock.lock();
+        onlineChecker.clearRange((ADDRESS)task.stackLow,
+                                 task.stackTop - task.stackLow);
+        if ( CheckerPool::isRunning() )
+          CheckerPool::clear((ADDRESS)task.stackLow,
+                             task.stackTop - task.stackLow);
+        guardLock.unlock();
+      }
+      task.stackLow = ~0ul;
+    }
+
     /** called before the task terminates. */
     static inline VOID TaskEndLog( TaskInfo& task ) {
-      //guardLock.lock(); // protect file descriptor
-      // do something
-      //guardLock.unlock();
+      if ( TraceRecorder::isRecording() ) TraceRecorder::taskEnd(task.taskID);
+      CheckSummary(task);
+    }
+
+    /**
+     * checks the summary of the accesses "task" deferred, with the
+     * lock taken once for all of them, or hands it to the workers.
+     * Called when the task ends, before its stack frames are cleared. */
+    static inline VOID CheckSummary( TaskInfo & task ) {
+      if (deferringTask == &task) deferringTask = NULL;
+      if ( task.memoryLocations.empty() ) return;
+      task.compactDeferred();
+
+      guardLock.lock();
+      reclaimFreedMemory();
+      if ( CheckerPool::isRunning() ) {
+        CheckerPool::Event * event = new CheckerPool::Event();
+        event->kind = CheckerPool::Event::SUMMARY;
+        event->first = task.taskID;
+        event->accesses.swap( task.memoryLocations );
+        CheckerPool::submit( event );
+      } else {
+        for (const TaskInfo::DeferredAccess & access : task.memoryLocations) {
+          ulong conflicts = onlineChecker.getConflicts().size();
+          onlineChecker.saveTaskActions(
+              CheckerPool::toMemoryActions(task.taskID, access) );
+          noteSampledRace(conflicts, access.funcID, access.lineNo);
+        }
+      }
+      guardLock.unlock();
+      task.memoryLocations.clear();
+    }
+
+    /**
+     * called when the thread switches to task "task", NULL if none,
+     * so that frees of the thread reach the summary of the task */
+    static inline void setRunningTask(TaskInfo * task) {
+      if (isDeferring) deferringTask = task;
     }
 
     /**
@@ -183,53 +537,182 @@ class INS {
       guardLock.unlock();
     }
 
-    /** provides the address of memory a task reads from */
+    /** provides the address and size of memory a task reads from */
     static inline VOID Read( TaskInfo & task,
-        ADDRESS addr, INTEGER lineNo, STRING funcName ) {
-      INTEGER funcID = task.getFunctionId( funcName );
-
-      // register function if not registered yet
-      if (funcID == 0) {
-        funcID = RegisterFunction( funcName );
-        task.registerFunction( funcName, funcID );
+        ADDRESS addr, ulong size, INTEGER lineNo, STRING funcName ) {
+      const TaskInfo::Function & function = getFunction(task, funcName);
+      if (function.suppressed && function.suppressed->test(lineNo)) return;
+      INTEGER funcID = function.id;
+
+      task.noteStackAccess(addr);
+      if ( isSampledOut(funcID, lineNo) ) return;
+      if ( TraceRecorder::isRecording() ) {
+        // read-only ranges are registered before threads start
+        if ( !isReadOnly(addr) )
+          TraceRecorder::access(task.taskID, addr, size, false, 0,
+                                funcID, lineNo);
+        return;
+      }
+      if ( isDeferring ) {
+        if ( !isReadOnly(addr) )
+          deferAccess(task, addr, size, getKind(false), 0, funcID, lineNo);
+        return;
       }
 
-      //task.saveReadAction(addr, lineNo, funcID);
-      std::stringstream ssin(std::to_string((VALUE)addr) + " 0 " +
+      std::stringstream ssin(addressToString(addr) + " 0 " +
           std::to_string(lineNo) + " " + std::to_string(funcID));
 
       guardLock.lock();
-      onlineChecker.detectRaceOnMem(task.taskID, "R", ssin);
+      reclaimFreedMemory();
+      if ( !isReadOnly(addr) ) {
+        ulong conflicts = onlineChecker.getConflicts().size();
+        onlineChecker.detectRaceOnMem(task.taskID, "R", ssin, size,
+            task.lockSetID);
+        noteSampledRace(conflicts, funcID, lineNo);
+      }
       guardLock.unlock();
     }
 
-    /** stores a write action */
-    static inline VOID Write(TaskInfo & task, ADDRESS addr,
-        INTEGER value, INTEGER lineNo, STRING funcName) {
-
-      INTEGER funcID = task.getFunctionId( funcName );
-
-      // register function if not registered yet
-      if (funcID == 0) {
-        funcID = RegisterFunction( funcName );
-        task.registerFunction( funcName, funcID );
+    /**
+     * stores a write action of "size" bytes. "update" is the kind of
+     * an atomic read-modify-write, OTHER for plain writes. */
+    static inline VOID Write(TaskInfo & task, ADDRESS addr, ulong size,
+        INTEGER value, INTEGER lineNo, STRING funcName,
+        OPERATION update = OTHER) {
+
+      const TaskInfo::Function & function = getFunction(task, funcName);
+      if (function.suppressed && function.suppressed->test(lineNo)) return;
+      INTEGER funcID = function.id;
+
+      task.noteStackAccess(addr);
+      if ( isSampledOut(funcID, lineNo) ) return;
+      if ( TraceRecorder::isRecording() ) {
+        TraceRecorder::access(task.taskID, addr, size, true, value,
+                              funcID, lineNo, update);
+        return;
+      }
+      if ( isDeferring ) {
+        deferAccess(task, addr, size, getKind(true), value, funcID, lineNo,
+                    update);
+        return;
       }
+      if (update == OTHER && isRepeatedWrite(task, addr, size, value))
+        return;
 
-      //task.saveWriteAction(addr, value, lineNo, funcID);
-      std::stringstream ssin(std::to_string((VALUE)addr) + " " +
+      std::stringstream ssin(addressToString(addr) + " " +
           std::to_string(value) + " " + std::to_string(lineNo) +
           " " + std::to_string(funcID));
 
       guardLock.lock();
-      onlineChecker.detectRaceOnMem(task.taskID, "W", ssin);
+      reclaimFreedMemory();
+      ulong conflicts = onlineChecker.getConflicts().size();
+      onlineChecker.detectRaceOnMem(task.taskID, "W", ssin, size,
+          task.lockSetID, update);
+      noteSampledRace(conflicts, funcID, lineNo);
+      if (update == OTHER) noteCheckedWrite(task, addr, size, value);
+      guardLock.unlock();
+    }
+
+    /**
+     * checks a batch of "count" accesses of function "funcName".
+     * The function is looked up and the lock taken once per batch. */
+    static inline VOID ProcessAccesses(TaskInfo & task,
+        const tasksan::AccessRecord * records, unsigned count,
+        STRING funcName) {
+
+      const TaskInfo::Function & function = getFunction(task, funcName);
+      INTEGER funcID = function.id;
+
+      if ( TraceRecorder::isRecording() || isDeferring ) {
+        for (unsigned i = 0; i < count; i++) {
+          const tasksan::AccessRecord & record = records[i];
+          if (!record.lineNo) continue;
+          if (function.suppressed &&
+              function.suppressed->test(record.lineNo)) continue;
+          task.noteStackAccess(record.addr);
+
+          bool isWrite = record.kind & tasksan::ACCESS_WRITE;
+          if (!isWrite && isReadOnly(record.addr)) continue;
+          if ( isSampledOut(funcID, record.lineNo) ) continue;
+          if ( isDeferring ) {
+            deferAccess(task, record.addr,
+                record.kind & ~tasksan::ACCESS_WRITE, getKind(isWrite),
+                isWrite ? record.value : 0, funcID, record.lineNo);
+            continue;
+          }
+          TraceRecorder::access(task.taskID, record.addr,
+              record.kind & ~tasksan::ACCESS_WRITE, isWrite,
+              record.value, funcID, record.lineNo);
+        }
+        return;
+      }
+
+      guardLock.lock();
+      reclaimFreedMemory();
+      for (unsigned i = 0; i < count; i++) {
+        const tasksan::AccessRecord & record = records[i];
+        if (!record.lineNo) continue;
+        if (function.suppressed &&
+            function.suppressed->test(record.lineNo)) continue;
+        task.noteStackAccess(record.addr);
+
+        bool isWrite = record.kind & tasksan::ACCESS_WRITE;
+        if (!isWrite && isReadOnly(record.addr)) continue;
+        if ( isSampledOut(funcID, record.lineNo) ) continue;
+        ulong size = record.kind & ~tasksan::ACCESS_WRITE;
+        if (isWrite &&
+            isRepeatedWrite(task, record.addr, size, record.value)) continue;
+        std::stringstream ssin(addressToString(record.addr) + " " +
+            std::to_string(isWrite ? record.value : 0) + " " +
+            std::to_string(record.lineNo) + " " + std::to_string(funcID));
+        ulong conflicts = onlineChecker.getConflicts().size();
+        onlineChecker.detectRaceOnMem(task.taskID, isWrite ? "W" : "R",
+            ssin, size, task.lockSetID);
+        noteSampledRace(conflicts, funcID, record.lineNo);
+        if (isWrite) noteCheckedWrite(task, record.addr, size, record.value);
+      }
+      guardLock.unlock();
+    }
+
+    /** called when a task acquires a lock or enters a critical region */
+    static inline VOID AcquireLock(TaskInfo & task, unsigned long lock) {
+      if ( TraceRecorder::isRecording() ) {
+        TraceRecorder::lock(task.taskID, lock, true);
+        return;
+      }
+      guardLock.lock();
+      if ( CheckerPool::isRunning() )
+        CheckerPool::submit(CheckerPool::Event::ACQUIRE, task.lockSetID, lock);
+      task.lockSetID = onlineChecker.acquireLock(task.lockSetID, lock);
+      guardLock.unlock();
+    }
+
+    /** called when a task releases a lock or leaves a critical region */
+    static inline VOID ReleaseLock(TaskInfo & task, unsigned long lock) {
+      if ( TraceRecorder::isRecording() ) {
+        TraceRecorder::lock(task.taskID, lock, false);
+        return;
+      }
+      guardLock.lock();
+      if ( CheckerPool::isRunning() )
+        CheckerPool::submit(CheckerPool::Event::RELEASE, task.lockSetID, lock);
+      task.lockSetID = onlineChecker.releaseLock(task.lockSetID, lock);
       guardLock.unlock();
     }
 
     /** Saves IDs of child tasks at a barrier */
     static inline VOID saveChildHBs(TaskInfo & task) {
+      if ( TraceRecorder::isRecording() ) {
+        for (int uncleID : task.childrenIDs)
+          TraceRecorder::join(uncleID, task.taskID);
+        task.childrenIDs.clear();
+        return;
+      }
       guardLock.lock();
       for (int uncleID : task.childrenIDs) {
         onlineChecker.saveHappensBeforeEdge(uncleID, task.taskID);
+        if ( CheckerPool::isRunning() )
+          CheckerPool::submit(CheckerPool::Event::EDGE, uncleID, task.taskID);
       }
       task.childrenIDs.clear();
       guardLock.unlock();
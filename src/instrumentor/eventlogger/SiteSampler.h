@@ -0,0 +1,202 @@
+/////////////////////////////////////////////////////////////////
+//  TaskSanitizer: a lightweight determinacy race checking
+//          tool for OpenMP task applications
+//
+//    Copyright (c) 2015 - 2018 Hassan Salehe Matar
+//      Copying or using this code by any means whatsoever
+//      without consent of the owner is strictly prohibited.
+//
+//   Contact: hassansalehe-at-gmail-dot-com
+//
+/////////////////////////////////////////////////////////////////
+
+// Samples the accesses checked per static access site, in the manner
+// of LiteRace, when TASKSAN_SAMPLE_RATE is below 1. Each thread counts
+// the visits of sites in a table of its own and checks a site with a
+// probability which starts at 1 and halves after every SAMPLE_BURST
+// checks which find no race, down to the rate set. A site at which a
+// race is found is checked in full again. Events of the task graph
+// are never sampled, so happens-before stays exact and sampling can
+// only miss races. A decision is a hash of TASKSAN_SAMPLE_SEED, the
+// site and its visits by the thread, hence runs with the same seed
+// and schedule check the same accesses.
+
+#ifndef _INSTRUMENTOR_EVENTLOGGER_SITESAMPLER_H_
+#define _INSTRUMENTOR_EVENTLOGGER_SITESAMPLER_H_
+
+#include "common/defs.h"
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <mutex>
+#include <pthread.h>
+#include <vector>
+
+class SiteSampler {
+  public:
+    // sites counted per thread; sites which collide share no counts
+    static const unsigned TABLE_SIZE = 1 << 12;
+
+    // checks without races after which the rate of a site halves
+    static const unsigned SAMPLE_BURST = 16;
+
+    /**
+     * Returns true if TASKSAN_SAMPLE_RATE sets a rate below 1 */
+    static bool isSampling() {
+      return getMinThreshold() < FULL_THRESHOLD;
+    }
+
+    /**
+     * Returns true if the access at site ("funcID", "lineNo") by the
+     * calling thread is to be checked */
+    static inline bool shouldCheck(INTEGER funcID, INTEGER lineNo) {
+      ThreadTable & table = getThreadTable();
+      Site & site = getSite(table, (funcID << 32) | (uint32_t)lineNo);
+      table.visits++;
+
+      uint64_t threshold = std::max(getMinThreshold(),
+                                    FULL_THRESHOLD >> site.level);
+      uint64_t stream = mix(getSeed() ^ mix(site.key));
+      uint64_t draw = mix(stream + site.visits++) >> 32;
+      if (draw >= threshold) return false;
+
+      table.checks++;
+      if (++site.checks % SAMPLE_BURST == 0 && site.level < 32) {
+        site.level++;
+      }
+      return true;
+    }
+
+    /**
+     * Records that checking site ("funcID", "lineNo") found a race,
+     * so that the calling thread checks the site in full again */
+    static inline void noteRace(INTEGER funcID, INTEGER lineNo) {
+      Site & site = getSite(getThreadTable(),
+                            (funcID << 32) | (uint32_t)lineNo);
+      site.level = 0;
+      site.checks = 0;
+    }
+
+    /** Prints how many accesses were checked */
+    static void printStats(std::ostream & out) {
+      ulong visits = getExitedVisits().load();
+      ulong checks = getExitedChecks().load();
+      {
+        std::lock_guard<std::mutex> guard( getRegistryLock() );
+        for (ThreadTable * table : getRegistry()) {
+          visits += table->visits;
+          checks += table->checks;
+        }
+      }
+      out << "TaskSanitizer: sampling checked " << checks << " of "
+          << visits << " accesses (TASKSAN_SAMPLE_RATE="
+          << getenv("TASKSAN_SAMPLE_RATE") << ", TASKSAN_SAMPLE_SEED="
+          << getSeed() << ")" << std::endl;
+    }
+
+  private:
+    static const uint64_t FULL_THRESHOLD = 1ull << 32;
+
+    // counts of a site by a thread
+    struct Site {
+      INTEGER key = 0;     // (function ID, line), 0 if unused
+      uint64_t visits = 0;
+      uint32_t checks = 0;
+      uint32_t level = 0;  // the rate is 1 / 2^level
+    };
+
+    // the sites of a thread and its totals
+    struct ThreadTable {
+      Site sites[TABLE_SIZE];
+      ulong visits = 0;
+      ulong checks = 0;
+    };
+
+    /** Returns the lowest rate, scaled to FULL_THRESHOLD */
+    static uint64_t getMinThreshold() {
+      static uint64_t minThreshold = readMinThreshold();
+      return minThreshold;
+    }
+
+    static uint64_t readMinThreshold() {
+      STRING rate = getenv("TASKSAN_SAMPLE_RATE");
+      if (!rate || !*rate) return FULL_THRESHOLD;
+      double value = atof(rate);
+      if (value >= 1.0) return FULL_THRESHOLD;
+      return std::max((uint64_t)(value * FULL_THRESHOLD), (uint64_t)1);
+    }
+
+    static uint64_t getSeed() {
+      static STRING seed = getenv("TASKSAN_SAMPLE_SEED");
+      static uint64_t value = seed ? strtoull(seed, NULL, 0) : 0;
+      return value;
+    }
+
+    /** the finalizer of splitmix64, which spreads bits of "x" */
+    static inline uint64_t mix(uint64_t x) {
+      x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+      x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+      return x ^ (x >> 31);
+    }
+
+    /**
+     * Returns the counts of site "key" in "table". A site which
+     * takes the slot of another starts with a rate of 1. */
+    static inline Site & getSite(ThreadTable & table, INTEGER key) {
+      Site & site = table.sites[mix(key) & (TABLE_SIZE - 1)];
+      if (site.key != key) site = Site(), site.key = key;
+      return site;
+    }
+
+    static std::mutex & getRegistryLock() {
+      static std::mutex * registryLock = new std::mutex();
+      return *registryLock;
+    }
+
+    // tables of live threads, never destroyed since threads may
+    // check accesses after static destructors ran
+    static std::vector<ThreadTable *> & getRegistry() {
+      static auto * registry = new std::vector<ThreadTable *>();
+      return *registry;
+    }
+
+    // totals of threads which exited
+    static std::atomic<ulong> & getExitedVisits() {
+      static std::atomic<ulong> visits{ 0 };
+      return visits;
+    }
+    static std::atomic<ulong> & getExitedChecks() {
+      static std::atomic<ulong> checks{ 0 };
+      return checks;
+    }
+
+    /**
+     * Adds the totals of a thread which exits and frees its table */
+    static void closeThreadTable(void * data) {
+      ThreadTable * table = (ThreadTable *)data;
+      std::lock_guard<std::mutex> guard( getRegistryLock() );
+      std::vector<ThreadTable *> & registry = getRegistry();
+      registry.erase(std::remove(registry.begin(), registry.end(), table),
+                     registry.end());
+      getExitedVisits() += table->visits;
+      getExitedChecks() += table->checks;
+      delete table;
+    }
+
+    /** Returns the table of the calling thread */
+    static ThreadTable & getThreadTable() {
+      static __thread ThreadTable * threadTable = NULL;
+      if (threadTable) return *threadTable;
+
+      static pthread_key_t tableKey;
+      static bool hasKey =
+          pthread_key_create(&tableKey, closeThreadTable) == 0;
+      threadTable = new ThreadTable();
+      if (hasKey) pthread_setspecific(tableKey, threadTable);
+      std::lock_guard<std::mutex> guard( getRegistryLock() );
+      getRegistry().push_back( threadTable );
+      return *threadTable;
+    }
+};
+
+#endif // end SiteSampler.h
@@ -17,25 +17,67 @@
 
 #include "common/defs.h"
 #include "common/MemoryActions.h"
+#include "common/Suppressions.h"
 
 typedef struct TaskInfo {
   uint threadID = 0;
   uint taskID   = 0;
   bool active   = false;
 
+  // ID of the set of locks currently held by the task
+  int lockSetID = 0;
+
+  // the stack of the thread running the task starts at stackBottom.
+  // The task's frames lie below stackTop, and stackLow is the lowest
+  // address of them it accessed. Set when the task starts running.
+  ulong stackBottom = 0;
+  ulong stackTop    = 0;
+  ulong stackLow    = ~0ul;
+
+  // a function executed by the task: its ID and the lines of it
+  // which are suppressed, NULL if none
+  struct Function {
+    INTEGER id = 0;
+    const tasksan::suppress::SiteBitmap * suppressed = NULL;
+  };
+
   // stores pointers of signatures of functions executed by task
   // for faster acces
-  std::unordered_map<STRING, INTEGER> functions;
+  std::unordered_map<STRING, Function> functions;
 
-  // stores memory actions performed by task.
-  std::unordered_map<address, MemoryActions> memoryLocations;
+  // an access deferred to the end of the task with TASKSAN_DEFER, or
+  // a range the task freed, which drops its accesses before it
+  struct DeferredAccess {
+    enum Kind : uint8_t { READ, WRITE, FREED };
+    ulong addr;
+    ulong size;
+    INTEGER value;
+    INTEGER lineNo;
+    INTEGER funcID;
+    int lockSetID;
+    Kind kind;
+    uint8_t update;  // an OPERATION
+  };
 
-  // improve performance by buffering actions and write only once.
-  std::ostringstream actionBuffer;
+  // the accesses deferred, in order until compacted
+  std::vector<DeferredAccess> memoryLocations;
+  ulong compactAt = 1 << 16;  // entries at which to compact them
 
   // stores the IDs of child tasks created by this task
   std::vector<int> childrenIDs;
 
+  // recent plain writes the task had checked, by address, with the
+  // stamp their cell had after the check, 0 if it had none
+  struct CheckedWrite {
+    ADDRESS addr = NULL;
+    ulong size = 0;
+    INTEGER value = 0;
+    int lockSetID = 0;
+    uint64_t stamp = 0;
+  };
+  static const unsigned CHECKED_WRITES = 16;
+  CheckedWrite checkedWrites[CHECKED_WRITES];
+
   /**
    * Appends child ID to a list of children IDs */
   inline void addChild(int childID) {
@@ -43,47 +85,142 @@ typedef struct TaskInfo {
   }
 
   /**
-   * Stores the action info as performed by task. The rules for
-   * storing this information are explained in MemoryActions.h */
-  inline void saveMemoryAction(Action & action) {
-    MemoryActions &loc = memoryLocations[action.addr];
-    loc.storeAction( action );
+   * Lowers stackLow if "addr" is in the task's stack frames */
+  inline void noteStackAccess(ADDRESS addr) {
+    ulong location = (ulong)addr;
+    if (location < stackLow && location < stackTop &&
+        location >= stackBottom) {
+      stackLow = location;
+    }
   }
 
-  inline void saveReadAction(ADDRESS & addr,
-      INTEGER & lineNo,
-      const INTEGER funcID) {
+  /**
+   * Returns true if the task checked a write of "value" to the same
+   * bytes, holding the same locks, and its cell is at stamp "stamp"
+   * still. Stamps are unique, so the history of the cell is as after
+   * that check: it holds the write and writes of "value" only. */
+  inline bool isCheckedWrite(ADDRESS addr, ulong size, INTEGER value,
+                             uint64_t stamp) const {
+    const CheckedWrite & write = checkedWrites[getCheckedSlot(addr)];
+    return stamp && write.stamp == stamp && write.addr == addr &&
+           write.size == size && write.value == value &&
+           write.lockSetID == lockSetID;
+  }
 
-    MemoryActions & loc = memoryLocations[addr];
-    if ( !loc.hasWrite() ) {
-      Action action( taskID, addr, 0, lineNo, funcID );
-      action.isWrite = false;
-      loc.storeAction( action );
-    }
+  inline void noteCheckedWrite(ADDRESS addr, ulong size, INTEGER value,
+                               uint64_t stamp) {
+    CheckedWrite & write = checkedWrites[getCheckedSlot(addr)];
+    write.addr = addr;
+    write.size = size;
+    write.value = value;
+    write.lockSetID = lockSetID;
+    write.stamp = stamp;
   }
 
-  inline void saveWriteAction(
-      ADDRESS addr,
-      INTEGER value,
-      INTEGER lineNo,
-      INTEGER funcID) {
+  static inline unsigned getCheckedSlot(ADDRESS addr) {
+    return ((ulong)addr >> 3) & (CHECKED_WRITES - 1);
+  }
 
-     MemoryActions & loc = memoryLocations[addr];
-     bool isWrite = true;
-     loc.storeAction(taskID, addr, value, lineNo, funcID, isWrite);
+  /**
+   * Defers an access of the task, or a free of memory while it runs */
+  inline void deferAccess(const DeferredAccess & access) {
+    memoryLocations.push_back( access );
+    if (memoryLocations.size() >= compactAt) {
+      compactDeferred();
+      if (memoryLocations.size() > compactAt / 2) compactAt *= 2;
+    }
   }
 
   /**
-   * Prints to ostringstream all memory access actions recorded. */
-  void printMemoryActions() {
-    for (auto it = memoryLocations.begin();
-         it != memoryLocations.end(); ++it) {
-      it->second.printActions( actionBuffer );
+   * Keeps of the accesses deferred only those the checker would keep:
+   * per address and size the first read and the last write, of the
+   * bytes which the task did not free afterwards. Frees are dropped. */
+  void compactDeferred() {
+    std::map<ulong, ulong> freed;  // freed after the access, disjoint
+    std::vector<DeferredAccess> kept;
+    kept.reserve( memoryLocations.size() );
+    for (ulong i = memoryLocations.size(); i-- > 0; ) {
+      const DeferredAccess & access = memoryLocations[i];
+      if (access.kind == DeferredAccess::FREED) {
+        addFreedRange(freed, access.addr, access.addr + access.size);
+      } else {
+        keepUnfreed(access, freed, kept);
+      }
+    }
+    std::reverse(kept.begin(), kept.end());
+    memoryLocations.swap( kept );
+
+    // by address, size and kind; the order of the task otherwise
+    std::stable_sort(memoryLocations.begin(), memoryLocations.end(),
+        [](const DeferredAccess & a, const DeferredAccess & b) {
+          if (a.addr != b.addr) return a.addr < b.addr;
+          if (a.size != b.size) return a.size < b.size;
+          return a.kind < b.kind;
+        });
+    ulong last = 0;
+    for (ulong i = 0; i < memoryLocations.size(); i++) {
+      const DeferredAccess & access = memoryLocations[i];
+      bool isNext = i + 1 < memoryLocations.size() &&
+          memoryLocations[i + 1].addr == access.addr &&
+          memoryLocations[i + 1].size == access.size &&
+          memoryLocations[i + 1].kind == access.kind;
+      bool isPrevious = last > 0 &&
+          memoryLocations[last - 1].addr == access.addr &&
+          memoryLocations[last - 1].size == access.size &&
+          memoryLocations[last - 1].kind == access.kind;
+      if (access.kind == DeferredAccess::WRITE ? !isNext : !isPrevious) {
+        memoryLocations[last++] = access;
+      }
     }
+    memoryLocations.resize(last);
   }
 
   /** HELPER FUNCTIONS */
 
+  /**
+   * Adds bytes [start, end) to disjoint ranges "freed", merging the
+   * ranges they overlap or touch. */
+  static void addFreedRange(std::map<ulong, ulong> & freed,
+                            ulong start, ulong end) {
+    auto range = freed.upper_bound(start);
+    if (range != freed.begin() && std::prev(range)->second >= start) {
+      --range;
+      start = range->first;
+    }
+    while (range != freed.end() && range->first <= end) {
+      end = std::max(end, range->second);
+      range = freed.erase(range);
+    }
+    freed[start] = end;
+  }
+
+  /**
+   * Appends to "kept" the parts of "access" which are in none of
+   * the disjoint ranges "freed". */
+  static void keepUnfreed(const DeferredAccess & access,
+                          const std::map<ulong, ulong> & freed,
+                          std::vector<DeferredAccess> & kept) {
+    ulong start = access.addr;
+    ulong end = access.addr + access.size;
+    auto range = freed.upper_bound(start);
+    if (range != freed.begin()) --range;
+    for (; start < end && range != freed.end() && range->first < end;
+         ++range) {
+      if (range->second <= start) continue;
+      if (range->first > start) {
+        kept.push_back( access );
+        kept.back().addr = start;
+        kept.back().size = range->first - start;
+      }
+      start = range->second;
+    }
+    if (start < end) {
+      kept.push_back( access );
+      kept.back().addr = start;
+      kept.back().size = end - start;
+    }
+  }
+
   /**
    * returns ID if function registered before, otherwise 0. */
    inline INTEGER getFunctionId( const STRING funcName ) {
@@ -91,22 +228,25 @@ typedef struct TaskInfo {
      if ( fd == functions.end() ) {
        return 0;
      } else {
-       return fd->second;
+       return fd->second.id;
      }
    }
 
    /**
-    * Registers function for faster access. */
-   void registerFunction(STRING funcName, INTEGER funcId ) {
-     functions[funcName] = funcId;
+    * returns the function if registered before, otherwise NULL. */
+   inline const Function * findFunction( const STRING funcName ) {
+     auto fd = functions.find( funcName );
+     return fd == functions.end() ? NULL : &fd->second;
    }
 
    /**
-    * Clears all stored memory actions.
-    * Can executed once the actions are written to log file. */
-   void flushLogs() {
-     memoryLocations.clear();
-     actionBuffer.str(""); // clear buffer
+    * Registers function for faster access. */
+   const Function & registerFunction(STRING funcName, INTEGER funcId,
+       const tasksan::suppress::SiteBitmap * suppressed = NULL) {
+     Function & function = functions[funcName];
+     function.id = funcId;
+     function.suppressed = suppressed;
+     return function;
    }
 
 } TaskInfo;
@@ -0,0 +1,400 @@
+/////////////////////////////////////////////////////////////////
+//  TaskSanitizer: a lightweight determinacy race checking
+//          tool for OpenMP task applications
+//
+//    Copyright (c) 2015 - 2018 Hassan Salehe Matar
+//      Copying or using this code by any means whatsoever
+//      without consent of the owner is strictly prohibited.
+//
+//   Contact: hassansalehe-at-gmail-dot-com
+//
+/////////////////////////////////////////////////////////////////
+
+// Records events of the program into per-thread binary traces in
+// the format of common/TraceFormat.h, for checking after the run.
+// Each thread appends to its own buffer and writes it to its own
+// file when full, so recording accesses takes no lock. With
+// TASKSAN_RECORD_COMPRESS=1 the buffer is written in compressed
+// blocks.
+
+#ifndef _INSTRUMENTOR_EVENTLOGGER_TRACERECORDER_H_
+#define _INSTRUMENTOR_EVENTLOGGER_TRACERECORDER_H_
+
+#include "common/defs.h"
+#include "common/TraceFormat.h"
+#include "common/BlockCompressor.h"
+#include <atomic>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+class TraceRecorder {
+  public:
+    // bytes buffered per thread before writing them
+    static const unsigned BUFFER_SIZE = 1 << 20;
+
+    /**
+     * Returns true if TASKSAN_RECORD names a path prefix for traces */
+    static bool isRecording() {
+      return getPrefix() != NULL;
+    }
+
+    static void taskBegin(uint taskID) {
+      orderTask(tasksan::trace::EVENT_TASK_BEGIN, taskID);
+    }
+
+    static void taskEnd(uint taskID) {
+      orderTask(tasksan::trace::EVENT_TASK_END, taskID);
+    }
+
+    /** records that task "parentID" happens before "childID" */
+    static void dependence(uint parentID, uint childID) {
+      orderEdge(tasksan::trace::EVENT_DEPENDENCE, parentID, childID);
+    }
+
+    /** records that child "childID" joined "taskID" at a taskwait */
+    static void join(uint childID, uint taskID) {
+      orderEdge(tasksan::trace::EVENT_JOIN, childID, taskID);
+    }
+
+    /** records that bytes [addr, addr + size) were freed */
+    static void clear(ADDRESS addr, ulong size) {
+      if ( isThreadClosing() ) return;
+      ThreadTrace & trace = getThreadTrace();
+      char * event = trace.reserve(tasksan::trace::MAX_EVENT_SIZE);
+      event = tasksan::trace::put(event, tasksan::trace::EVENT_CLEAR);
+      event = tasksan::trace::putVarint(event, nextSequence());
+      event = tasksan::trace::putVarint(event, (uint64_t)addr);
+      event = tasksan::trace::putVarint(event, (uint64_t)size);
+      trace.used = event - trace.buffer;
+      trace.delta = tasksan::trace::DeltaState();
+    }
+
+    /** records a read or write of "size" bytes by task "taskID" */
+    static void access(uint taskID, ADDRESS addr, ulong size,
+        bool isWrite, INTEGER value, INTEGER funcID, INTEGER lineNo,
+        OPERATION update = OTHER) {
+      using namespace tasksan::trace;
+      if ( isThreadClosing() ) return;
+      ThreadTrace & trace = getThreadTrace();
+      switchTask(trace, taskID);
+      uint64_t siteID = getSite(trace, funcID, lineNo);
+
+      // addresses and sites are close to those of the previous access
+      int64_t addrDelta = (int64_t)((uint64_t)addr - trace.delta.addr);
+      int64_t siteDelta = (int64_t)(siteID - trace.delta.site);
+      trace.delta.addr = (uint64_t)addr;
+      trace.delta.site = siteID;
+
+      char * event = trace.reserve(MAX_EVENT_SIZE);
+      if (isWrite) {
+        event = put(event, EVENT_WRITE);
+        event = putVarint(event, zigzag(addrDelta));
+        event = putVarint(event, zigzag(value));
+        event = putVarint(event, zigzag(siteDelta));
+        event = putVarint(event, size | encodeUpdate(update) << 5);
+      } else {
+        event = put(event, EVENT_READ);
+        event = putVarint(event, zigzag(addrDelta));
+        event = putVarint(event, zigzag(siteDelta));
+        event = putVarint(event, size);
+      }
+      trace.used = event - trace.buffer;
+    }
+
+    /** records that task "taskID" acquired or released "lock" */
+    static void lock(uint taskID, unsigned long lock, bool acquired) {
+      if ( isThreadClosing() ) return;
+      ThreadTrace & trace = getThreadTrace();
+      switchTask(trace, taskID);
+      char * event = trace.reserve(tasksan::trace::MAX_EVENT_SIZE);
+      event = tasksan::trace::put(event, acquired ?
+          tasksan::trace::EVENT_LOCK_ACQUIRE :
+          tasksan::trace::EVENT_LOCK_RELEASE);
+      event = tasksan::trace::putVarint(event, (uint64_t)lock);
+      trace.used = event - trace.buffer;
+    }
+
+    /** records the name of function "funcID" */
+    static void function(INTEGER funcID, STRING funcName) {
+      if ( isThreadClosing() ) return;
+      ThreadTrace & trace = getThreadTrace();
+      uint32_t length = strlen(funcName);
+      char * event = trace.reserve(tasksan::trace::MAX_EVENT_SIZE +
+                                   std::min(length, BUFFER_SIZE / 4));
+      event = tasksan::trace::put(event, tasksan::trace::EVENT_FUNCTION);
+      event = tasksan::trace::putVarint(event, (uint64_t)funcID);
+      event = putString(event, funcName, length);
+      trace.used = event - trace.buffer;
+    }
+
+    /** records the .iir file of function "funcID" */
+    static void iirFile(INTEGER funcID, STRING fileName) {
+      if ( isThreadClosing() ) return;
+      ThreadTrace & trace = getThreadTrace();
+      uint32_t length = strlen(fileName);
+      char * event = trace.reserve(tasksan::trace::MAX_EVENT_SIZE +
+                                   std::min(length, BUFFER_SIZE / 4));
+      event = tasksan::trace::put(event, tasksan::trace::EVENT_IIR_FILE);
+      event = tasksan::trace::putVarint(event, (uint64_t)funcID);
+      event = putString(event, fileName, length);
+      trace.used = event - trace.buffer;
+    }
+
+    /**
+     * Writes the buffers of all threads to their files. Called at
+     * the end of the program, when other threads record no more. */
+    static void flushAll() {
+      std::lock_guard<std::mutex> guard( getRegistryLock() );
+      for (ThreadTrace * trace : getRegistry()) trace->flush();
+    }
+
+  private:
+    // the trace of a thread: its file and buffered events
+    struct ThreadTrace {
+      int fd = -1;
+      char * buffer = NULL;
+      ulong used = 0;
+      char * compressed = NULL; // blocks, if compressing
+      uint currentTask = ~0u;   // task of the last EVENT_SWITCH
+      uint32_t nextSite = 0;
+      std::unordered_map<INTEGER, uint32_t> sites; // (func, line) -> ID
+      tasksan::trace::DeltaState delta;
+
+      /**
+       * Returns room for "size" bytes, writing the buffer if full.
+       * Names are truncated so that an event fits an empty buffer. */
+      inline char * reserve(ulong size) {
+        if (used + size > BUFFER_SIZE) flush();
+        return buffer + used;
+      }
+
+      void flush() {
+        if (compressed) {
+          writeAll(compressed, compressBlocks(buffer, used, compressed));
+        } else {
+          writeAll(buffer, used);
+        }
+        used = 0;
+      }
+
+      void writeAll(const char * data, ulong size) {
+        ulong written = 0;
+        while (fd >= 0 && written < size) {
+          ssize_t count = write(fd, data + written, size - written);
+          if (count <= 0) break;
+          written += count;
+        }
+      }
+    };
+
+    /**
+     * Returns the path prefix of traces, NULL if not recording */
+    static STRING getPrefix() {
+      static STRING prefix = getenv("TASKSAN_RECORD");
+      return (prefix && *prefix) ? prefix : NULL;
+    }
+
+    /** Returns true if TASKSAN_RECORD_COMPRESS=1 */
+    static bool isCompressing() {
+      static STRING compress = getenv("TASKSAN_RECORD_COMPRESS");
+      static bool isCompressing = compress && atoi(compress);
+      return isCompressing;
+    }
+
+    /** returns the most bytes a full buffer compresses to */
+    static ulong getMaxBlocksSize() {
+      ulong blocks = (BUFFER_SIZE + tasksan::trace::BLOCK_SIZE - 1) /
+                     tasksan::trace::BLOCK_SIZE;
+      return blocks * (2 * sizeof(uint32_t) +
+          tasksan::compress::getMaxCompressedSize(tasksan::trace::BLOCK_SIZE));
+    }
+
+    /**
+     * Compresses "size" bytes at "events" into blocks at "blocks".
+     * Blocks which do not shrink are stored as they are. Returns the
+     * size of the blocks. */
+    static ulong compressBlocks(const char * events, ulong size,
+                                char * blocks) {
+      char * block = blocks;
+      for (ulong offset = 0; offset < size;
+           offset += tasksan::trace::BLOCK_SIZE) {
+        ulong rawSize = std::min(size - offset,
+                                 (ulong)tasksan::trace::BLOCK_SIZE);
+        char * data = block + 2 * sizeof(uint32_t);
+        ulong storedSize = tasksan::compress::compressBlock(events + offset,
+                                                            rawSize, data);
+        if (storedSize >= rawSize) {
+          memcpy(data, events + offset, rawSize);
+          storedSize = rawSize;
+        }
+        block = tasksan::trace::put(block, (uint32_t)rawSize);
+        block = tasksan::trace::put(block, (uint32_t)storedSize);
+        block += storedSize;
+      }
+      return block - blocks;
+    }
+
+    static std::mutex & getRegistryLock() {
+      static std::mutex * registryLock = new std::mutex();
+      return *registryLock;
+    }
+
+    // traces of live threads, never destroyed since threads may
+    // record after static destructors ran
+    static std::vector<ThreadTrace *> & getRegistry() {
+      static auto * registry = new std::vector<ThreadTrace *>();
+      return *registry;
+    }
+
+    // the trace of the calling thread, NULL until its first event
+    static ThreadTrace *& getCurrentTrace() {
+      static __thread ThreadTrace * threadTrace = NULL;
+      return threadTrace;
+    }
+
+    // set once the trace of the calling thread is closed, after which
+    // the thread records nothing
+    static bool & isThreadClosing() {
+      static __thread bool isClosing = false;
+      return isClosing;
+    }
+
+    /**
+     * Writes the trace of a thread which exits and frees it */
+    static void closeThreadTrace(void * data) {
+      ThreadTrace * trace = (ThreadTrace *)data;
+      {
+        std::lock_guard<std::mutex> guard( getRegistryLock() );
+        std::vector<ThreadTrace *> & registry = getRegistry();
+        registry.erase(std::remove(registry.begin(), registry.end(), trace),
+                       registry.end());
+      }
+      // frees below record clears, which the closing trace drops
+      getCurrentTrace() = NULL;
+      isThreadClosing() = true;
+      trace->flush();
+      close(trace->fd);
+      free(trace->buffer);
+      free(trace->compressed);
+      delete trace;
+    }
+
+    /**
+     * Returns the trace of the calling thread, opening its file
+     * <prefix>.<thread>.trace on first use */
+    static ThreadTrace & getThreadTrace() {
+      ThreadTrace *& threadTrace = getCurrentTrace();
+      if (threadTrace) return *threadTrace;
+
+      static pthread_key_t traceKey;
+      static bool hasKey =
+          pthread_key_create(&traceKey, closeThreadTrace) == 0;
+      static std::atomic<unsigned> threadCount{ 0 };
+
+      std::string fileName = std::string(getPrefix()) + "." +
+          std::to_string(threadCount.fetch_add(1)) +
+          tasksan::trace::getTraceExtension();
+      threadTrace = new ThreadTrace();
+      threadTrace->buffer = (char *)malloc(BUFFER_SIZE);
+      if ( isCompressing() ) {
+        threadTrace->compressed = (char *)malloc(getMaxBlocksSize());
+      }
+      threadTrace->fd = open(fileName.c_str(),
+                             O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if (threadTrace->fd < 0) {
+        std::cerr << "TaskSanitizer: cannot write " << fileName << std::endl;
+      }
+
+      // the header is never compressed
+      char header[sizeof(tasksan::trace::MAGIC) + 2 * sizeof(uint32_t)];
+      memcpy(header, tasksan::trace::MAGIC, sizeof(tasksan::trace::MAGIC));
+      char * end = tasksan::trace::put(header + sizeof(tasksan::trace::MAGIC),
+                                       (uint32_t)tasksan::trace::VERSION);
+      tasksan::trace::put(end, (uint32_t)(isCompressing() ?
+                                          tasksan::trace::FLAG_COMPRESSED : 0));
+      threadTrace->writeAll(header, sizeof(header));
+
+      if (hasKey) pthread_setspecific(traceKey, threadTrace);
+      std::lock_guard<std::mutex> guard( getRegistryLock() );
+      getRegistry().push_back( threadTrace );
+      return *threadTrace;
+    }
+
+    // numbers events which order tasks
+    static std::atomic<uint64_t> & getSequence() {
+      static std::atomic<uint64_t> sequence{ 0 };
+      return sequence;
+    }
+
+    static inline uint64_t nextSequence() {
+      return getSequence().fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static inline char * putString(char * event, STRING text,
+                                   uint32_t length) {
+      length = std::min(length, BUFFER_SIZE / 4);
+      event = tasksan::trace::putVarint(event, length);
+      memcpy(event, text, length);
+      return event + length;
+    }
+
+    static void orderTask(tasksan::trace::EventType type, uint taskID) {
+      if ( isThreadClosing() ) return;
+      ThreadTrace & trace = getThreadTrace();
+      char * event = trace.reserve(tasksan::trace::MAX_EVENT_SIZE);
+      event = tasksan::trace::put(event, type);
+      event = tasksan::trace::putVarint(event, nextSequence());
+      event = tasksan::trace::putVarint(event, taskID);
+      trace.used = event - trace.buffer;
+      trace.delta = tasksan::trace::DeltaState();
+    }
+
+    static void orderEdge(tasksan::trace::EventType type,
+                          uint firstID, uint secondID) {
+      if ( isThreadClosing() ) return;
+      ThreadTrace & trace = getThreadTrace();
+      char * event = trace.reserve(tasksan::trace::MAX_EVENT_SIZE);
+      event = tasksan::trace::put(event, type);
+      event = tasksan::trace::putVarint(event, nextSequence());
+      event = tasksan::trace::putVarint(event, firstID);
+      event = tasksan::trace::putVarint(event, secondID);
+      trace.used = event - trace.buffer;
+      trace.delta = tasksan::trace::DeltaState();
+    }
+
+    /** records that events from now on belong to task "taskID" */
+    static inline void switchTask(ThreadTrace & trace, uint taskID) {
+      if (trace.currentTask == taskID) return;
+      char * event = trace.reserve(tasksan::trace::MAX_EVENT_SIZE);
+      event = tasksan::trace::put(event, tasksan::trace::EVENT_SWITCH);
+      event = tasksan::trace::putVarint(event,
+          getSequence().load(std::memory_order_relaxed));
+      event = tasksan::trace::putVarint(event, taskID);
+      trace.used = event - trace.buffer;
+      trace.currentTask = taskID;
+      trace.delta = tasksan::trace::DeltaState();
+    }
+
+    /**
+     * Returns the ID of site ("funcID", "lineNo") in the trace,
+     * recording the site on first use */
+    static inline uint32_t getSite(ThreadTrace & trace,
+                                   INTEGER funcID, INTEGER lineNo) {
+      INTEGER key = (funcID << 32) | (uint32_t)lineNo;
+      auto site = trace.sites.find(key);
+      if (site != trace.sites.end()) return site->second;
+
+      uint32_t siteID = trace.nextSite++;
+      trace.sites[key] = siteID;
+      char * event = trace.reserve(tasksan::trace::MAX_EVENT_SIZE);
+      event = tasksan::trace::put(event, tasksan::trace::EVENT_SITE);
+      event = tasksan::trace::putVarint(event, siteID);
+      event = tasksan::trace::putVarint(event, (uint64_t)funcID);
+      event = tasksan::trace::putVarint(event, tasksan::trace::zigzag(lineNo));
+      trace.used = event - trace.buffer;
+      return siteID;
+    }
+};
+
+#endif // end TraceRecorder.h
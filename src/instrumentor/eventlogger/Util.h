@@ -39,6 +39,10 @@ void createNewTaskMetadata(ompt_data_t *task_data) {
 
   if (oldTaskInfo) {
     newTaskInfo->childrenIDs = oldTaskInfo->childrenIDs;
+    newTaskInfo->lockSetID   = oldTaskInfo->lockSetID;
+    newTaskInfo->stackBottom = oldTaskInfo->stackBottom;
+    newTaskInfo->stackTop    = oldTaskInfo->stackTop;
+    newTaskInfo->stackLow    = oldTaskInfo->stackLow;
   }
 
   INS::TaskBeginLog(*newTaskInfo);
@@ -81,9 +85,12 @@ void endThisTask(ompt_data_t *task_data) {
 
 /**
  * Changes identifer of the current task to
- * new ID and thus make it look like a new task. */
+ * new ID and thus make it look like a new task.
+ * The task runs on the calling thread, which records
+ * the frees of the new segment in its summary. */
 void disguiseToTewTask(ompt_data_t *task_data) {
   UTIL::createNewTaskMetadata(task_data);
+  if (task_data) INS::setRunningTask( (TaskInfo *)task_data->ptr );
 }
 
 } // namespace
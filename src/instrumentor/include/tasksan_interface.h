@@ -0,0 +1,47 @@
+/////////////////////////////////////////////////////////////////
+//  TaskSanitizer: a lightweight determinacy race checking
+//          tool for OpenMP task applications
+//
+//    Copyright (c) 2015 - 2018 Hassan Salehe Matar
+//      Copying or using this code by any means whatsoever
+//      without consent of the owner is strictly prohibited.
+//
+//   Contact: hassansalehe-at-gmail-dot-com
+//
+/////////////////////////////////////////////////////////////////
+
+// The public interface of TaskSanitizer for programs it checks, e.g.
+// to skip known-safe phases such as I/O or initialization:
+//   TASKSAN_IGNORE_BEGIN();
+//   readInput(file);
+//   TASKSAN_IGNORE_END();
+// Accesses of the calling thread between the two are not checked,
+// while tasks and their dependences still are. Regions nest. Define
+// TASKSAN_NO_ANNOTATIONS to compile the annotations away.
+
+#ifndef _INSTRUMENTOR_INCLUDE_TASKSAN_INTERFACE_H_
+#define _INSTRUMENTOR_INCLUDE_TASKSAN_INTERFACE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Starts a region of the calling thread whose accesses are ignored */
+void tasksan_disable(void);
+
+/** Ends the innermost ignored region of the calling thread */
+void tasksan_enable(void);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#ifdef TASKSAN_NO_ANNOTATIONS
+#define TASKSAN_IGNORE_BEGIN() do { } while (0)
+#define TASKSAN_IGNORE_END()   do { } while (0)
+#else
+#define TASKSAN_IGNORE_BEGIN() tasksan_disable()
+#define TASKSAN_IGNORE_END()   tasksan_enable()
+#endif
+
+#endif // end tasksan_interface.h
@@ -72,7 +72,7 @@ std::string createAbsoluteFileName(
 }
 
 /**
- * Returns absolute file name of which the function belongs to.
+ * Returns absolute file name of the main source file of the module.
  */
 std::string getFullFilename(llvm::Module & M) {
 
@@ -80,14 +80,10 @@ std::string getFullFilename(llvm::Module & M) {
   std::string dirName   =  "";
   llvm::DebugInfoFinder dFinder;
   dFinder.processModule(M);
-  for (auto aScope : dFinder.scopes() ) {
-    dirName = aScope->getDirectory().str();
-    name    = aScope->getFilename().str();
-    name    = createAbsoluteFileName(dirName, name);
-
-    if (name.find("Unknown.iir") == std::string::npos) {
-      return name;
-    }
+  for (auto aUnit : dFinder.compile_units() ) {
+    dirName = aUnit->getDirectory().str();
+    name    = aUnit->getFilename().str();
+    return createAbsoluteFileName(dirName, name);
   }
   return name;
 }
@@ -206,6 +202,19 @@ bool hasMainFunction(llvm::Module & M) {
     }
   }
 
+  /**
+   * Returns the absolute name of the source file of the instruction,
+   * "Unknown" without debugging information.
+   */
+  std::string getFilename(llvm::Instruction* I) {
+    if (auto Loc = I->getDebugLoc()) {
+      std::string dirName = Loc->getDirectory().str();
+      std::string name = Loc->getFilename().str();
+      return createAbsoluteFileName(dirName, name);
+    }
+    return "Unknown";
+  }
+
 } // namespace debug
 
 } // tasksan
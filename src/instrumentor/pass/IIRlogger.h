@@ -31,30 +31,35 @@ namespace tasksan {
 /// detected among them.
 namespace IIRlog {
 
-  // the log out stream
-  std::ofstream logFile;
+  // IIR of the critical sections of the current module
+  std::string logBuffer;
+
+  // the .iir file of the current module, empty if it has no debug
+  // information
+  std::string logFileName;
 
   /**
-   * Opens an output log file which is later used for
-   * logging all instructions in program's critical sections.
+   * Names the .iir file of module "M" after its source file, hence
+   * each translation unit logs into a file of its own. The IIR is
+   * buffered and written to disk only once, by FinalizeLogger at the
+   * end of the module.
    */
-  void InitializeLogger( std::string cppName ) {
-    std::string full_file_name = "" + cppName + ".iir";
-
-    if ( logFile.is_open() ) logFile.close();
-
-    logFile.open(full_file_name, std::ofstream::out | std::ofstream::app);
-    if ( !logFile.is_open() ) {
-      llvm::errs() << "FILE NO OPEN \n";
+  void InitializeLogger(llvm::Module & M) {
+    logBuffer.clear();
+    logFileName = tasksan::debug::getFullFilename(M);
+    if (logFileName == "Unknown") {
+      logFileName.clear();
+    } else {
+      logFileName += ".iir";
     }
   }
 
-
   /**
    * Saves a string to a log file
    */
   void SaveToLogFile( llvm::StringRef taskName ) {
-     logFile << taskName.str() << std::endl << std::flush;
+     logBuffer.append( taskName.str() );
+     logBuffer.push_back('\n');
   }
 
   /**
@@ -66,10 +71,42 @@ namespace IIRlog {
    */
   void LogNewIIRcode(int lineNo, llvm::Instruction& IIRcode ) {
     //errs() << lineNo << ": " << IIRcode.str() << "\n";
-    std::string tempBuf;
-    llvm::raw_string_ostream rso(tempBuf);
+    llvm::raw_string_ostream rso(logBuffer);
+    rso << lineNo << ": ";
     IIRcode.print(rso);
-    logFile << lineNo << ": " << tempBuf << std::endl;
+    rso << "\n";
+  }
+
+  /**
+   * Writes the buffered IIR of the module to its .iir file. The file
+   * is written to a unique temporary file first and then renamed
+   * over the .iir file, which replaces whatever an earlier build of
+   * the module logged. A module without critical sections removes
+   * its stale .iir file.
+   */
+  void FinalizeLogger() {
+    if ( logFileName.empty() ) return;
+    if ( logBuffer.empty() ) {
+      llvm::sys::fs::remove(logFileName);
+      return;
+    }
+
+    int tempFD;
+    llvm::SmallString<128> tempName;
+    if (llvm::sys::fs::createUniqueFile(
+          logFileName + ".%%%%%%.tmp", tempFD, tempName)) {
+      llvm::errs() << "FILE NO OPEN " << logFileName << "\n";
+      return;
+    }
+    {
+      llvm::raw_fd_ostream tempFile(tempFD, /*shouldClose=*/true);
+      tempFile << logBuffer;
+    }
+    if (llvm::sys::fs::rename(tempName, logFileName)) {
+      llvm::errs() << "FILE NO RENAME " << logFileName << "\n";
+      llvm::sys::fs::remove(tempName);
+    }
+    logBuffer.clear();
   }
 
   /**
@@ -122,31 +159,41 @@ namespace IIRlog {
 
   /**
    * Logs all statements in critical sections for commutativity
-   * checking in verification of determinacy races
+   * checking in verification of determinacy races. The sections
+   * follow a line which names function "name", as functions from
+   * headers may share line numbers with those of the module.
+   * Returns the .iir file name if the function has critical
+   * sections, an empty string otherwise.
    */
-  void logTaskBody(llvm::Function & F, llvm::StringRef name) {
+  std::string logTaskBody(llvm::Function & F, llvm::StringRef name) {
 
-    std::string fullFileName = tasksan::debug::getFilename(F);
-    if (fullFileName == "Unknown") {
-      return;
+    if ( logFileName.empty() ) {
+      return "";
     }
 
     int in_critical_section = 0;
+    bool logger_initialized = false;
 
     // search for critical sections in the whole function body
     for (auto &BB : F) {
       for (auto &Inst : BB) {
 
         if ( isLockInvocation(Inst) ) { // set critical section
-          InitializeLogger(fullFileName);
+          if ( !logger_initialized ) {
+            IIRlog::SaveToLogFile(
+                tasksan::getFunctionSignature() + name.str() );
+            logger_initialized = true;
+          }
           if (in_critical_section == 0) {
             IIRlog::SaveToLogFile( tasksan::getStartCriticalSignature() );
           }
           in_critical_section++;
         } else if ( isUnlockInvocation(Inst) ) { // exit critical section
-          if (in_critical_section > 0) in_critical_section--;
-          if (in_critical_section == 0) {
-            IIRlog::SaveToLogFile( tasksan::getEndCriticalSignature() );
+          if (in_critical_section > 0) {
+            in_critical_section--;
+            if (in_critical_section == 0) {
+              IIRlog::SaveToLogFile( tasksan::getEndCriticalSignature() );
+            }
           }
         } else if (in_critical_section > 0) { // in critical section
           unsigned lineNo = 0;
@@ -157,6 +204,7 @@ namespace IIRlog {
         }
       }
     }
+    return logger_initialized ? logFileName : "";
   }
 } // end IIRlog namespace
 
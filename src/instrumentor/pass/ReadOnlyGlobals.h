@@ -0,0 +1,137 @@
+/////////////////////////////////////////////////////////////////
+//  TaskSanitizer: a lightweight determinacy race checking
+//          tool for OpenMP applications
+//
+//    Copyright (c) 2015 - 2018 Hassan Salehe Matar
+//      Copying or using this code by any means whatsoever
+//      without consent of the owner is strictly prohibited.
+//
+//   Contact: hassansalehe-at-gmail-dot-com
+//
+/////////////////////////////////////////////////////////////////
+
+// Finds global variables which are never written from code that
+// may run in OpenMP tasks, e.g. lookup tables and configuration
+// filled before the first parallel region. Reads of them cannot
+// race since no task writes them.
+
+#ifndef _INSTRUMENTOR_PASS_READONLYGLOBALS_H_
+#define _INSTRUMENTOR_PASS_READONLYGLOBALS_H_
+
+#include "instrumentor/pass/LLVMLibs.h" // all LLVM includes stored there
+#include "instrumentor/pass/Util.h"
+#include "instrumentor/pass/TaskReachability.h"
+#include <set>
+
+/// general namespace for TaskSanitizer tool
+namespace tasksan {
+
+/// This namespace contains a module-level analysis of global
+/// variables. A global is read-only in tasks if every use of its
+/// address is a load, or a store or memory intrinsic writing it
+/// in a function which never runs in a task. Any other use, e.g.
+/// passing its address to a call, may let a task write it.
+namespace rodata {
+
+  // globals never written from code which may run in a task
+  std::set<const llvm::GlobalVariable *> readOnlyGlobals;
+
+  // read-only globals whose reads were not instrumented
+  std::set<const llvm::GlobalVariable *> elidedGlobals;
+
+  /**
+   * Checks if a write "I" happens only outside tasks
+   */
+  bool isSerialWrite(const llvm::Instruction & I) {
+    return !tasksan::reach::taskFunctions.count(I.getFunction());
+  }
+
+  /**
+   * Checks if use "U" of the address of a global neither writes it
+   * in a task nor lets the address escape. Derived addresses are
+   * added to "worklist".
+   */
+  bool isReadOnlyUse(const llvm::Use & U,
+                     std::vector<const llvm::Value *> & worklist) {
+    const llvm::User *user = U.getUser();
+
+    // addresses derived from the global: casts and GEPs
+    if (llvm::isa<llvm::BitCastOperator>(user) ||
+        llvm::isa<llvm::GEPOperator>(user)) {
+      worklist.push_back(user);
+      return true;
+    }
+
+    if (llvm::isa<llvm::LoadInst>(user)) return true;
+    if (auto *SI = llvm::dyn_cast<llvm::StoreInst>(user)) {
+      return U.getOperandNo() == SI->getPointerOperandIndex() &&
+             isSerialWrite(*SI);
+    }
+    if (auto *MI = llvm::dyn_cast<llvm::MemIntrinsic>(user)) {
+      // the source of a copy is only read
+      if (llvm::isa<llvm::MemTransferInst>(MI) && U.getOperandNo() == 1)
+        return true;
+      return U.getOperandNo() == 0 && isSerialWrite(*MI);
+    }
+    if (auto *II = llvm::dyn_cast<llvm::IntrinsicInst>(user)) {
+      return llvm::isa<llvm::DbgInfoIntrinsic>(II) ||
+             II->getIntrinsicID() == llvm::Intrinsic::lifetime_start ||
+             II->getIntrinsicID() == llvm::Intrinsic::lifetime_end;
+    }
+    return llvm::isa<llvm::ICmpInst>(user);
+  }
+
+  /**
+   * Checks if global "GV" is never written from task code.
+   * If "closedModule" is true, no other module accesses it.
+   */
+  bool isReadOnlyInTasks(const llvm::GlobalVariable & GV,
+                         bool closedModule) {
+    if (GV.isDeclaration() || GV.isConstant() || GV.isThreadLocal() ||
+        GV.isExternallyInitialized() || GV.getAddressSpace() != 0 ||
+        GV.getName().startswith("llvm.")) {
+      return false;
+    }
+    if (!closedModule && !GV.hasLocalLinkage()) return false;
+
+    std::vector<const llvm::Value *> worklist(1, &GV);
+    while ( !worklist.empty() ) {
+      const llvm::Value *V = worklist.back();
+      worklist.pop_back();
+      for (const llvm::Use & U : V->uses()) {
+        if ( !isReadOnlyUse(U, worklist) ) return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * Finds the globals of module "M" which are read-only in tasks.
+   * Uses the functions which may run in tasks, computed by
+   * tasksan::reach::analyzeModule.
+   */
+  void analyzeModule(llvm::Module & M, bool closedModule) {
+    readOnlyGlobals.clear();
+    elidedGlobals.clear();
+    for (auto & GV : M.globals()) {
+      if ( isReadOnlyInTasks(GV, closedModule) )
+        readOnlyGlobals.insert(&GV);
+    }
+  }
+
+  /**
+   * Checks if "Addr" points into a global which is read-only
+   * in tasks. Such globals are recorded for the runtime.
+   */
+  bool isReadOnly(const llvm::Value * Addr) {
+    auto *GV = llvm::dyn_cast<llvm::GlobalVariable>(
+        tasksan::util::getPointerBase(Addr));
+    if (!GV || !readOnlyGlobals.count(GV)) return false;
+    elidedGlobals.insert(GV);
+    return true;
+  }
+} // end rodata namespace
+
+} // end tasksan namespace
+
+#endif // end ReadOnlyGlobals.h
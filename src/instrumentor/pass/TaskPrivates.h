@@ -0,0 +1,342 @@
+/////////////////////////////////////////////////////////////////
+//  TaskSanitizer: a lightweight determinacy race checking
+//          tool for OpenMP applications
+//
+//    Copyright (c) 2015 - 2018 Hassan Salehe Matar
+//      Copying or using this code by any means whatsoever
+//      without consent of the owner is strictly prohibited.
+//
+//   Contact: hassansalehe-at-gmail-dot-com
+//
+/////////////////////////////////////////////////////////////////
+
+// Finds memory accesses to the data which the OpenMP runtime
+// allocates for each task: the kmp_task_t descriptor and the
+// privates block holding private and firstprivate variables.
+// Only the creating task, before the task is enqueued, and the
+// task itself touch this data, so its accesses cannot race.
+
+#ifndef _INSTRUMENTOR_PASS_TASKPRIVATES_H_
+#define _INSTRUMENTOR_PASS_TASKPRIVATES_H_
+
+#include "instrumentor/pass/LLVMLibs.h" // all LLVM includes stored there
+#include "instrumentor/pass/Util.h"
+#include <map>
+#include <set>
+
+/// general namespace for TaskSanitizer tool
+namespace tasksan {
+
+/// This namespace contains a module-level analysis of pointers
+/// to task-owned data. Clang lays a task out as
+///   %struct.kmp_task_t_with_privates = { %struct.kmp_task_t,
+///                                        %struct..kmp_privates.t }
+/// and the pointers into it come from:
+///   - the result of __kmpc_omp_task_alloc in the creating task,
+///   - the second argument of the task entry (.omp_task_entry.)
+///     passed to __kmpc_omp_task_alloc,
+///   - arguments of internal functions, e.g. the outlined task
+///     body, to which every caller passes such pointers,
+///   - stack slots which .omp_task_privates_map. fills with the
+///     addresses of the privates, and slots holding such pointers
+///     in unoptimized code.
+namespace privates {
+
+  enum Kind {
+    NONE,          // may point to shared data
+    TASK_LOCAL,    // points to data owned by a single task
+    PRIVATES_MAP   // the function mapping privates to slots
+  };
+
+  // pointer arguments known to point to task-owned data
+  std::map<const llvm::Argument *, Kind> argKinds;
+
+  // stack slots whose loaded values point to task-owned data
+  std::map<const llvm::AllocaInst *, Kind> slotKinds;
+
+  // stack slots filled by the privates mapping function
+  std::set<const llvm::AllocaInst *> mapSlots;
+
+  // functions passing task-owned data to each other: function ->
+  // a function of the same group
+  std::map<const llvm::Function *, const llvm::Function *> groups;
+
+  // groups in which pointers to task-owned data escape
+  std::set<const llvm::Function *> escapingGroups;
+
+  // number of accesses not instrumented thanks to this analysis
+  unsigned elidedAccesses = 0;
+
+  /**
+   * Checks if a function maps the privates of a task to pointers
+   */
+  bool isPrivatesMap(const llvm::Function & F) {
+    return F.getName().startswith(".omp_task_privates_map.");
+  }
+
+  /**
+   * Checks if a call allocates a task descriptor
+   */
+  bool isTaskAlloc(const llvm::Value * V) {
+    auto *CI = llvm::dyn_cast_or_null<llvm::CallInst>(V);
+    const llvm::Function *callee = CI ? CI->getCalledFunction() : nullptr;
+    return callee && (callee->getName() == "__kmpc_omp_task_alloc" ||
+                      callee->getName() == "__kmpc_omp_target_task_alloc");
+  }
+
+  /**
+   * Classifies pointer "V" with the facts known so far
+   */
+  Kind classify(const llvm::Value * V) {
+    const llvm::Value *base = tasksan::util::getPointerBase(V);
+
+    if (auto *F = llvm::dyn_cast<llvm::Function>(base))
+      return isPrivatesMap(*F) ? PRIVATES_MAP : NONE;
+    if (isTaskAlloc(base)) return TASK_LOCAL;
+
+    if (auto *A = llvm::dyn_cast<llvm::Argument>(base)) {
+      auto kind = argKinds.find(A);
+      return kind == argKinds.end() ? NONE : kind->second;
+    }
+    if (auto *AI = llvm::dyn_cast<llvm::AllocaInst>(base))
+      return mapSlots.count(AI) ? TASK_LOCAL : NONE;
+
+    // a value loaded from a stack slot
+    if (auto *LI = llvm::dyn_cast<llvm::LoadInst>(base)) {
+      auto *slot = llvm::dyn_cast<llvm::AllocaInst>(
+          LI->getPointerOperand()->stripPointerCasts());
+      if (!slot) return NONE;
+      auto kind = slotKinds.find(slot);
+      return kind == slotKinds.end() ? NONE : kind->second;
+    }
+    return NONE;
+  }
+
+  /**
+   * Checks if "CI" calls the privates mapping function of a task
+   */
+  bool isPrivatesMapCall(const llvm::CallInst & CI) {
+    return CI.getNumArgOperands() > 1 &&
+           classify(CI.getCalledValue()) == PRIVATES_MAP &&
+           classify(CI.getArgOperand(0)) == TASK_LOCAL;
+  }
+
+  /**
+   * Updates the kind of a stack slot from all its uses. Returns
+   * true if the kind changed.
+   */
+  bool analyzeSlot(const llvm::AllocaInst & AI) {
+    Kind kind = NONE;
+    bool isMapSlot = false, first = true;
+    for (const llvm::Use & U : AI.uses()) {
+      const llvm::User *user = U.getUser();
+      Kind stored = NONE;
+      if (llvm::isa<llvm::LoadInst>(user)) {
+        continue;
+      } else if (auto *SI = llvm::dyn_cast<llvm::StoreInst>(user)) {
+        if (U.getOperandNo() != SI->getPointerOperandIndex()) return false;
+        stored = classify(SI->getValueOperand());
+      } else if (auto *CI = llvm::dyn_cast<llvm::CallInst>(user)) {
+        if (!isPrivatesMapCall(*CI) || U.getOperandNo() == 0) return false;
+        stored = TASK_LOCAL;
+        isMapSlot = true;
+      } else if (!llvm::isa<llvm::DbgInfoIntrinsic>(user)) {
+        return false;
+      }
+      if (stored == NONE || (!first && stored != kind)) return false;
+      kind = stored;
+      first = false;
+    }
+    if (first) return false;
+
+    bool changed = slotKinds[&AI] != kind;
+    slotKinds[&AI] = kind;
+    if (isMapSlot) mapSlots.insert(&AI);
+    return changed;
+  }
+
+  /**
+   * Updates the kinds of the arguments of an internal function
+   * from its call sites. Returns true if a kind changed.
+   */
+  bool analyzeArguments(const llvm::Function & F) {
+    if (!F.hasLocalLinkage() || isPrivatesMap(F) || F.use_empty())
+      return false;
+
+    std::vector<Kind> kinds;
+    for (const llvm::Use & U : F.uses()) {
+      auto *CI = llvm::dyn_cast<llvm::CallInst>(U.getUser());
+      if (!CI || !CI->isCallee(&U)) return false;
+      for (unsigned i = 0; i < F.arg_size(); i++) {
+        Kind kind = classify(CI->getArgOperand(i));
+        if (kinds.size() == i) kinds.push_back(kind);
+        else if (kinds[i] != kind) kinds[i] = NONE;
+      }
+    }
+
+    bool changed = false;
+    for (auto & A : F.args()) {
+      if (kinds[A.getArgNo()] == NONE || argKinds.count(&A)) continue;
+      argKinds[&A] = kinds[A.getArgNo()];
+      changed = true;
+    }
+    return changed;
+  }
+
+  /**
+   * Returns the representative of the group of function "F"
+   */
+  const llvm::Function * getGroup(const llvm::Function * F) {
+    auto parent = groups.find(F);
+    if (parent == groups.end() || parent->second == F) return F;
+    const llvm::Function *root = getGroup(parent->second);
+    groups[F] = root;
+    return root;
+  }
+
+  /**
+   * Checks if a use of pointer "V" to task-owned data may let the
+   * pointer escape. Uses which pass it to an internal function put
+   * the caller and the callee into one group.
+   */
+  bool mayEscape(const llvm::Use & U) {
+    const llvm::User *user = U.getUser();
+    if (llvm::isa<llvm::LoadInst>(user) || llvm::isa<llvm::ICmpInst>(user) ||
+        llvm::isa<llvm::GetElementPtrInst>(user) ||
+        llvm::isa<llvm::BitCastInst>(user)) {
+      return false;
+    }
+
+    if (auto *SI = llvm::dyn_cast<llvm::StoreInst>(user)) {
+      if (U.getOperandNo() == SI->getPointerOperandIndex()) return false;
+      // stored into a stack slot whose loads are tracked
+      auto *slot = llvm::dyn_cast<llvm::AllocaInst>(
+          SI->getPointerOperand()->stripPointerCasts());
+      return !slot || slotKinds[slot] != TASK_LOCAL;
+    }
+
+    auto *CI = llvm::dyn_cast<llvm::CallInst>(user);
+    if (!CI) return true;
+    if (llvm::isa<llvm::DbgInfoIntrinsic>(CI) ||
+        llvm::isa<llvm::MemIntrinsic>(CI) || isPrivatesMapCall(*CI)) {
+      return false;
+    }
+    const llvm::Function *callee = CI->getCalledFunction();
+    if (!callee || CI->isCallee(&U)) return true;
+    if (callee->getName().startswith("__kmpc_") ||
+        callee->getIntrinsicID() == llvm::Intrinsic::lifetime_start ||
+        callee->getIntrinsicID() == llvm::Intrinsic::lifetime_end) {
+      return false;
+    }
+
+    // the callee receives task-owned data only from its callers
+    if (U.getOperandNo() >= callee->arg_size()) return true;
+    auto arg = argKinds.find(&*std::next(callee->arg_begin(),
+                                         U.getOperandNo()));
+    if (arg == argKinds.end() || arg->second != TASK_LOCAL) return true;
+    groups[getGroup(CI->getFunction())] = getGroup(callee);
+    return false;
+  }
+
+  /**
+   * Finds the groups of functions in which pointers to task-owned
+   * data escape, e.g. when a task passes the address of its
+   * firstprivate variable to a child task as a shared variable.
+   */
+  void findEscapes(llvm::Module & M) {
+    std::set<const llvm::Function *> escaping;
+    for (auto & F : M) {
+      if (F.isDeclaration()) continue;
+      groups[&F] = &F;
+    }
+
+    for (auto & F : M) {
+      // the mapping function stores addresses of privates into the
+      // slots of its caller by design
+      if (F.isDeclaration() || isPrivatesMap(F)) continue;
+      std::vector<const llvm::Value *> pointers;
+      for (auto & A : F.args()) pointers.push_back(&A);
+      for (auto & I : llvm::instructions(F)) pointers.push_back(&I);
+
+      for (auto V : pointers) {
+        if (!V->getType()->isPointerTy() || classify(V) != TASK_LOCAL)
+          continue;
+        for (const llvm::Use & U : V->uses()) {
+          if (mayEscape(U)) escaping.insert(&F);
+        }
+      }
+    }
+
+    for (auto F : escaping) escapingGroups.insert(getGroup(F));
+  }
+
+  /**
+   * Finds the pointers to task-owned data in module "M"
+   */
+  void analyzeModule(llvm::Module & M) {
+    argKinds.clear();
+    slotKinds.clear();
+    mapSlots.clear();
+    groups.clear();
+    escapingGroups.clear();
+    elidedAccesses = 0;
+
+    for (auto & F : M) {
+      if (F.isDeclaration()) continue;
+      // the mapping function writes only to the task and its slots
+      if (isPrivatesMap(F)) {
+        for (auto & A : F.args()) argKinds[&A] = TASK_LOCAL;
+      }
+
+      // the task entry passed to the allocation of a task receives
+      // the task descriptor: entry(gtid, task)
+      for (auto & I : llvm::instructions(F)) {
+        auto *CI = llvm::dyn_cast<llvm::CallInst>(&I);
+        if (!isTaskAlloc(CI) || CI->getNumArgOperands() < 6) continue;
+        auto *entry = llvm::dyn_cast<llvm::Function>(
+            CI->getArgOperand(5)->stripPointerCasts());
+        if (entry && !entry->isDeclaration() && entry->arg_size() == 2)
+          argKinds[&*std::next(entry->arg_begin())] = TASK_LOCAL;
+      }
+    }
+
+    // facts only grow, so iterating until none changes terminates
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (auto & F : M) {
+        if (F.isDeclaration()) continue;
+        changed |= analyzeArguments(F);
+        for (auto & I : F.getEntryBlock()) {
+          if (auto *AI = llvm::dyn_cast<llvm::AllocaInst>(&I))
+            changed |= analyzeSlot(*AI);
+        }
+      }
+    }
+    findEscapes(M);
+  }
+
+  /**
+   * Checks if access "I" to "Addr" touches only task-owned data
+   * whose address does not escape.
+   */
+  bool isTaskLocal(const llvm::Instruction * I, const llvm::Value * Addr) {
+    if (classify(Addr) != TASK_LOCAL) return false;
+    if (escapingGroups.count(getGroup(I->getFunction()))) return false;
+    elidedAccesses++;
+    return true;
+  }
+
+  /**
+   * Prints how many accesses to task-owned data were elided.
+   */
+  void reportElided(llvm::Module & M) {
+    llvm::errs() << "TaskSanitizer: " << elidedAccesses
+                 << " access(es) to task descriptors and privates not"
+                 << " instrumented in " << M.getModuleIdentifier() << "\n";
+  }
+} // end privates namespace
+
+} // end tasksan namespace
+
+#endif // end TaskPrivates.h
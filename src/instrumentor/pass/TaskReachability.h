@@ -0,0 +1,198 @@
+/////////////////////////////////////////////////////////////////
+//  TaskSanitizer: a lightweight determinacy race checking
+//          tool for OpenMP applications
+//
+//    Copyright (c) 2015 - 2018 Hassan Salehe Matar
+//      Copying or using this code by any means whatsoever
+//      without consent of the owner is strictly prohibited.
+//
+//   Contact: hassansalehe-at-gmail-dot-com
+//
+/////////////////////////////////////////////////////////////////
+
+// Finds functions of a module which may execute inside OpenMP
+// tasks or parallel regions. Purely serial functions need not be
+// instrumented since no task is active while they run.
+
+#ifndef _INSTRUMENTOR_PASS_TASKREACHABILITY_H_
+#define _INSTRUMENTOR_PASS_TASKREACHABILITY_H_
+
+#include "instrumentor/pass/LLVMLibs.h" // all LLVM includes stored there
+#include "instrumentor/pass/Util.h"
+#include <set>
+#include <vector>
+
+/// general namespace for TaskSanitizer tool
+namespace tasksan {
+
+/// This namespace contains a module-level call-graph analysis
+/// which finds the functions reachable from bodies of OpenMP
+/// outlined regions and tasks. The roots are:
+///   - .omp_outlined. and .omp_task_entry. functions,
+///   - functions passed to OpenMP runtime calls (__kmpc_*), e.g.
+///     task entries passed to __kmpc_omp_task_alloc,
+///   - functions with unknown callers: address-taken functions
+///     and, unless the module is assumed closed, functions
+///     visible to other modules.
+namespace reach {
+
+  // functions of the current module which may run in a task
+  std::set<const llvm::Function *> taskFunctions;
+
+  // functions of the current module which may run outside tasks
+  std::set<const llvm::Function *> serialFunctions;
+
+  // functions passed to the OpenMP runtime, e.g. task entries
+  std::set<const llvm::Function *> runtimeCallbacks;
+
+  // names of functions which are not instrumented
+  std::vector<std::string> skippedFunctions;
+
+  /**
+   * Checks if a function is a body of an OpenMP outlined region
+   * or of a task generated by the compiler.
+   */
+  bool isOpenMPEntry(const llvm::Function & F) {
+    llvm::StringRef name = F.getName();
+    return name.find(".omp_outlined.") != llvm::StringRef::npos ||
+           name.find(".omp_task_entry.") != llvm::StringRef::npos;
+  }
+
+  /**
+   * Returns the function called directly by an instruction,
+   * nullptr if the instruction is not a direct call.
+   */
+  const llvm::Function * getDirectCallee(const llvm::Instruction & Inst) {
+    if (auto *CI = llvm::dyn_cast<llvm::CallInst>(&Inst)) {
+      return CI->getCalledFunction();
+    } else if (auto *II = llvm::dyn_cast<llvm::InvokeInst>(&Inst)) {
+      return II->getCalledFunction();
+    }
+    return nullptr;
+  }
+
+  /**
+   * Checks if a call is made to the OpenMP runtime library
+   */
+  bool isOpenMPRuntimeCall(const llvm::Instruction & Inst) {
+    const llvm::Function *callee = getDirectCallee(Inst);
+    return callee && callee->getName().startswith("__kmpc_");
+  }
+
+  /**
+   * Checks if a function may be called from code which
+   * this module does not see.
+   */
+  bool hasUnknownCallers(const llvm::Function & F, bool closedModule) {
+    // main is called only at program start-up
+    if (F.getName() == "main") return false;
+    if (F.hasAddressTaken()) return true;
+    return !closedModule && !F.hasLocalLinkage();
+  }
+
+  /**
+   * Adds to "reached" the functions in "worklist" and all functions
+   * they call directly. Calls to OpenMP entries are not followed
+   * if "skipEntries" is true.
+   */
+  void closeOverCalls(std::vector<const llvm::Function *> & worklist,
+                      std::set<const llvm::Function *> & reached,
+                      bool skipEntries) {
+    for (auto F : worklist) reached.insert(F);
+
+    while ( !worklist.empty() ) {
+      const llvm::Function *F = worklist.back();
+      worklist.pop_back();
+      for (auto & BB : *F) {
+        for (auto & Inst : BB) {
+          const llvm::Function *callee = getDirectCallee(Inst);
+          if (!callee || callee->isDeclaration()) continue;
+          if (skipEntries && (isOpenMPEntry(*callee) ||
+                              runtimeCallbacks.count(callee))) continue;
+          if (reached.insert(callee).second) worklist.push_back(callee);
+        }
+      }
+    }
+  }
+
+  /**
+   * Computes the functions of module "M" which may run in a task.
+   * If "closedModule" is true, functions visible to other modules
+   * are assumed to be called only from this module.
+   */
+  void analyzeModule(llvm::Module & M, bool closedModule) {
+    taskFunctions.clear();
+    serialFunctions.clear();
+    runtimeCallbacks.clear();
+    skippedFunctions.clear();
+
+    for (auto & F : M) {
+      if (F.isDeclaration()) continue;
+
+      // callbacks passed to the OpenMP runtime (tasks, microtasks)
+      for (auto & BB : F) {
+        for (auto & Inst : BB) {
+          if ( !isOpenMPRuntimeCall(Inst) ) continue;
+          for (auto & operand : Inst.operands()) {
+            auto *callback = llvm::dyn_cast<llvm::Function>(
+                operand->stripPointerCasts());
+            if (callback && !callback->isDeclaration())
+              runtimeCallbacks.insert(callback);
+          }
+        }
+      }
+    }
+
+    std::vector<const llvm::Function *> taskRoots, serialRoots;
+    for (auto & F : M) {
+      if (F.isDeclaration()) continue;
+      bool isEntry = isOpenMPEntry(F) || runtimeCallbacks.count(&F);
+      bool unknownCallers = hasUnknownCallers(F, closedModule);
+      if (isEntry || unknownCallers) taskRoots.push_back(&F);
+      if (!isEntry && (unknownCallers || F.getName() == "main"))
+        serialRoots.push_back(&F);
+    }
+
+    // functions called from task code run in tasks too
+    closeOverCalls(taskRoots, taskFunctions, false);
+
+    // functions called from serial code run outside tasks, except
+    // OpenMP entries which run in the implicit tasks of a region
+    closeOverCalls(serialRoots, serialFunctions, true);
+  }
+
+  /**
+   * Checks if function "F" may run both in tasks and in serial
+   * code, i.e. whether a serial version of it is worth having.
+   */
+  bool mayRunInBoth(const llvm::Function & F) {
+    return taskFunctions.count(&F) && serialFunctions.count(&F);
+  }
+
+  /**
+   * Checks if function "F" may execute in a task. Functions which
+   * do not are recorded for the report of skipped functions.
+   */
+  bool mayRunInTask(llvm::Function & F) {
+    if (taskFunctions.count(&F)) return true;
+    skippedFunctions.push_back(
+        tasksan::util::demangleName(F.getName()).str() );
+    return false;
+  }
+
+  /**
+   * Prints the functions of module "M" which were not instrumented.
+   */
+  void reportSkipped(llvm::Module & M) {
+    llvm::errs() << "TaskSanitizer: " << skippedFunctions.size()
+                 << " serial function(s) not instrumented in "
+                 << M.getModuleIdentifier() << "\n";
+    for (auto & name : skippedFunctions) {
+      llvm::errs() << "  " << name << "\n";
+    }
+  }
+} // end reach namespace
+
+} // end tasksan namespace
+
+#endif // end TaskReachability.h
@@ -48,6 +48,11 @@
 #include "instrumentor/pass/Util.h"
 #include "instrumentor/pass/IIRlogger.h"
 #include "instrumentor/pass/DebugInfoHelper.h"
+#include "instrumentor/pass/TaskReachability.h"
+#include "instrumentor/pass/TaskPrivates.h"
+#include "instrumentor/pass/ReadOnlyGlobals.h"
+#include "common/RuntimeState.h"
+#include "common/AccessBuffer.h"
 
 #define DEBUG_TYPE "tasksan"
 
@@ -67,9 +72,55 @@ static llvm::cl::opt<bool>  ClInstrumentAtomics(
 static llvm::cl::opt<bool>  ClInstrumentMemIntrinsics(
     "tasksan-instrument-memintrinsics", llvm::cl::init(true),
     llvm::cl::desc("Instrument memintrinsics (memset/memcpy/memmove)"), llvm::cl::Hidden);
+static llvm::cl::opt<bool>  ClInstrumentSerialCode(
+    "tasksan-instrument-serial-code", llvm::cl::init(false),
+    llvm::cl::desc("Instrument functions which never run in OpenMP tasks"),
+    llvm::cl::Hidden);
+static llvm::cl::opt<bool>  ClAssumeClosedModule(
+    "tasksan-closed-module", llvm::cl::init(false),
+    llvm::cl::desc("Assume externally visible functions are called only "
+                   "from the module being instrumented"), llvm::cl::Hidden);
+static llvm::cl::opt<bool>  ClCloneSerialCode(
+    "tasksan-clone-serial-code", llvm::cl::init(true),
+    llvm::cl::desc("Run uninstrumented clones of functions called outside "
+                   "OpenMP tasks"), llvm::cl::Hidden);
+static llvm::cl::opt<bool>  ClFastPathGuard(
+    "tasksan-fast-path-guard", llvm::cl::init(true),
+    llvm::cl::desc("Check the thread-local runtime state inline before "
+                   "calling access callbacks"), llvm::cl::Hidden);
+static llvm::cl::opt<bool>  ClBatchAccesses(
+    "tasksan-batch-accesses", llvm::cl::init(false),
+    llvm::cl::desc("Log accesses of each basic block into a thread-local "
+                   "buffer and check them with one runtime call"),
+    llvm::cl::Hidden);
+static llvm::cl::opt<bool>  ClCoalesceAccesses(
+    "tasksan-coalesce-accesses", llvm::cl::init(true),
+    llvm::cl::desc("Check adjacent accesses to fields and elements of a "
+                   "common base with one range callback"), llvm::cl::Hidden);
+static llvm::cl::opt<bool>  ClElideTaskPrivates(
+    "tasksan-elide-task-privates", llvm::cl::init(true),
+    llvm::cl::desc("Do not instrument accesses to task descriptors and to "
+                   "private and firstprivate task data"), llvm::cl::Hidden);
+static llvm::cl::opt<bool>  ClElideReadOnlyGlobals(
+    "tasksan-elide-read-only-globals", llvm::cl::init(true),
+    llvm::cl::desc("Do not instrument reads of globals never written "
+                   "from OpenMP tasks"), llvm::cl::Hidden);
+static llvm::cl::opt<bool>  ClReportSkipped(
+    "tasksan-report-skipped", llvm::cl::init(false),
+    llvm::cl::desc("Report functions not instrumented since they never "
+                   "run in OpenMP tasks and elided task-private accesses"),
+    llvm::cl::Hidden);
+
+static llvm::cl::opt<std::string>  ClSuppressions(
+    "tasksan-suppressions", llvm::cl::init(""),
+    llvm::cl::desc("Do not instrument accesses of functions, files and "
+                   "lines matching the rules of this suppression file"),
+    llvm::cl::Hidden);
 
 static const char *const kTsanModuleCtorName = "tasksan.module_ctor";
 static const char *const kTsanInitName = "__tasksan_init";
+static const char *const kTsanInTaskName = "__tasksan_in_task";
+static const char *const kTsanSerialSuffix = ".tasksan.serial";
 
 namespace {
 
@@ -91,6 +142,26 @@ struct TaskSanitizer : public llvm::FunctionPass {
 
     const llvm::DataLayout &DL = M.getDataLayout();
     IntptrTy = DL.getIntPtrType(M.getContext());
+    TsanCtorFunction = nullptr;
+    // the .iir file of the module's critical sections
+    tasksan::IIRlog::InitializeLogger(M);
+
+    std::string error;
+    if (!ClSuppressions.empty() && tasksan::util::suppressions.empty() &&
+        !tasksan::util::suppressions.load(ClSuppressions, error))
+      llvm::report_fatal_error(llvm::Twine("tasksan-suppressions: ") +
+                               error);
+
+    // find functions which may run in tasks; others are serial
+    tasksan::reach::analyzeModule(M, ClAssumeClosedModule);
+    // find pointers to data owned by single tasks
+    if (ClElideTaskPrivates)
+      tasksan::privates::analyzeModule(M);
+    // find globals which tasks only read
+    tasksan::rodata::analyzeModule(M, ClAssumeClosedModule);
+    SerialClones.clear();
+    if (ClCloneSerialCode)
+      createSerialClones(M);
 // HASSAN:
 //    std::tie(TsanCtorFunction, std::ignore)
 //        = createSanitizerCtorAndInitFunctions(
@@ -102,11 +173,26 @@ struct TaskSanitizer : public llvm::FunctionPass {
     return true;
   }
 
+  bool doFinalization(llvm::Module &M) override {
+    // write IIR of the module's critical sections once
+    tasksan::IIRlog::FinalizeLogger();
+    if (ClReportSkipped) {
+      tasksan::reach::reportSkipped(M);
+      tasksan::privates::reportElided(M);
+    }
+    insertSerialDispatch(M);
+    return insertRuntimeRegistration(M);
+  }
+
   bool runOnFunction(llvm::Function &F) override;
 
  private:
   void initializeCallbacks(llvm::Module &M);
   bool instrumentLoadOrStore(llvm::Instruction *I, const llvm::DataLayout &DL);
+  void coalesceAccesses(llvm::SmallVectorImpl<llvm::Instruction *> &Accesses,
+                        const llvm::DataLayout &DL);
+  bool instrumentAccessGroup(llvm::ArrayRef<llvm::Instruction *> Group,
+                             const llvm::DataLayout &DL);
   bool instrumentAtomic(llvm::Instruction *I, const llvm::DataLayout &DL);
   bool instrumentMemIntrinsic(llvm::Instruction *I);
   void chooseInstructionsToInstrument(llvm::SmallVectorImpl<llvm::Instruction *> &Local,
@@ -114,7 +200,17 @@ struct TaskSanitizer : public llvm::FunctionPass {
                                       const llvm::DataLayout &DL);
   bool addrPointsToConstantData(llvm::Value *Addr);
   int getMemoryAccessFuncIndex(llvm::Value *Addr, const llvm::DataLayout &DL);
+  bool instrumentRangeAccess(llvm::Instruction *I, const llvm::DataLayout &DL);
   void InsertRuntimeIgnores(llvm::Function &F);
+  bool insertRuntimeRegistration(llvm::Module &M);
+  void createSerialClones(llvm::Module &M);
+  void insertSerialDispatch(llvm::Module &M);
+  llvm::Instruction *insertFastPathGuard(llvm::Instruction *I);
+  bool instrumentBatches(llvm::Function &F,
+                         llvm::SmallVectorImpl<llvm::Instruction *> &Accesses,
+                         const llvm::DataLayout &DL);
+  void logAccess(llvm::Instruction *I, unsigned Slot,
+                 const llvm::DataLayout &DL);
 
   llvm::Type *IntptrTy;
   llvm::IntegerType *OrdTy;
@@ -122,12 +218,24 @@ struct TaskSanitizer : public llvm::FunctionPass {
   // register every new instrumented function
   llvm::Value *funcNamePtr = NULL;
 
-  // Data for registering IIR file name
-  llvm::Value *IIRfile;
-  std::string IIRfileURL;
+  // .iir file names of functions with critical sections, registered
+  // at runtime by the module constructor: (file name, function name).
+  // The name is the string passed to callbacks of the function, which
+  // tells it apart from functions of the same name in other modules.
+  std::vector<std::pair<std::string, llvm::Value *>> IIRfunctions;
+
+  // uninstrumented clones of functions which run both in tasks and
+  // in serial code: original function -> serial clone
+  std::map<llvm::Function *, llvm::Function *> SerialClones;
+  std::set<llvm::Function *> SerialCloneSet;
+
+  // groups of adjacent accesses checked with one range callback,
+  // each in program order
+  std::vector<llvm::SmallVector<llvm::Instruction *, 4>> AccessGroups;
 
   // Callbacks to run-time library are computed in doInitialization.
   llvm::Function *RegisterIIRfile;
+  llvm::Function *RegisterReadOnly;
   llvm::Function *TsanFuncEntry;
   llvm::Function *TsanFuncExit;
   llvm::Function *TsanIgnoreBegin;
@@ -155,6 +263,13 @@ struct TaskSanitizer : public llvm::FunctionPass {
   llvm::Function *TsanVptrLoad;
   llvm::Function *MemmoveFn, *MemcpyFn, *MemsetFn;
   llvm::Function *TsanCtorFunction;
+  llvm::GlobalVariable *TsanState;
+  llvm::GlobalVariable *TsanAccessBuffer;
+  llvm::StructType *AccessRecordTy;
+  llvm::ArrayType *AccessBufferTy;
+  llvm::Function *TsanFlushAccesses;
+  llvm::Function *TsanReadRange;
+  llvm::Function *TsanWriteRange;
 
 }; // end of TaskSanitizer
 } // end of namespace
@@ -169,14 +284,54 @@ static llvm::RegisterStandardPasses regPass(
    llvm::PassManagerBuilder::EP_EarlyAsPossible,
    registerTaskSanitizer);
 
+// Returns the 32-bit thread-local variable "Name" of the runtime.
+static llvm::GlobalVariable *getRuntimeTLS(llvm::Module &M,
+                                           llvm::StringRef Name) {
+  llvm::GlobalVariable *GV = M.getGlobalVariable(Name);
+  if (!GV) {
+    GV = new llvm::GlobalVariable(
+        M, llvm::Type::getInt32Ty(M.getContext()), false,
+        llvm::GlobalValue::ExternalLinkage, nullptr, Name, nullptr,
+        llvm::GlobalValue::InitialExecTLSModel);
+  }
+  return GV;
+}
+
 void TaskSanitizer::initializeCallbacks(llvm::Module &M) {
   llvm::IRBuilder<> IRB(M.getContext());
   llvm::AttributeList Attr;
   Attr = Attr.addAttribute(M.getContext(),
       llvm::AttributeList::FunctionIndex, llvm::Attribute::NoUnwind);
   // Initialize the callbacks.
+  TsanState = getRuntimeTLS(M, tasksan::getStateWordName());
+
+  // access buffer for batched logging, see common/AccessBuffer.h
+  AccessRecordTy = llvm::StructType::get(
+      IRB.getInt8PtrTy(), IRB.getInt64Ty(), IRB.getInt32Ty(), IRB.getInt32Ty());
+  AccessBufferTy =
+      llvm::ArrayType::get(AccessRecordTy, tasksan::ACCESS_BUFFER_SIZE);
+  TsanAccessBuffer = M.getGlobalVariable(tasksan::getAccessBufferName());
+  if (!TsanAccessBuffer) {
+    TsanAccessBuffer = new llvm::GlobalVariable(
+        M, AccessBufferTy, false, llvm::GlobalValue::ExternalLinkage,
+        nullptr, tasksan::getAccessBufferName(), nullptr,
+        llvm::GlobalValue::InitialExecTLSModel);
+  }
+  TsanFlushAccesses = checkSanitizerInterfaceFunction(M.getOrInsertFunction(
+      "__tasksan_flush_accesses", Attr, IRB.getVoidTy(), IRB.getInt32Ty(),
+      IRB.getInt8PtrTy()));
+  TsanReadRange = checkSanitizerInterfaceFunction(M.getOrInsertFunction(
+      "__tasksan_read_range", Attr, IRB.getVoidTy(), IRB.getInt8PtrTy(),
+      IntptrTy, IRB.getInt32Ty(), IRB.getInt32Ty(), IRB.getInt8PtrTy()));
+  TsanWriteRange = checkSanitizerInterfaceFunction(M.getOrInsertFunction(
+      "__tasksan_write_range", Attr, IRB.getVoidTy(), IRB.getInt8PtrTy(),
+      IntptrTy, IRB.getInt32Ty(), IRB.getInt32Ty(), IRB.getInt8PtrTy()));
   RegisterIIRfile = checkSanitizerInterfaceFunction(M.getOrInsertFunction(
-      "__tasksan_register_iir_file", Attr, IRB.getVoidTy(), IRB.getInt8PtrTy()));
+      "__tasksan_register_iir_file", Attr, IRB.getVoidTy(), IRB.getInt8PtrTy(),
+      IRB.getInt8PtrTy()));
+  RegisterReadOnly = checkSanitizerInterfaceFunction(M.getOrInsertFunction(
+      "__tasksan_register_read_only", Attr, IRB.getVoidTy(),
+      IRB.getInt8PtrTy(), IntptrTy));
 
   TsanFuncEntry = checkSanitizerInterfaceFunction(M.getOrInsertFunction(
       "__tasksan_func_entry", Attr, IRB.getVoidTy(), IRB.getInt8PtrTy()));
@@ -232,11 +387,13 @@ void TaskSanitizer::initializeCallbacks(llvm::Module &M) {
     llvm::Type *PtrTy = Ty->getPointerTo();
     llvm::SmallString<32> AtomicLoadName("__tasksan_atomic" + BitSizeStr + "_load");
     TsanAtomicLoad[i] = checkSanitizerInterfaceFunction(
-        M.getOrInsertFunction(AtomicLoadName, Attr, Ty, PtrTy, OrdTy));
+        M.getOrInsertFunction(AtomicLoadName, Attr, Ty, PtrTy, OrdTy,
+                              IRB.getInt32Ty(), IRB.getInt8PtrTy()));
 
     llvm::SmallString<32> AtomicStoreName("__tasksan_atomic" + BitSizeStr + "_store");
     TsanAtomicStore[i] = checkSanitizerInterfaceFunction(M.getOrInsertFunction(
-        AtomicStoreName, Attr, IRB.getVoidTy(), PtrTy, Ty, OrdTy));
+        AtomicStoreName, Attr, IRB.getVoidTy(), PtrTy, Ty, OrdTy,
+        IRB.getInt32Ty(), IRB.getInt8PtrTy()));
 
     for (int op = llvm::AtomicRMWInst::FIRST_BINOP;
         op <= llvm::AtomicRMWInst::LAST_BINOP; ++op) {
@@ -260,13 +417,15 @@ void TaskSanitizer::initializeCallbacks(llvm::Module &M) {
         continue;
       llvm::SmallString<32> RMWName("__tasksan_atomic" + llvm::itostr(BitSize) + NamePart);
       TsanAtomicRMW[op][i] = checkSanitizerInterfaceFunction(
-          M.getOrInsertFunction(RMWName, Attr, Ty, PtrTy, Ty, OrdTy));
+          M.getOrInsertFunction(RMWName, Attr, Ty, PtrTy, Ty, OrdTy,
+                                IRB.getInt32Ty(), IRB.getInt8PtrTy()));
     }
 
     llvm::SmallString<32> AtomicCASName("__tasksan_atomic" + BitSizeStr +
                                   "_compare_exchange_val");
     TsanAtomicCAS[i] = checkSanitizerInterfaceFunction(M.getOrInsertFunction(
-        AtomicCASName, Attr, Ty, PtrTy, Ty, Ty, OrdTy, OrdTy));
+        AtomicCASName, Attr, Ty, PtrTy, Ty, Ty, OrdTy, OrdTy,
+        IRB.getInt32Ty(), IRB.getInt8PtrTy()));
   }
   TsanVptrUpdate = checkSanitizerInterfaceFunction(
       M.getOrInsertFunction("__tasksan_vptr_update", Attr, IRB.getVoidTy(),
@@ -289,6 +448,17 @@ void TaskSanitizer::initializeCallbacks(llvm::Module &M) {
                             IRB.getInt32Ty(), IntptrTy));
 }
 
+// Checks if the suppressions cover the line of access "I" in function
+// "FuncName"
+static bool isSuppressedAccess(llvm::Instruction *I,
+                               llvm::StringRef FuncName) {
+  if (tasksan::util::suppressions.empty())
+    return false;
+  unsigned Line = tasksan::debug::getLineNo(I);
+  return Line && tasksan::util::suppressions.suppressesLine(
+      FuncName.str(), tasksan::debug::getFilename(I), Line);
+}
+
 static bool isVtableAccess(llvm::Instruction *I) {
   if (llvm::MDNode *Tag = I->getMetadata(llvm::LLVMContext::MD_tbaa))
     return Tag->isTBAAVtableAccess();
@@ -330,6 +500,11 @@ static bool shouldInstrumentReadWriteFromAddress(const llvm::Module *M,
 }
 
 bool TaskSanitizer::addrPointsToConstantData(llvm::Value *Addr) {
+  if (ClElideReadOnlyGlobals && tasksan::rodata::isReadOnly(Addr)) {
+    // Reads from globals which no task writes can not race either.
+    return true;
+  }
+
   // If this is a GEP, just analyze its pointer operand.
   if (llvm::GetElementPtrInst *GEP = llvm::dyn_cast<llvm::GetElementPtrInst>(Addr))
     Addr = GEP->getPointerOperand();
@@ -352,6 +527,9 @@ bool TaskSanitizer::addrPointsToConstantData(llvm::Value *Addr) {
 // Currently handled:
 //  - read-before-write (within same BB, no calls between)
 //  - not captured variables
+//  - task descriptors and private/firstprivate task data
+// Adjacent accesses to a common base are then grouped into range checks
+// (see coalesceAccesses).
 //
 // We do not handle some of the patterns that should not survive
 // after the classic compiler optimizations.
@@ -364,6 +542,7 @@ void TaskSanitizer::chooseInstructionsToInstrument(
     llvm::SmallVectorImpl<llvm::Instruction *> &Local, llvm::SmallVectorImpl<llvm::Instruction *> &All,
     const llvm::DataLayout &DL) {
   llvm::SmallSet<llvm::Value*, 8> WriteTargets;
+  llvm::SmallVector<llvm::Instruction *, 8> Chosen;
   // Iterate from the end.
   for (llvm::Instruction *I : reverse(Local)) {
     if (llvm::StoreInst *Store = llvm::dyn_cast<llvm::StoreInst>(I)) {
@@ -395,9 +574,180 @@ void TaskSanitizer::chooseInstructionsToInstrument(
       // (see llvm/Analysis/CaptureTracking.h for details).
       continue;
     }
-    All.push_back(I);
+    if (ClElideTaskPrivates && tasksan::privates::isTaskLocal(I, Addr)) {
+      // The data belongs to a single task and its address does not
+      // escape, so no other task can access it.
+      continue;
+    }
+    Chosen.push_back(I);
   }
   Local.clear();
+
+  // batches already amortize callbacks over a block
+  if (ClCoalesceAccesses && !ClBatchAccesses)
+    coalesceAccesses(Chosen, DL);
+  All.append(Chosen.begin(), Chosen.end());
+}
+
+// Checks if an access to "Addr" is not a single scalar of 1, 2, 4 or 8
+// bytes, e.g. a vector or a 16-byte or odd-sized value. The runtime
+// checks such accesses as ranges of elements.
+static bool isRangeAccess(llvm::Value *Addr, const llvm::DataLayout &DL) {
+  llvm::Type *OrigTy =
+      llvm::cast<llvm::PointerType>(Addr->getType())->getElementType();
+  uint64_t Size = DL.getTypeStoreSize(OrigTy);
+  return OrigTy->isVectorTy() ||
+         (Size != 1 && Size != 2 && Size != 4 && Size != 8);
+}
+
+// Returns the size of the elements a range access to a value of type
+// "Ty" is checked as: vector elements if they are whole bytes, else the
+// largest of 8, 4, 2 and 1 bytes which divides the size of the value.
+static uint64_t getRangeElementSize(llvm::Type *Ty,
+                                    const llvm::DataLayout &DL) {
+  uint64_t Size = DL.getTypeStoreSize(Ty);
+  if (llvm::VectorType *VTy = llvm::dyn_cast<llvm::VectorType>(Ty)) {
+    uint64_t ElemSize = DL.getTypeStoreSize(VTy->getElementType());
+    if (ElemSize <= 8 && llvm::isPowerOf2_64(ElemSize) &&
+        ElemSize * VTy->getNumElements() == Size)
+      return ElemSize;
+  }
+  uint64_t ElemSize = 8;
+  while (Size % ElemSize)
+    ElemSize /= 2;
+  return ElemSize;
+}
+
+// Finds the base of the address of access "I" and its constant offset.
+// In unoptimized code each access reloads a pointer from its stack slot,
+// so pointers loaded from the same uncaptured slot share a base. Returns
+// the base and whether it is such a slot.
+static std::pair<llvm::Value *, bool> getAccessBase(llvm::Instruction *I,
+                                                    int64_t &Offset,
+                                                    const llvm::DataLayout &DL) {
+  llvm::Value *Addr = llvm::isa<llvm::StoreInst>(*I)
+      ? llvm::cast<llvm::StoreInst>(I)->getPointerOperand()
+      : llvm::cast<llvm::LoadInst>(I)->getPointerOperand();
+  Offset = 0;
+  llvm::Value *Base = llvm::GetPointerBaseWithConstantOffset(Addr, Offset, DL);
+  if (llvm::LoadInst *L = llvm::dyn_cast<llvm::LoadInst>(Base)) {
+    llvm::Value *Slot = L->getPointerOperand();
+    if (!L->isVolatile() && llvm::isa<llvm::AllocaInst>(Slot) &&
+        !PointerMayBeCaptured(Slot, true, true))
+      return std::make_pair(Slot, true);
+  }
+  return std::make_pair(Base, false);
+}
+
+// Checks if the stack slot "Slot" is written between accesses "First"
+// and "Last" of a basic block, which would change the pointer loaded.
+static bool isSlotWrittenBetween(llvm::Value *Slot, llvm::Instruction *First,
+                                 llvm::Instruction *Last) {
+  for (llvm::Instruction *I = First; I && I != Last; I = I->getNextNode()) {
+    llvm::StoreInst *Store = llvm::dyn_cast<llvm::StoreInst>(I);
+    if (Store && Store->getPointerOperand() == Slot)
+      return true;
+  }
+  return false;
+}
+
+// Groups accesses of a segment without calls which read or write
+// consecutive elements of the same size from a common base on the same
+// source line, e.g. fields of a struct or a[i] and a[i + 1]. Each group
+// is checked with a single range callback and removed from "Accesses".
+// Stored floating-point values are converted by their own callbacks, so
+// such writes are not grouped.
+void TaskSanitizer::coalesceAccesses(
+    llvm::SmallVectorImpl<llvm::Instruction *> &Accesses,
+    const llvm::DataLayout &DL) {
+  struct Candidate {
+    int64_t Offset;
+    llvm::Instruction *I;
+    bool operator<(const Candidate &Other) const {
+      return Offset < Other.Offset;
+    }
+  };
+  // (base, loaded from slot, is write, element size, line) -> accesses,
+  // in the order of the first access of each group, so that the groups
+  // and the code emitted for them do not depend on pointer values
+  typedef std::tuple<llvm::Value *, bool, bool, uint64_t, unsigned> GroupKey;
+  llvm::MapVector<GroupKey, llvm::SmallVector<Candidate, 4>,
+                  std::map<GroupKey, unsigned>> Candidates;
+
+  for (auto I : Accesses) {
+    bool IsWrite = llvm::isa<llvm::StoreInst>(*I);
+    llvm::Value *Addr = IsWrite
+        ? llvm::cast<llvm::StoreInst>(I)->getPointerOperand()
+        : llvm::cast<llvm::LoadInst>(I)->getPointerOperand();
+    if (isVtableAccess(I) || Addr->isSwiftError() ||
+        isRangeAccess(Addr, DL))
+      continue;
+    llvm::Type *OrigTy =
+        llvm::cast<llvm::PointerType>(Addr->getType())->getElementType();
+    if (IsWrite && !OrigTy->isIntegerTy() && !OrigTy->isPointerTy())
+      continue;
+    uint64_t Size = DL.getTypeStoreSize(OrigTy);
+    if (Size != DL.getTypeAllocSize(OrigTy))
+      continue;
+
+    int64_t Offset;
+    std::pair<llvm::Value *, bool> Base = getAccessBase(I, Offset, DL);
+    GroupKey Key(Base.first, Base.second, IsWrite, Size,
+                 tasksan::debug::getLineNo(I));
+    Candidates[Key].push_back({Offset, I});
+  }
+
+  llvm::SmallPtrSet<llvm::Instruction *, 8> Grouped;
+  for (auto &Entry : Candidates) {
+    llvm::SmallVector<Candidate, 4> &Members = Entry.second;
+    if (Members.size() < 2)
+      continue;
+    bool IsWrite = std::get<2>(Entry.first);
+    int64_t Size = std::get<3>(Entry.first);
+    std::stable_sort(Members.begin(), Members.end());
+
+    // split the sorted accesses into runs of consecutive elements
+    size_t Begin = 0;
+    while (Begin < Members.size()) {
+      size_t End = Begin + 1;
+      while (End < Members.size()) {
+        int64_t Gap = Members[End].Offset - Members[End - 1].Offset;
+        // reads of one element twice are checked once; the values of
+        // repeated writes differ, so those end a run
+        if (Gap != Size && (Gap != 0 || IsWrite))
+          break;
+        End++;
+      }
+      if (Members[End - 1].Offset > Members[Begin].Offset) {
+        llvm::SmallVector<llvm::Instruction *, 4> Group;
+        for (size_t i = Begin; i < End; i++)
+          Group.push_back(Members[i].I);
+        // program order: accesses of a segment are in one block
+        llvm::BasicBlock *BB = Group.front()->getParent();
+        llvm::SmallVector<llvm::Instruction *, 4> Ordered;
+        for (auto &Inst : *BB)
+          if (std::find(Group.begin(), Group.end(), &Inst) != Group.end())
+            Ordered.push_back(&Inst);
+
+        bool FromSlot = std::get<1>(Entry.first);
+        if (!FromSlot || !isSlotWrittenBetween(std::get<0>(Entry.first),
+                                               Ordered.front(),
+                                               Ordered.back())) {
+          Grouped.insert(Ordered.begin(), Ordered.end());
+          AccessGroups.push_back(Ordered);
+        }
+      }
+      Begin = End;
+    }
+  }
+
+  if (Grouped.empty())
+    return;
+  Accesses.erase(std::remove_if(Accesses.begin(), Accesses.end(),
+                                [&](llvm::Instruction *I) {
+                                  return Grouped.count(I) != 0;
+                                }),
+                 Accesses.end());
 }
 
 static bool isAtomic(llvm::Instruction *I) {
@@ -424,29 +774,165 @@ void TaskSanitizer::InsertRuntimeIgnores(llvm::Function &F) {
   }
 }
 
+// Every module registers the .iir files of its own critical sections
+// through a module constructor, so that critical sections of all
+// translation units are known to the runtime, not only those of main's.
+// The constructor also registers the address ranges of globals whose
+// reads were not instrumented since no task writes them.
+bool TaskSanitizer::insertRuntimeRegistration(llvm::Module &M) {
+  std::set<const llvm::GlobalVariable *> &ReadOnly =
+      tasksan::rodata::elidedGlobals;
+  if (IIRfunctions.empty() && ReadOnly.empty())
+    return false;
+
+  llvm::LLVMContext &Ctx = M.getContext();
+  const llvm::DataLayout &DL = M.getDataLayout();
+  TsanCtorFunction = llvm::Function::Create(
+      llvm::FunctionType::get(llvm::Type::getVoidTy(Ctx), false),
+      llvm::GlobalValue::InternalLinkage, kTsanModuleCtorName, &M);
+  llvm::BasicBlock *CtorBB =
+      llvm::BasicBlock::Create(Ctx, "", TsanCtorFunction);
+  llvm::IRBuilder<> IRB(llvm::ReturnInst::Create(Ctx, CtorBB));
+
+  for (auto &IIRfunction : IIRfunctions) {
+    llvm::Value *IIRfile =
+        IRB.CreateGlobalStringPtr(IIRfunction.first, "iirFileLoc");
+    IRB.CreateCall(RegisterIIRfile,
+                   {IRB.CreatePointerCast(IIRfile, IRB.getInt8PtrTy()),
+                    IRB.CreatePointerCast(IIRfunction.second,
+                                          IRB.getInt8PtrTy())});
+  }
+  IIRfunctions.clear();
+
+  for (auto GV : ReadOnly) {
+    llvm::Value *Start = const_cast<llvm::GlobalVariable *>(GV);
+    uint64_t Size = DL.getTypeAllocSize(GV->getValueType());
+    IRB.CreateCall(RegisterReadOnly,
+                   {IRB.CreatePointerCast(Start, IRB.getInt8PtrTy()),
+                    llvm::ConstantInt::get(IntptrTy, Size)});
+  }
+  ReadOnly.clear();
+
+  llvm::appendToGlobalCtors(M, TsanCtorFunction, 0);
+  return true;
+}
+
+// Functions which run both in tasks and in serial code get an
+// uninstrumented clone. The clones are created before instrumentation
+// and are called from the entry of the instrumented functions when
+// the thread is not in a task (see insertSerialDispatch).
+void TaskSanitizer::createSerialClones(llvm::Module &M) {
+  SerialCloneSet.clear();
+  std::vector<llvm::Function *> Candidates;
+  for (auto &F : M) {
+    if (F.isDeclaration() || F.isVarArg() ||
+        F.hasFnAttribute(llvm::Attribute::Naked) ||
+        tasksan::util::isMainFunction(F))
+      continue;
+    if (tasksan::reach::mayRunInBoth(F))
+      Candidates.push_back(&F);
+  }
+
+  for (auto F : Candidates) {
+    llvm::ValueToValueMapTy VMap;
+    llvm::Function *Clone = llvm::CloneFunction(F, VMap);
+    Clone->setName(F->getName() + kTsanSerialSuffix);
+    Clone->setLinkage(llvm::GlobalValue::InternalLinkage);
+    Clone->setComdat(nullptr);
+    SerialClones[F] = Clone;
+    SerialCloneSet.insert(Clone);
+  }
+}
+
+// Inserts a check of the thread-local "in task" flag, maintained by
+// the runtime, at the entry of each function with a serial clone.
+// Outside tasks the function tail-calls its uninstrumented clone.
+void TaskSanitizer::insertSerialDispatch(llvm::Module &M) {
+  if (SerialClones.empty())
+    return;
+
+  llvm::LLVMContext &Ctx = M.getContext();
+  llvm::Type *FlagTy = llvm::Type::getInt32Ty(Ctx);
+  llvm::GlobalVariable *InTask = getRuntimeTLS(M, kTsanInTaskName);
+
+  for (auto &Clone : SerialClones) {
+    llvm::Function *F = Clone.first;
+    llvm::BasicBlock *OldEntry = &F->getEntryBlock();
+    llvm::BasicBlock *Dispatch =
+        llvm::BasicBlock::Create(Ctx, "tasksan.dispatch", F, OldEntry);
+    llvm::BasicBlock *Serial =
+        llvm::BasicBlock::Create(Ctx, "tasksan.serial", F, OldEntry);
+
+    llvm::IRBuilder<> IRB(Dispatch);
+    if (llvm::DISubprogram *SP = F->getSubprogram())
+      IRB.SetCurrentDebugLocation(
+          llvm::DILocation::get(Ctx, SP->getLine(), 0, SP));
+    llvm::Value *Flag = IRB.CreateLoad(FlagTy, InTask, "tasksan.in_task");
+    llvm::Value *IsSerial =
+        IRB.CreateICmpEQ(Flag, llvm::ConstantInt::get(FlagTy, 0));
+    llvm::BranchInst *Branch = IRB.CreateCondBr(IsSerial, Serial, OldEntry);
+
+    // keep static allocas in the entry block
+    for (auto I = OldEntry->begin(); I != OldEntry->end();) {
+      llvm::Instruction *Inst = &*I++;
+      auto *AI = llvm::dyn_cast<llvm::AllocaInst>(Inst);
+      if (AI && llvm::isa<llvm::Constant>(AI->getArraySize()))
+        AI->moveBefore(Branch);
+    }
+
+    IRB.SetInsertPoint(Serial);
+    llvm::SmallVector<llvm::Value *, 8> Args;
+    bool HasByVal = false;
+    for (auto &Arg : F->args()) {
+      Args.push_back(&Arg);
+      HasByVal |= Arg.hasByValAttr();
+    }
+    llvm::CallInst *Call = IRB.CreateCall(Clone.second, Args);
+    Call->setCallingConv(F->getCallingConv());
+    Call->setAttributes(F->getAttributes());
+    Call->setTailCall(!HasByVal);
+    if (F->getReturnType()->isVoidTy())
+      IRB.CreateRetVoid();
+    else
+      IRB.CreateRet(Call);
+  }
+}
+
 bool TaskSanitizer::runOnFunction(llvm::Function &F) {
   // This is required to prevent instrumenting call to
   // __tasksan_init from within the module constructor.
   if (&F == TsanCtorFunction)
     return false;
 
-  bool Res = false;
+  // serial clones run outside tasks and stay uninstrumented
+  if (SerialCloneSet.count(&F))
+    return false;
 
-  tasksan::IIRlog::logTaskBody(F, tasksan::util::getPlainFuncName(F));
+  bool Res = false;
 
   // Register function name
   llvm::StringRef funcName = tasksan::util::demangleName(F.getName());
+  std::string IIRfileName = tasksan::IIRlog::logTaskBody(F, funcName);
   llvm::IRBuilder<> IRB(F.getEntryBlock().getFirstNonPHI());
   funcNamePtr = IRB.CreateGlobalStringPtr(funcName, "functionName");
+  if ( !IIRfileName.empty() ) {
+    IIRfunctions.push_back( std::make_pair(IIRfileName, funcNamePtr) );
+  }
 
   initializeCallbacks(*F.getParent());
   llvm::SmallVector<llvm::Instruction*, 8> AllLoadsAndStores;
   llvm::SmallVector<llvm::Instruction*, 8> LocalLoadsAndStores;
   llvm::SmallVector<llvm::Instruction*, 8> AtomicAccesses;
   llvm::SmallVector<llvm::Instruction*, 8> MemIntrinCalls;
+  AccessGroups.clear();
 
   bool HasCalls = false;
-  bool SanitizeFunction = true; //HASSAN F.hasFnAttribute(Attribute::SanitizeThread);
+  // accesses of serial functions are never in a task, and those of
+  // suppressed functions are never checked
+  bool Suppressed = tasksan::util::DontInstrument(
+      F.getName(), tasksan::debug::getFilename(F));
+  bool SanitizeFunction = (ClInstrumentSerialCode ||
+                           tasksan::reach::mayRunInTask(F)) && !Suppressed;
   const llvm::DataLayout &DL = F.getParent()->getDataLayout();
   const llvm::TargetLibraryInfo *TLI =
       &getAnalysis<llvm::TargetLibraryInfoWrapperPass>().getTLI();
@@ -454,14 +940,17 @@ bool TaskSanitizer::runOnFunction(llvm::Function &F) {
   // Traverse all instructions, collect loads/stores/returns, check for calls.
   for (auto &BB : F) {
     for (auto &Inst : BB) {
-      if (isAtomic(&Inst))
-        AtomicAccesses.push_back(&Inst);
-      else if (llvm::isa<llvm::LoadInst>(Inst) || llvm::isa<llvm::StoreInst>(Inst))
-        LocalLoadsAndStores.push_back(&Inst);
-      else if (llvm::isa<llvm::CallInst>(Inst) || llvm::isa<llvm::InvokeInst>(Inst)) {
+      if (isAtomic(&Inst)) {
+        if (!isSuppressedAccess(&Inst, funcName))
+          AtomicAccesses.push_back(&Inst);
+      } else if (llvm::isa<llvm::LoadInst>(Inst) || llvm::isa<llvm::StoreInst>(Inst)) {
+        if (!isSuppressedAccess(&Inst, funcName))
+          LocalLoadsAndStores.push_back(&Inst);
+      } else if (llvm::isa<llvm::CallInst>(Inst) || llvm::isa<llvm::InvokeInst>(Inst)) {
         if (llvm::CallInst *CI = llvm::dyn_cast<llvm::CallInst>(&Inst))
           maybeMarkSanitizerLibraryCallNoBuiltin(CI, TLI);
-        if (llvm::isa<llvm::MemIntrinsic>(Inst))
+        if (llvm::isa<llvm::MemIntrinsic>(Inst) &&
+            !isSuppressedAccess(&Inst, funcName))
           MemIntrinCalls.push_back(&Inst);
         HasCalls = true;
         chooseInstructionsToInstrument(LocalLoadsAndStores, AllLoadsAndStores,
@@ -476,14 +965,21 @@ bool TaskSanitizer::runOnFunction(llvm::Function &F) {
   // (e.g. variables that do not escape, etc).
 
   // Instrument memory accesses only if we want to report bugs in the function.
-  if (ClInstrumentMemoryAccesses && SanitizeFunction)
-    for (auto Inst : AllLoadsAndStores) {
-      Res |= instrumentLoadOrStore(Inst, DL);
+  if (ClInstrumentMemoryAccesses && SanitizeFunction) {
+    if (ClBatchAccesses)
+      Res |= instrumentBatches(F, AllLoadsAndStores, DL);
+    else
+      for (auto Inst : AllLoadsAndStores) {
+        Res |= instrumentLoadOrStore(Inst, DL);
+      }
+    for (auto &Group : AccessGroups) {
+      Res |= instrumentAccessGroup(Group, DL);
     }
+  }
 
   // Instrument atomic memory accesses in any case (they can be used to
   // implement synchronization).
-  if (ClInstrumentAtomics)
+  if (ClInstrumentAtomics && !Suppressed)
     for (auto Inst : AtomicAccesses) {
       Res |= instrumentAtomic(Inst, DL);
     }
@@ -499,17 +995,6 @@ bool TaskSanitizer::runOnFunction(llvm::Function &F) {
       InsertRuntimeIgnores(F);
   }
 
-  // save full path name of .iir log file
-  if ( tasksan::util::isMainFunction(F) ) {
-    std::string fileName = tasksan::debug::getFilename(F);
-    IIRfileURL = std::string(fileName + ".iir");
-
-    llvm::IRBuilder<> IRB(F.getEntryBlock().getFirstNonPHI());
-    IIRfile = IRB.CreateGlobalStringPtr(IIRfileURL, "iirFileLoc");
-    IRB.CreateCall(RegisterIIRfile,
-                   IRB.CreatePointerCast(IIRfile, IRB.getInt8PtrTy()));
-  }
-
   // Instrument function entry/exit points if there were instrumented accesses.
   if ((Res || HasCalls) && ClInstrumentFuncEntryExit) {
     llvm::IRBuilder<> IRB(F.getEntryBlock().getFirstNonPHI());
@@ -541,6 +1026,10 @@ bool TaskSanitizer::instrumentLoadOrStore(llvm::Instruction *I,
   if (Addr->isSwiftError())
     return false;
 
+  // vectors and unusual sizes are checked element by element
+  if (isRangeAccess(Addr, DL))
+    return instrumentRangeAccess(I, DL);
+
   int Idx = getMemoryAccessFuncIndex(Addr, DL);
   if (Idx < 0)
     return false;
@@ -577,6 +1066,10 @@ bool TaskSanitizer::instrumentLoadOrStore(llvm::Instruction *I,
   else
     OnAccessFunc = IsWrite ? TsanUnalignedWrite[Idx] : TsanUnalignedRead[Idx];
 
+  // call the runtime only if the thread checks accesses
+  if (ClFastPathGuard)
+    IRB.SetInsertPoint(insertFastPathGuard(I));
+
   if (IsWrite) {
       llvm::Value *Val = llvm::cast<llvm::StoreInst>(I)->getValueOperand();
       if ( Val->getType()->isFloatTy() )
@@ -602,6 +1095,193 @@ bool TaskSanitizer::instrumentLoadOrStore(llvm::Instruction *I,
   return true;
 }
 
+// Checks a vector or unusually sized access with a range callback. A
+// read is checked before it. A write is checked after it, since the
+// runtime loads the values of the elements from memory.
+bool TaskSanitizer::instrumentRangeAccess(llvm::Instruction *I,
+                                          const llvm::DataLayout &DL) {
+  bool IsWrite = llvm::isa<llvm::StoreInst>(*I);
+  llvm::Value *Addr = IsWrite
+      ? llvm::cast<llvm::StoreInst>(I)->getPointerOperand()
+      : llvm::cast<llvm::LoadInst>(I)->getPointerOperand();
+  llvm::Type *OrigTy =
+      llvm::cast<llvm::PointerType>(Addr->getType())->getElementType();
+  uint64_t Size = DL.getTypeStoreSize(OrigTy);
+  if (Size == 0)
+    return false;
+
+  llvm::Instruction *At = IsWrite ? I->getNextNode() : I;
+  if (ClFastPathGuard)
+    At = insertFastPathGuard(At);
+  llvm::IRBuilder<> IRB(At);
+  IRB.SetCurrentDebugLocation(I->getDebugLoc());
+  IRB.CreateCall(IsWrite ? TsanWriteRange : TsanReadRange,
+                 {IRB.CreatePointerCast(Addr, IRB.getInt8PtrTy()),
+                  llvm::ConstantInt::get(IntptrTy, Size),
+                  IRB.getInt32(getRangeElementSize(OrigTy, DL)),
+                  tasksan::debug::getLineNumber(I),
+                  IRB.CreatePointerCast(funcNamePtr, IRB.getInt8PtrTy())});
+  return true;
+}
+
+// Checks a group of adjacent accesses (see coalesceAccesses) with one
+// range callback. Reads are checked before the first read of the group.
+// Writes are checked after the last write, where the runtime loads the
+// values written from memory.
+bool TaskSanitizer::instrumentAccessGroup(
+    llvm::ArrayRef<llvm::Instruction *> Group, const llvm::DataLayout &DL) {
+  bool IsWrite = llvm::isa<llvm::StoreInst>(*Group.front());
+  int64_t Lowest = 0, Highest = 0;
+  for (auto I : Group) {
+    int64_t Offset;
+    getAccessBase(I, Offset, DL);
+    Lowest = (I == Group.front()) ? Offset : std::min(Lowest, Offset);
+    Highest = (I == Group.front()) ? Offset : std::max(Highest, Offset);
+  }
+
+  // the lowest address is computed from the address of the access
+  // next to the callback, which is available there
+  llvm::Instruction *Ref = IsWrite ? Group.back() : Group.front();
+  llvm::Instruction *At = IsWrite ? Ref->getNextNode() : Ref;
+  int64_t RefOffset;
+  getAccessBase(Ref, RefOffset, DL);
+  llvm::Value *Addr = IsWrite
+      ? llvm::cast<llvm::StoreInst>(Ref)->getPointerOperand()
+      : llvm::cast<llvm::LoadInst>(Ref)->getPointerOperand();
+  uint64_t ElemSize = DL.getTypeStoreSize(
+      llvm::cast<llvm::PointerType>(Addr->getType())->getElementType());
+
+  if (ClFastPathGuard)
+    At = insertFastPathGuard(At);
+  llvm::IRBuilder<> IRB(At);
+  IRB.SetCurrentDebugLocation(Ref->getDebugLoc());
+  Addr = IRB.CreatePointerCast(Addr, IRB.getInt8PtrTy());
+  if (Lowest != RefOffset)
+    Addr = IRB.CreateGEP(IRB.getInt8Ty(), Addr,
+                         IRB.getInt64(Lowest - RefOffset));
+  IRB.CreateCall(IsWrite ? TsanWriteRange : TsanReadRange,
+                 {Addr,
+                  llvm::ConstantInt::get(IntptrTy,
+                                         Highest - Lowest + ElemSize),
+                  IRB.getInt32(ElemSize),
+                  tasksan::debug::getLineNumber(Group.front()),
+                  IRB.CreatePointerCast(funcNamePtr, IRB.getInt8PtrTy())});
+  return true;
+}
+
+// Converts a stored value to the 64-bit value of an access record.
+// Floating-point values keep their bits, like by __tasksan_write_float.
+static llvm::Value *castToInt64(llvm::IRBuilder<> &IRB, llvm::Value *Val,
+                                const llvm::DataLayout &DL) {
+  llvm::Type *Ty = Val->getType();
+  if (Ty->isPointerTy())
+    return IRB.CreatePtrToInt(Val, IRB.getInt64Ty());
+  if (Ty->isFloatingPointTy() ||
+      (Ty->isVectorTy() && !Ty->getScalarType()->isPointerTy()))
+    Val = IRB.CreateBitCast(Val, IRB.getIntNTy(DL.getTypeSizeInBits(Ty)));
+  if (!Val->getType()->isIntegerTy())
+    return IRB.getInt64(0);
+  return IRB.CreateZExtOrTrunc(Val, IRB.getInt64Ty());
+}
+
+// Stores the record of access "I" into slot "Slot" of the
+// thread-local access buffer, right before the access.
+void TaskSanitizer::logAccess(llvm::Instruction *I, unsigned Slot,
+                              const llvm::DataLayout &DL) {
+  llvm::IRBuilder<> IRB(I);
+  bool IsWrite = llvm::isa<llvm::StoreInst>(*I);
+  llvm::Value *Addr = IsWrite
+      ? llvm::cast<llvm::StoreInst>(I)->getPointerOperand()
+      : llvm::cast<llvm::LoadInst>(I)->getPointerOperand();
+  llvm::Type *OrigTy = llvm::cast<llvm::PointerType>(Addr->getType())->getElementType();
+  uint32_t Kind = DL.getTypeStoreSize(OrigTy);
+  if (IsWrite)
+    Kind |= tasksan::ACCESS_WRITE;
+  llvm::Value *Val = IsWrite
+      ? castToInt64(IRB, llvm::cast<llvm::StoreInst>(I)->getValueOperand(), DL)
+      : IRB.getInt64(0);
+
+  llvm::Value *Record =
+      IRB.CreateConstInBoundsGEP2_32(AccessBufferTy, TsanAccessBuffer, 0, Slot);
+  IRB.CreateStore(IRB.CreatePointerCast(Addr, IRB.getInt8PtrTy()),
+                  IRB.CreateStructGEP(AccessRecordTy, Record, 0));
+  IRB.CreateStore(Val, IRB.CreateStructGEP(AccessRecordTy, Record, 1));
+  IRB.CreateStore(tasksan::debug::getLineNumber(I),
+                  IRB.CreateStructGEP(AccessRecordTy, Record, 2));
+  IRB.CreateStore(IRB.getInt32(Kind),
+                  IRB.CreateStructGEP(AccessRecordTy, Record, 3));
+}
+
+// Logs the accesses of each basic block into the thread-local access
+// buffer with inline stores. A single __tasksan_flush_accesses call
+// checks them at the end of the block, before calls and atomics, or
+// when the buffer is full. Vtable accesses keep their callbacks.
+bool TaskSanitizer::instrumentBatches(
+    llvm::Function &F, llvm::SmallVectorImpl<llvm::Instruction *> &Accesses,
+    const llvm::DataLayout &DL) {
+  bool Res = false;
+  llvm::SmallPtrSet<llvm::Instruction *, 16> ToLog;
+  for (auto I : Accesses) {
+    llvm::Value *Addr = llvm::isa<llvm::StoreInst>(*I)
+        ? llvm::cast<llvm::StoreInst>(I)->getPointerOperand()
+        : llvm::cast<llvm::LoadInst>(I)->getPointerOperand();
+    if (isVtableAccess(I) || Addr->isSwiftError() ||
+        isRangeAccess(Addr, DL))
+      Res |= instrumentLoadOrStore(I, DL);
+    else
+      ToLog.insert(I);
+  }
+  if (ToLog.empty())
+    return Res;
+
+  // the flush calls: (instruction to flush before, number of records)
+  llvm::SmallVector<std::pair<llvm::Instruction *, unsigned>, 16> Flushes;
+  for (auto &BB : F) {
+    unsigned Slot = 0;
+    for (auto &Inst : BB) {
+      bool IsCall = (llvm::isa<llvm::CallInst>(Inst) &&
+                     !llvm::isa<llvm::DbgInfoIntrinsic>(Inst)) ||
+                    llvm::isa<llvm::InvokeInst>(Inst);
+      if (Slot > 0 && (IsCall || Inst.isTerminator() || isAtomic(&Inst))) {
+        Flushes.push_back(std::make_pair(&Inst, Slot));
+        Slot = 0;
+      }
+      if (!ToLog.count(&Inst))
+        continue;
+      logAccess(&Inst, Slot++, DL);
+      if (Slot == tasksan::ACCESS_BUFFER_SIZE) {
+        Flushes.push_back(std::make_pair(Inst.getNextNode(), Slot));
+        Slot = 0;
+      }
+    }
+  }
+
+  for (auto &Flush : Flushes) {
+    llvm::Instruction *At = Flush.first;
+    if (ClFastPathGuard)
+      At = insertFastPathGuard(At);
+    llvm::IRBuilder<> IRB(At);
+    IRB.CreateCall(TsanFlushAccesses,
+                   {IRB.getInt32(Flush.second),
+                    IRB.CreatePointerCast(funcNamePtr, IRB.getInt8PtrTy())});
+  }
+  return true;
+}
+
+// Emits an inline check of the thread-local runtime state word before
+// access "I". Returns the terminator of the block, taken only if the
+// thread checks accesses, where the callback is to be inserted.
+llvm::Instruction *TaskSanitizer::insertFastPathGuard(llvm::Instruction *I) {
+  llvm::IRBuilder<> IRB(I);
+  llvm::Value *State =
+      IRB.CreateLoad(IRB.getInt32Ty(), TsanState, "tasksan.state");
+  llvm::Value *Checking =
+      IRB.CreateICmpEQ(State, IRB.getInt32(tasksan::STATE_CHECKING));
+  return llvm::SplitBlockAndInsertIfThen(
+      Checking, I, false,
+      llvm::MDBuilder(I->getContext()).createBranchWeights(1, 1000));
+}
+
 static llvm::ConstantInt *createOrdering(llvm::IRBuilder<> *IRB, llvm::AtomicOrdering ord) {
   uint32_t v = 0;
   switch (ord) {
@@ -657,6 +1337,10 @@ bool TaskSanitizer::instrumentMemIntrinsic(llvm::Instruction *I) {
 
 bool TaskSanitizer::instrumentAtomic(llvm::Instruction *I, const llvm::DataLayout &DL) {
   llvm::IRBuilder<> IRB(I);
+  // source location of the access, passed to the runtime like for
+  // plain loads and stores
+  llvm::Value *LineNo = tasksan::debug::getLineNumber(I);
+  llvm::Value *FuncName = IRB.CreatePointerCast(funcNamePtr, IRB.getInt8PtrTy());
   if (llvm::LoadInst *LI = llvm::dyn_cast<llvm::LoadInst>(I)) {
     llvm::Value *Addr = LI->getPointerOperand();
     int Idx = getMemoryAccessFuncIndex(Addr, DL);
@@ -667,7 +1351,8 @@ bool TaskSanitizer::instrumentAtomic(llvm::Instruction *I, const llvm::DataLayou
     llvm::Type *Ty = llvm::Type::getIntNTy(IRB.getContext(), BitSize);
     llvm::Type *PtrTy = Ty->getPointerTo();
     llvm::Value *Args[] = {IRB.CreatePointerCast(Addr, PtrTy),
-                     createOrdering(&IRB, LI->getOrdering())};
+                     createOrdering(&IRB, LI->getOrdering()),
+                     LineNo, FuncName};
     llvm::Type *OrigTy = llvm::cast<llvm::PointerType>(Addr->getType())->getElementType();
     llvm::Value *C = IRB.CreateCall(TsanAtomicLoad[Idx], Args);
     llvm::Value *Cast = IRB.CreateBitOrPointerCast(C, OrigTy);
@@ -683,7 +1368,8 @@ bool TaskSanitizer::instrumentAtomic(llvm::Instruction *I, const llvm::DataLayou
     llvm::Type *PtrTy = Ty->getPointerTo();
     llvm::Value *Args[] = {IRB.CreatePointerCast(Addr, PtrTy),
                      IRB.CreateBitOrPointerCast(SI->getValueOperand(), Ty),
-                     createOrdering(&IRB, SI->getOrdering())};
+                     createOrdering(&IRB, SI->getOrdering()),
+                     LineNo, FuncName};
     llvm::CallInst *C = llvm::CallInst::Create(TsanAtomicStore[Idx], Args);
     ReplaceInstWithInst(I, C);
   } else if (llvm::AtomicRMWInst *RMWI = llvm::dyn_cast<llvm::AtomicRMWInst>(I)) {
@@ -700,7 +1386,8 @@ bool TaskSanitizer::instrumentAtomic(llvm::Instruction *I, const llvm::DataLayou
     llvm::Type *PtrTy = Ty->getPointerTo();
     llvm::Value *Args[] = {IRB.CreatePointerCast(Addr, PtrTy),
                      IRB.CreateIntCast(RMWI->getValOperand(), Ty, false),
-                     createOrdering(&IRB, RMWI->getOrdering())};
+                     createOrdering(&IRB, RMWI->getOrdering()),
+                     LineNo, FuncName};
     llvm::CallInst *C = llvm::CallInst::Create(F, Args);
     ReplaceInstWithInst(I, C);
   } else if (llvm::AtomicCmpXchgInst *CASI = llvm::dyn_cast<llvm::AtomicCmpXchgInst>(I)) {
@@ -720,7 +1407,8 @@ bool TaskSanitizer::instrumentAtomic(llvm::Instruction *I, const llvm::DataLayou
                      CmpOperand,
                      NewOperand,
                      createOrdering(&IRB, CASI->getSuccessOrdering()),
-                     createOrdering(&IRB, CASI->getFailureOrdering())};
+                     createOrdering(&IRB, CASI->getFailureOrdering()),
+                     LineNo, FuncName};
     llvm::CallInst *C = IRB.CreateCall(TsanAtomicCAS[Idx], Args);
     llvm::Value *Success = IRB.CreateICmpEQ(C, CmpOperand);
     llvm::Value *OldVal = C;
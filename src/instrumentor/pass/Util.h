@@ -16,6 +16,7 @@
 #define _INSTRUMENTOR_PASS_UTIL_H_
 
 #include "instrumentor/pass/LLVMLibs.h" // the LLVM includes put there
+#include "common/Suppressions.h"
 
 /// general namespace for TaskSanitizer tool
 namespace tasksan {
@@ -39,20 +40,8 @@ llvm::StringRef tokenReceivingFunc;
 // function signature of a task body
 llvm::StringRef taskSignature = "task";
 
-bool DontInstrument(llvm::StringRef name) {
-  int status = -1;
-  std::string name_(name.str());
-  char* d =abi::__cxa_demangle(name_.c_str(), nullptr, nullptr, &status);
-  if (! status) {
-    llvm::StringRef ab(d);
-    std::string dname(d);
-    //errs() << ab << "\n";
-    if (dname.find("genmat") != std::string::npos) {
-      return true;
-    }
-  }
-  return false;
-}
+// rules of the suppression file given with -tasksan-suppressions
+tasksan::suppress::SuppressionList suppressions;
 
 llvm::StringRef demangleName(llvm::StringRef name) {
   int status = -1;
@@ -76,6 +65,15 @@ std::string Demangle(llvm::StringRef name) {
   return name;
 }
 
+/**
+ * Checks if the suppressions cover all lines of function "name"
+ * defined in file "fileName".
+ */
+bool DontInstrument(llvm::StringRef name, const std::string & fileName) {
+  return !suppressions.empty() &&
+         suppressions.suppressesFunction(Demangle(name), fileName);
+}
+
 llvm::StringRef getPlainFuncName(llvm::Function & F) {
   llvm::StringRef name = tasksan::util::demangleName(F.getName());
   auto idx = name.find('(');
@@ -94,6 +92,19 @@ bool isMainFunction(llvm::Function &F ) {
    return tasksan::util::getPlainFuncName(F) == "main";
 }
 
+/**
+ * Returns the object pointer "V" is derived from by casts and GEPs,
+ * e.g. the global variable of an access to an element of it.
+ */
+const llvm::Value * getPointerBase(const llvm::Value * V) {
+  while (true) {
+    V = V->stripPointerCasts();
+    auto *GEP = llvm::dyn_cast<llvm::GEPOperator>(V);
+    if (!GEP) return V;
+    V = GEP->getPointerOperand();
+  }
+}
+
 bool isTaskBodyFunction(llvm::StringRef name) {
 
   int status = -1;
@@ -0,0 +1,108 @@
+/////////////////////////////////////////////////////////////////
+//  TaskSanitizer: a lightweight determinacy race checking
+//          tool for OpenMP task applications
+//
+//    Copyright (c) 2015 - 2018 Hassan Salehe Matar
+//      Copying or using this code by any means whatsoever
+//      without consent of the owner is strictly prohibited.
+//
+//   Contact: hassansalehe-at-gmail-dot-com
+//
+/////////////////////////////////////////////////////////////////
+#include "detector/commutativity/CommutativityChecker.h"
+#include <cassert>
+#include <fstream>
+#include <iostream>
+
+const std::string counterFile = "/tmp/tasksan_unittest_counter.cc.iir";
+const std::string scaleFile   = "/tmp/tasksan_unittest_scale.cc.iir";
+
+// logs one critical section of function "name" as the pass does
+void logSection(std::ofstream & iir, const std::string & name,
+                const std::vector<std::string> & body) {
+  iir << tasksan::getFunctionSignature() << name << "\n"
+      << tasksan::getStartCriticalSignature() << "\n";
+  for (auto & statement : body) iir << statement << "\n";
+  iir << tasksan::getEndCriticalSignature() << "\n";
+}
+
+Conflict makeConflict(const std::string & func1, INTEGER line1,
+                      const std::string & func2, INTEGER line2) {
+  Action action1(1, (ADDRESS)0x10, 0, line1, 1);
+  Action action2(2, (ADDRESS)0x10, 0, line2, 2);
+  action1.funcName = func1;
+  action2.funcName = func2;
+  action1.isWrite = action2.isWrite = true;
+  return Conflict(action1, action2);
+}
+
+int main() {
+  // the def-use graph of "counter = min(counter, x)"
+  std::vector<Instruction> minimum = {
+    Instruction("%1 = load i32, i32* @counter, align 4"),
+    Instruction("%2 = icmp slt i32 %1, %x"),
+    Instruction("%3 = select i1 %2, i32 %1, i32 %x"),
+    Instruction("store i32 %3, i32* @counter, align 4") };
+  for (size_t i = 0; i < minimum.size(); i++) minimum[i].lineNo = 5;
+  tasksan::commute::DefUseGraph graph;
+  graph.build(minimum);
+  assert(graph.getLastOnLine(5) == 3);
+  assert(graph.getLastOnLine(6) == -1);
+  assert(graph.getNode(2).oper == MIN);
+  assert(graph.getNode(3).oper == STORE);
+  assert(graph.getValue(graph.getNode(2).destination).definition == 2);
+
+  std::ofstream counter(counterFile);
+  logSection(counter, "inc", {
+    "10: %1 = load i32, i32* @counter, align 4",
+    "10: %2 = add nsw i32 %1, 1",
+    "10: store i32 %2, i32* @counter, align 4" });
+  logSection(counter, "dec", {
+    "20: %1 = load i32, i32* @counter, align 4",
+    "20: %2 = sub nsw i32 %1, 1",
+    "20: store i32 %2, i32* @counter, align 4" });
+  logSection(counter, "reset", {
+    "30: %1 = call i32 @next()",
+    "30: store i32 %1, i32* @counter, align 4" });
+  counter.close();
+
+  // a function of the same name in another module
+  std::ofstream scale(scaleFile);
+  logSection(scale, "inc", {
+    "10: %1 = load i32, i32* @total, align 4",
+    "10: %2 = mul nsw i32 %1, 2",
+    "10: store i32 %2, i32* @total, align 4" });
+  scale.close();
+
+  CommutativityChecker::registerIIRfile(counterFile.c_str(), "inc");
+  CommutativityChecker::registerIIRfile(counterFile.c_str(), "dec");
+  CommutativityChecker::registerIIRfile(counterFile.c_str(), "reset");
+  CommutativityChecker::registerIIRfile(scaleFile.c_str(), "inc");
+  CommutativityChecker::registerIIRfile(counterFile.c_str(), "inc");
+
+  CommutativityChecker checker;
+  // additions and subtractions commute
+  assert(checker.isCommutative(makeConflict("inc", 10, "dec", 20),
+                               counterFile, counterFile));
+  assert(checker.isCommutative(makeConflict("inc", 10, "inc", 10),
+                               counterFile, counterFile));
+  // a multiplication does not commute with an addition, and each
+  // function is looked up in the file of its module
+  assert(!checker.isCommutative(makeConflict("inc", 10, "inc", 10),
+                                scaleFile, counterFile));
+  assert(checker.isCommutative(makeConflict("inc", 10, "inc", 10),
+                               scaleFile, scaleFile));
+  // values of calls are unknown
+  assert(!checker.isCommutative(makeConflict("reset", 30, "inc", 10),
+                                counterFile, counterFile));
+  // functions or lines outside critical sections
+  assert(!checker.isCommutative(makeConflict("dec", 20, "dec", 20),
+                                scaleFile, scaleFile));
+  assert(!checker.isCommutative(makeConflict("inc", 11, "inc", 10),
+                                counterFile, counterFile));
+
+  remove(counterFile.c_str());
+  remove(scaleFile.c_str());
+  std::cout << "commutativity verdicts checked" << std::endl;
+  return 0;
+}
@@ -0,0 +1,48 @@
+/////////////////////////////////////////////////////////////////
+//  TaskSanitizer: a lightweight determinacy race checking
+//          tool for OpenMP task applications
+//
+//    Copyright (c) 2015 - 2018 Hassan Salehe Matar
+//      Copying or using this code by any means whatsoever
+//      without consent of the owner is strictly prohibited.
+//
+//   Contact: hassansalehe-at-gmail-dot-com
+//
+/////////////////////////////////////////////////////////////////
+#include "detector/determinacy/lockSets.h"
+#include <cassert>
+#include <iostream>
+
+int main() {
+  LockSets lockSets;
+  assert(!lockSets.isTracking());
+
+  // sets are interned: the same locks in any order get the same ID
+  int a = lockSets.acquire(LockSets::EMPTY, 0xa0);
+  int ab = lockSets.acquire(a, 0xb0);
+  int b = lockSets.acquire(LockSets::EMPTY, 0xb0);
+  assert(lockSets.isTracking());
+  assert(a != LockSets::EMPTY && a != ab && a != b);
+  assert(lockSets.acquire(b, 0xa0) == ab);
+  assert(lockSets.acquire(ab, 0xa0) == ab);   // held already
+
+  // releasing returns to the set without the lock
+  assert(lockSets.release(ab, 0xb0) == a);
+  assert(lockSets.release(a, 0xa0) == LockSets::EMPTY);
+  assert(lockSets.release(a, 0xc0) == a);     // not held
+
+  // protection needs a common lock
+  int c = lockSets.acquire(LockSets::EMPTY, 0xc0);
+  assert(lockSets.shareLock(a, ab));
+  assert(lockSets.shareLock(ab, b));
+  assert(lockSets.shareLock(a, a));
+  assert(!lockSets.shareLock(a, b));
+  assert(!lockSets.shareLock(c, ab));
+  assert(!lockSets.shareLock(LockSets::EMPTY, LockSets::EMPTY));
+  assert(!lockSets.shareLock(a, LockSets::EMPTY));
+  // cached answers are the same in either order
+  assert(lockSets.shareLock(b, ab) && !lockSets.shareLock(b, a));
+
+  std::cout << "lock sets checked" << std::endl;
+  return 0;
+}
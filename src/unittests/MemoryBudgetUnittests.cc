@@ -0,0 +1,94 @@
+/////////////////////////////////////////////////////////////////
+//  TaskSanitizer: a lightweight determinacy race checking
+//          tool for OpenMP task applications
+//
+//    Copyright (c) 2015 - 2018 Hassan Salehe Matar
+//      Copying or using this code by any means whatsoever
+//      without consent of the owner is strictly prohibited.
+//
+//   Contact: hassansalehe-at-gmail-dot-com
+//
+/////////////////////////////////////////////////////////////////
+#include "detector/determinacy/checker.h"
+#include <cassert>
+#include <iostream>
+#include <sstream>
+
+const ulong CELLS = 1 << 16;
+long memory[CELLS];
+
+int main() {
+  unsetenv("TASKSAN_MEMORY_LIMIT");
+  MemoryBudget unlimited;
+  assert(unlimited.isUnlimited() && !unlimited.isExceeded(~0ul - 1));
+
+  setenv("TASKSAN_MEMORY_LIMIT", "1M", 1);
+  const ulong limit = 1 << 20;
+  MemoryBudget budget;
+  assert(!budget.isUnlimited());
+
+  // stages start at 60%, 75% and 90% of the limit
+  assert(budget.getThreshold(MemoryBudget::SHORT_HISTORY) == limit / 10 * 6);
+  assert(budget.getThreshold(MemoryBudget::EVICTING) == limit / 4 * 3);
+  assert(budget.getThreshold(MemoryBudget::SAMPLING) == limit / 10 * 9);
+  assert(!budget.isExceeded(limit / 2));
+  assert(budget.isExceeded(limit / 10 * 6));
+
+  // each step moves to the next check: the next stage, then a
+  // twentieth more memory once evicting
+  budget.degrade(MemoryBudget::SHORT_HISTORY, "shortened", limit / 10 * 6);
+  budget.setNextCheck(limit / 10 * 6);
+  assert(!budget.isExceeded(limit / 10 * 7));
+  assert(budget.isExceeded(limit / 4 * 3));
+  budget.degrade(MemoryBudget::EVICTING, "evicted", limit / 4 * 3);
+  budget.setNextCheck(limit / 4 * 3);
+  assert(!budget.isExceeded(limit / 4 * 3 + limit / 40));
+  assert(budget.isExceeded(limit / 4 * 3 + limit / 20));
+  // stages never go back
+  budget.degrade(MemoryBudget::SHORT_HISTORY, "shortened", limit / 2);
+  assert(budget.getStage() == MemoryBudget::EVICTING);
+
+  // partitions get a share of the limit, and merging keeps the steps
+  MemoryBudget partition;
+  partition.share(4);
+  assert(partition.getThreshold(MemoryBudget::SAMPLING) ==
+         limit / 4 / 10 * 9);
+  partition.degrade(MemoryBudget::SAMPLING, "sampled", limit / 4);
+  budget.merge(partition);
+  assert(budget.getStage() == MemoryBudget::SAMPLING);
+  std::ostringstream summary;
+  budget.printSummary(summary);
+  assert(summary.str().find("1 MB, degraded checking") !=
+         std::string::npos);
+  assert(summary.str().find("sampled") != std::string::npos);
+  partition.disable();
+  assert(partition.isUnlimited());
+
+  // a checker far over its limit degrades instead of failing, and
+  // still finds races on cells it records
+  setenv("TASKSAN_MEMORY_LIMIT", "256K", 1);
+  Checker checker;
+  checker.registerFuncSignature("f", 1);
+  checker.onTaskCreate(0);
+  checker.saveHappensBeforeEdge(0, 1);
+  checker.saveHappensBeforeEdge(0, 2);
+  for (ulong cell = 0; cell < CELLS; cell++) {
+    for (int task = 1; task <= 2; task++) {
+      Action action(task, (ADDRESS)&memory[cell], task, 10, 1);
+      action.size = sizeof(long);
+      action.isWrite = true;
+      checker.saveTaskActions( MemoryActions(action) );
+    }
+  }
+  assert(ShadowMemory::get().getBytesInUse() < 2 * (256 << 10));
+  assert(!checker.getConflicts().empty());
+
+  std::ostringstream report;
+  std::streambuf * console = std::cout.rdbuf( report.rdbuf() );
+  checker.reportConflicts();
+  std::cout.rdbuf( console );
+  assert(report.str().find("256 KB, degraded checking") != std::string::npos);
+
+  std::cout << "stages of the memory budget checked" << std::endl;
+  return 0;
+}
@@ -0,0 +1,73 @@
+/////////////////////////////////////////////////////////////////
+//  TaskSanitizer: a lightweight determinacy race checking
+//          tool for OpenMP task applications
+//
+//    Copyright (c) 2015 - 2018 Hassan Salehe Matar
+//      Copying or using this code by any means whatsoever
+//      without consent of the owner is strictly prohibited.
+//
+//   Contact: hassansalehe-at-gmail-dot-com
+//
+/////////////////////////////////////////////////////////////////
+#include "detector/determinacy/checker.h"
+#include <cassert>
+#include <iostream>
+
+alignas(SHADOW_CELL_SIZE) char memory[64];
+
+void access(Checker & checker, INTEGER task, ulong offset, uint size,
+            bool isWrite) {
+  Action action(task, (ADDRESS)(memory + offset), task, 10 + task, 1);
+  action.size = size;
+  action.isWrite = isWrite;
+  checker.saveTaskActions( MemoryActions(action) );
+}
+
+ulong countConflicts(Checker & checker) {
+  ulong count = 0;
+  for (auto & lines : checker.getConflicts()) count += lines.second.size();
+  return count;
+}
+
+int main() {
+  Checker checker;
+  checker.registerFuncSignature("f", 1);
+  checker.onTaskCreate(0);
+  for (int task = 1; task <= 8; task++) {
+    checker.saveHappensBeforeEdge(0, task);
+  }
+
+  // different bytes of one cell do not conflict
+  access(checker, 1, 0, 4, true);
+  access(checker, 2, 4, 4, true);
+  assert(countConflicts(checker) == 0);
+
+  // overlapping bytes do
+  access(checker, 1, 8, 4, true);
+  access(checker, 2, 11, 2, false);
+  assert(countConflicts(checker) == 1);
+
+  // an access spanning two cells is checked in both, per byte
+  access(checker, 3, 20, 8, true);
+  access(checker, 4, 16, 4, true);
+  assert(countConflicts(checker) == 1);
+  access(checker, 4, 26, 1, true);
+  assert(countConflicts(checker) == 2);
+
+  // clearing part of a cell keeps the history of its other bytes
+  access(checker, 5, 32, 8, true);
+  checker.clearRange((ADDRESS)(memory + 36), 4);
+  access(checker, 6, 36, 4, true);
+  assert(countConflicts(checker) == 2);
+  access(checker, 6, 32, 1, false);
+  assert(countConflicts(checker) == 3);
+
+  // clearing all bytes of a cell drops its history
+  access(checker, 7, 40, 8, true);
+  checker.clearRange((ADDRESS)(memory + 40), 8);
+  access(checker, 8, 40, 8, true);
+  assert(countConflicts(checker) == 3);
+
+  std::cout << "byte masks of shadow cells checked" << std::endl;
+  return 0;
+}
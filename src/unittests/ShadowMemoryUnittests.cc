@@ -0,0 +1,63 @@
+/////////////////////////////////////////////////////////////////
+//  TaskSanitizer: a lightweight determinacy race checking
+//          tool for OpenMP task applications
+//
+//    Copyright (c) 2015 - 2018 Hassan Salehe Matar
+//      Copying or using this code by any means whatsoever
+//      without consent of the owner is strictly prohibited.
+//
+//   Contact: hassansalehe-at-gmail-dot-com
+//
+/////////////////////////////////////////////////////////////////
+#include "detector/determinacy/shadowMemory.h"
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+int main() {
+  ShadowMemory & memory = ShadowMemory::get();
+  const ulong SIZE_CLASS = ShadowMemory::SIZE_CLASS;
+  assert(memory.getBytesInUse() == 0);
+
+  // small sizes are rounded up to their size class
+  void * tiny = memory.allocate(1);
+  assert(memory.getBytesInUse() == SIZE_CLASS);
+  void * small = memory.allocate(SIZE_CLASS + 1);
+  assert(memory.getBytesInUse() == 3 * SIZE_CLASS);
+  assert((ulong)tiny % SIZE_CLASS == 0 && (ulong)small % SIZE_CLASS == 0);
+  memset(small, 0xff, SIZE_CLASS + 1);
+
+  // freed blocks are reused by their own size class only
+  memory.deallocate(small, SIZE_CLASS + 1);
+  assert(memory.getBytesInUse() == SIZE_CLASS);
+  void * other = memory.allocate(SIZE_CLASS);
+  assert(other != small);
+  assert(memory.allocate(2 * SIZE_CLASS) == small);
+  memory.deallocate(small, 2 * SIZE_CLASS);
+  memory.deallocate(other, SIZE_CLASS);
+  memory.deallocate(tiny, 1);
+  assert(memory.getBytesInUse() == 0);
+
+  // large ones are mapped alone, in whole pages
+  ulong large = ShadowMemory::MAX_SMALL_SIZE + 1;
+  void * block = memory.allocate(large);
+  assert(memory.getBytesInUse() == (ulong)getpagesize());
+  assert((ulong)block % getpagesize() == 0);
+  memset(block, 0xff, large);
+  memory.deallocate(block, large);
+  assert(memory.getBytesInUse() == 0);
+
+  // a thread with memory of its own does not use the shared memory
+  std::thread worker([&memory] {
+    ShadowMemory::useThreadMemory();
+    assert(&ShadowMemory::get() != &memory);
+    ShadowMemory::get().allocate(SIZE_CLASS);
+    assert(ShadowMemory::get().getBytesInUse() == SIZE_CLASS);
+  });
+  worker.join();
+  assert(memory.getBytesInUse() == 0);
+
+  std::cout << "size classes of shadow memory checked" << std::endl;
+  return 0;
+}
@@ -0,0 +1,69 @@
+/////////////////////////////////////////////////////////////////
+//  TaskSanitizer: a lightweight determinacy race checking
+//          tool for OpenMP task applications
+//
+//    Copyright (c) 2015 - 2018 Hassan Salehe Matar
+//      Copying or using this code by any means whatsoever
+//      without consent of the owner is strictly prohibited.
+//
+//   Contact: hassansalehe-at-gmail-dot-com
+//
+/////////////////////////////////////////////////////////////////
+#include "instrumentor/eventlogger/SiteSampler.h"
+#include <cassert>
+#include <sstream>
+#include <string>
+#include <thread>
+
+const int VISITS = 1 << 16;
+
+/** Returns the decisions of the calling thread for a site */
+std::string decide(INTEGER funcID, INTEGER lineNo, int visits) {
+  std::string decisions;
+  for (int i = 0; i < visits; i++) {
+    decisions += SiteSampler::shouldCheck(funcID, lineNo) ? '1' : '0';
+  }
+  return decisions;
+}
+
+int main() {
+  setenv("TASKSAN_SAMPLE_RATE", "0.001", 1);
+  setenv("TASKSAN_SAMPLE_SEED", "7", 1);
+  assert(SiteSampler::isSampling());
+
+  // a new site is checked in full for a burst, then less and less
+  std::string decisions = decide(1, 10, VISITS);
+  const std::string burst(SiteSampler::SAMPLE_BURST, '1');
+  assert(decisions.compare(0, burst.size(), burst) == 0);
+  int checks = std::count(decisions.begin(), decisions.end(), '1');
+  int lateChecks = std::count(decisions.end() - VISITS / 2,
+                              decisions.end(), '1');
+  assert(checks < VISITS / 100);
+  assert(lateChecks > 0 && lateChecks < VISITS / 200);
+
+  // other sites keep rates of their own
+  assert(decide(2, 10, burst.size()) == burst);
+  assert(decide(1, 11, burst.size()) == burst);
+
+  // a race restores checking in full for another burst
+  SiteSampler::noteRace(1, 10);
+  assert(decide(1, 10, burst.size()) == burst);
+  assert(decide(1, 10, VISITS / 2).find('0') != std::string::npos);
+
+  // a thread with the same seed and visits makes the same decisions
+  std::string other;
+  std::thread worker([&other] { other = decide(1, 10, VISITS); });
+  worker.join();
+  assert(other == decisions);
+
+  // threads which exited are counted
+  std::ostringstream stats;
+  SiteSampler::printStats(stats);
+  std::string expected = " of " + std::to_string(5 * VISITS / 2 + 3 *
+                                                 burst.size()) + " ";
+  assert(stats.str().find(expected) != std::string::npos);
+  assert(stats.str().find("TASKSAN_SAMPLE_SEED=7") != std::string::npos);
+
+  std::cout << "sampling bursts and backoff checked" << std::endl;
+  return 0;
+}
@@ -0,0 +1,106 @@
+/////////////////////////////////////////////////////////////////
+//  TaskSanitizer: a lightweight determinacy race checking
+//          tool for OpenMP task applications
+//
+//    Copyright (c) 2015 - 2018 Hassan Salehe Matar
+//      Copying or using this code by any means whatsoever
+//      without consent of the owner is strictly prohibited.
+//
+//   Contact: hassansalehe-at-gmail-dot-com
+//
+/////////////////////////////////////////////////////////////////
+#include "common/Suppressions.h"
+#include <cassert>
+#include <cstdio>
+#include <iostream>
+
+using namespace tasksan::suppress;
+
+const char * FILE_NAME = "/tmp/tasksan_unittest.supp";
+
+/** Loads "rules" into "list", returning what load returns */
+bool load(const std::string & rules, SuppressionList & list,
+          std::string & error) {
+  std::ofstream(FILE_NAME) << rules;
+  bool loaded = list.load(FILE_NAME, error);
+  remove(FILE_NAME);
+  return loaded;
+}
+
+int main() {
+  // globs
+  assert(matchGlob("", ""));
+  assert(matchGlob("*", ""));
+  assert(matchGlob("*", "anything"));
+  assert(matchGlob("f?o", "foo"));
+  assert(!matchGlob("f?o", "fo"));
+  assert(matchGlob("ns::*::f", "ns::A::B::f"));
+  assert(!matchGlob("ns::*::f", "ns::A::g"));
+  assert(matchGlob("*a*b", "xaxbxab"));
+  assert(!matchGlob("*a*b", "xaxbxa"));
+  assert(matchGlob("/src/*.cc", "/src/dir/file.cc"));
+  assert(!matchGlob("abc", "ab"));
+  assert(!matchGlob("ab", "abc"));
+  assert(matchGlob("ab**", "ab"));
+
+  // rules, with comments, blank lines and trailing spaces
+  SuppressionList list;
+  std::string error;
+  assert(list.empty());
+  assert(load("# comment\n"
+              "\n"
+              "  fun:quiet*  \r\n"
+              "fun:ns::noisy:20-29\n"
+              "fun:ns::once:7\n"
+              "src:/lib/*.c\n"
+              "src:/app/main.cc:100\n", list, error));
+  assert(!list.empty() && error.empty());
+
+  assert(list.suppressesFunction("quietly", "/app/a.cc"));
+  assert(list.suppressesFunction("f", "/lib/x.c"));
+  assert(!list.suppressesFunction("ns::noisy", "/app/a.cc"));
+  assert(!list.suppressesFunction("main", "/app/main.cc"));
+
+  assert(list.suppressesLine("ns::noisy", "/app/a.cc", 20));
+  assert(list.suppressesLine("ns::noisy", "/app/a.cc", 29));
+  assert(!list.suppressesLine("ns::noisy", "/app/a.cc", 30));
+  assert(list.suppressesLine("ns::once", "/app/a.cc", 7));
+  assert(!list.suppressesLine("ns::once", "/app/a.cc", 8));
+  assert(list.suppressesLine("main", "/app/main.cc", 100));
+  assert(!list.suppressesLine("main", "/app/main.cc", 101));
+  assert(list.suppressesLine("quietly", "/app/a.cc", 1));
+
+  // the runtime compiles fun: rules only
+  SiteBitmap bitmap;
+  assert(list.compileFunction("ns::noisy", bitmap));
+  assert(!bitmap.allLines);
+  assert(!bitmap.test(19) && bitmap.test(20) && bitmap.test(29));
+  assert(!bitmap.test(30) && !bitmap.test(1000));
+  SiteBitmap all;
+  assert(list.compileFunction("quiet", all));
+  assert(all.allLines && all.test(123456));
+  SiteBitmap none;
+  assert(!list.compileFunction("main", none));
+  assert(!none.test(100));
+  SiteBitmap wide;
+  wide.set(60, 130);
+  assert(!wide.test(59) && wide.test(63) && wide.test(64));
+  assert(wide.test(130) && !wide.test(131));
+
+  // malformed rules are reported with their line
+  const char * bad[] = { "quiet*\n", "fun:\n", "fun::10\n",
+                         "fun:f:0\n", "fun:f:9-3\n", "fun:f:3-\n",
+                         "src:a.c:1-2-3\n" };
+  for (const char * rule : bad) {
+    SuppressionList rejected;
+    error.clear();
+    assert(!load(std::string("# comment\n") + rule, rejected, error));
+    assert(error.find(std::string(FILE_NAME) + ":2: bad rule") == 0);
+  }
+  SuppressionList missing;
+  assert(!missing.load("/nonexistent/tasksan.supp", error));
+  assert(error == "cannot read /nonexistent/tasksan.supp");
+
+  std::cout << "globs and suppression rules checked" << std::endl;
+  return 0;
+}
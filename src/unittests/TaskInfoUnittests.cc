@@ -0,0 +1,74 @@
+/////////////////////////////////////////////////////////////////
+//  TaskSanitizer: a lightweight determinacy race checking
+//          tool for OpenMP task applications
+//
+//    Copyright (c) 2015 - 2018 Hassan Salehe Matar
+//      Copying or using this code by any means whatsoever
+//      without consent of the owner is strictly prohibited.
+//
+//   Contact: hassansalehe-at-gmail-dot-com
+//
+/////////////////////////////////////////////////////////////////
+#include "instrumentor/eventlogger/TaskInfo.h"
+#include <cassert>
+#include <iostream>
+
+typedef TaskInfo::DeferredAccess Access;
+
+void defer(TaskInfo & task, ulong addr, ulong size,
+           Access::Kind kind, INTEGER value = 0) {
+  task.memoryLocations.push_back(
+      Access{ addr, size, value, 1, 1, 0, kind, 0 } );
+}
+
+bool isKept(TaskInfo & task, ulong addr, ulong size, Access::Kind kind) {
+  for (const Access & access : task.memoryLocations) {
+    if (access.addr == addr && access.size == size && access.kind == kind)
+      return true;
+  }
+  return false;
+}
+
+int main() {
+  // the first read and the last write per address and size
+  TaskInfo task;
+  defer(task, 64, 8, Access::READ);
+  defer(task, 64, 8, Access::WRITE, 1);
+  defer(task, 64, 8, Access::READ);
+  defer(task, 64, 8, Access::WRITE, 2);
+  task.compactDeferred();
+  assert(task.memoryLocations.size() == 2);
+  assert(task.memoryLocations[1].kind == Access::WRITE);
+  assert(task.memoryLocations[1].value == 2);
+
+  // accesses before a free are dropped, those after it are kept
+  TaskInfo freeing;
+  defer(freeing, 128, 8, Access::WRITE);
+  defer(freeing, 128, 16, Access::FREED);
+  defer(freeing, 136, 8, Access::READ);
+  freeing.compactDeferred();
+  assert(freeing.memoryLocations.size() == 1);
+  assert(isKept(freeing, 136, 8, Access::READ));
+
+  // a range freed inside a larger one still covers the access
+  TaskInfo nested;
+  defer(nested, 20, 4, Access::WRITE);
+  defer(nested, 0, 32, Access::FREED);
+  defer(nested, 8, 4, Access::FREED);
+  nested.compactDeferred();
+  assert(nested.memoryLocations.empty());
+
+  // only the bytes of a range access which are not freed are kept
+  TaskInfo partial;
+  defer(partial, 4, 24, Access::WRITE);
+  defer(partial, 8, 4, Access::FREED);
+  defer(partial, 12, 4, Access::FREED);
+  defer(partial, 20, 16, Access::FREED);
+  partial.compactDeferred();
+  assert(partial.memoryLocations.size() == 2);
+  assert(isKept(partial, 4, 4, Access::WRITE));
+  assert(isKept(partial, 16, 4, Access::WRITE));
+
+  std::cout << "deferred accesses compacted" << std::endl;
+  return 0;
+}
@@ -0,0 +1,69 @@
+/////////////////////////////////////////////////////////////////
+//  TaskSanitizer: a lightweight determinacy race checking
+//          tool for OpenMP task applications
+//
+//    Copyright (c) 2015 - 2018 Hassan Salehe Matar
+//      Copying or using this code by any means whatsoever
+//      without consent of the owner is strictly prohibited.
+//
+//   Contact: hassansalehe-at-gmail-dot-com
+//
+/////////////////////////////////////////////////////////////////
+#include "instrumentor/eventlogger/TraceRecorder.h"
+#include "detector/offline/TraceChecker.h"
+#include <cassert>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+const int TASKS = 4; // and traces, besides that of the main thread
+const int CELLS = 1 << 14; // over many pages of history
+long shared[CELLS];
+
+/** Returns the report of checking the traces with "workers" workers */
+std::string check(uint workers) {
+  TraceChecker checker(workers);
+  for (int t = 0; t <= TASKS; t++) {
+    assert(checker.addTrace("/tmp/tasksan_unittest." + std::to_string(t) +
+                            ".trace"));
+  }
+  checker.check();
+
+  std::ostringstream report;
+  std::streambuf * console = std::cout.rdbuf( report.rdbuf() );
+  checker.reportConflicts();
+  std::cout.rdbuf( console );
+  return report.str();
+}
+
+int main() {
+  setenv("TASKSAN_RECORD", "/tmp/tasksan_unittest", 1);
+  // a limit far below what checking needs, which must not change the
+  // report with the number of workers
+  setenv("TASKSAN_MEMORY_LIMIT", "64K", 1);
+
+  // concurrent tasks, one per thread, writing and reading every cell
+  TraceRecorder::function(1, "f");
+  for (int t = 1; t <= TASKS; t++) {
+    std::thread worker([t] {
+      TraceRecorder::taskBegin(t);
+      for (int i = t % 2; i < CELLS; i += 1 + t % 3) {
+        TraceRecorder::access(t, &shared[i], 8, t != 2, t, 1, 10 + t);
+      }
+      TraceRecorder::taskEnd(t);
+    });
+    worker.join();
+  }
+  TraceRecorder::flushAll();
+
+  std::string serial = check(1);
+  assert(serial.find("conflicts") != std::string::npos);
+  assert(check(3) == serial);
+  assert(check(8) == serial);
+
+  for (int t = 0; t <= TASKS; t++) {
+    remove(("/tmp/tasksan_unittest." + std::to_string(t) + ".trace").c_str());
+  }
+  std::cout << "reports of 1, 3 and 8 workers are the same" << std::endl;
+  return 0;
+}
@@ -0,0 +1,133 @@
+/////////////////////////////////////////////////////////////////
+//  TaskSanitizer: a lightweight determinacy race checking
+//          tool for OpenMP task applications
+//
+//    Copyright (c) 2015 - 2018 Hassan Salehe Matar
+//      Copying or using this code by any means whatsoever
+//      without consent of the owner is strictly prohibited.
+//
+//   Contact: hassansalehe-at-gmail-dot-com
+//
+/////////////////////////////////////////////////////////////////
+#include "common/BlockCompressor.h"
+#include "instrumentor/eventlogger/TraceRecorder.h"
+#include "detector/offline/TraceChecker.h"
+#include <cassert>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+using namespace tasksan;
+
+/** Compresses and decompresses "block", which must come back whole */
+void roundTrip(const std::string & block) {
+  std::vector<char> compressed(
+      compress::getMaxCompressedSize(block.size()));
+  unsigned long size =
+      compress::compressBlock(block.data(), block.size(), &compressed[0]);
+  assert(size <= compressed.size());
+  std::vector<char> inflated(block.size() + 1);
+  long inflatedSize = compress::decompressBlock(&compressed[0], size,
+                                                &inflated[0], block.size());
+  assert(inflatedSize == (long)block.size());
+  assert(std::string(inflated.data(), inflatedSize) == block);
+}
+
+long shared[1 << 20];
+
+int main() {
+  // varints and zigzag values at their boundaries
+  uint64_t values[] = { 0, 1, 127, 128, 16383, 16384, 1ul << 35,
+                        ~0ul >> 1, ~0ul };
+  char buffer[16];
+  for (uint64_t value : values) {
+    char * end = trace::putVarint(buffer, value);
+    uint64_t decoded = 1;
+    assert(trace::getVarint(buffer, end, decoded) == end);
+    assert(decoded == value);
+    assert(trace::getVarint(buffer, end - 1, decoded) == NULL);
+    int64_t signedValue = (int64_t)value;
+    assert(trace::unzigzag(trace::zigzag(signedValue)) == signedValue);
+    assert(trace::unzigzag(trace::zigzag(-signedValue)) == -signedValue);
+  }
+  assert(trace::zigzag(-1) == 1 && trace::zigzag(1) == 2);
+  for (int update = ALLOCA; update <= OTHER; update++) {
+    unsigned code = trace::encodeUpdate((OPERATION)update);
+    assert(trace::decodeUpdate(code) == (OPERATION)update);
+    assert((16 | code << 5) >> 5 == code);
+  }
+  assert(trace::encodeUpdate(OTHER) == 0);
+
+  // blocks without matches, with long literals and long matches,
+  // and with matches overlapping their own output
+  roundTrip("");
+  roundTrip("abc");
+  std::string text;
+  for (int i = 0; i < 3000; i++) text += (char)(i * 7919 % 251);
+  roundTrip(text);
+  roundTrip(std::string(trace::MAX_EVENT_SIZE * 1000, 'x'));
+  roundTrip(text.substr(0, 40) + std::string(5000, 'y') + text);
+  std::string events;
+  for (int i = 0; i < 4000; i++) {
+    char event[trace::MAX_EVENT_SIZE];
+    char * end = trace::put(event, trace::EVENT_WRITE);
+    end = trace::putVarint(end, trace::zigzag(8));
+    end = trace::putVarint(end, trace::zigzag(i % 5));
+    events.append(event, end);
+  }
+  roundTrip(events);
+  std::string compressible(events);
+  std::vector<char> compressed(compress::getMaxCompressedSize(
+      compressible.size()));
+  assert(compress::compressBlock(compressible.data(), compressible.size(),
+                                 &compressed[0]) < compressible.size() / 4);
+
+  // a corrupt block is rejected
+  char corrupt[] = { (char)0x0f, 5, 0 }; // a match before any output
+  char inflated[64];
+  assert(compress::decompressBlock(corrupt, sizeof(corrupt),
+                                   inflated, sizeof(inflated)) == -1);
+
+  // compressed traces of accesses far apart, of negative values and
+  // of atomic updates decode to what was recorded
+  setenv("TASKSAN_RECORD", "/tmp/tasksan_unittest", 1);
+  setenv("TASKSAN_RECORD_COMPRESS", "1", 1);
+  TraceRecorder::function(1, "f");
+  for (uint task = 1; task <= 2; task++) {
+    std::thread worker([task] {
+      TraceRecorder::taskBegin(task);
+      TraceRecorder::access(task, &shared[1 << 19], 8, true, -5 * task, 1,
+                            10);
+      TraceRecorder::access(task, &shared[0], 8, true, task, 1, 11,
+                            ADD);
+      TraceRecorder::access(task, &shared[(1 << 20) - 1], 8, true,
+                            -(1l << 40) * task, 1, 12);
+      TraceRecorder::access(task, &shared[7], 8, false, 0, 1, 13);
+      TraceRecorder::taskEnd(task);
+    });
+    worker.join();
+  }
+  TraceRecorder::flushAll();
+
+  TraceChecker checker(2);
+  for (int t = 0; t <= 2; t++) {
+    assert(checker.addTrace("/tmp/tasksan_unittest." + std::to_string(t) +
+                            ".trace"));
+  }
+  checker.check();
+  std::ostringstream report;
+  std::streambuf * console = std::cout.rdbuf( report.rdbuf() );
+  checker.reportConflicts();
+  std::cout.rdbuf( console );
+  // the plain writes race, the additions commute and reads do not race
+  assert(report.str().find("2 task pairs") != std::string::npos);
+  assert(report.str().find("f: 11") == std::string::npos);
+  assert(report.str().find("f: 10, f: 10") != std::string::npos);
+  assert(report.str().find("f: 12, f: 12") != std::string::npos);
+
+  for (int t = 0; t <= 2; t++) {
+    remove(("/tmp/tasksan_unittest." + std::to_string(t) + ".trace").c_str());
+  }
+  std::cout << "trace encoding and compression checked" << std::endl;
+  return 0;
+}
@@ -0,0 +1,56 @@
+/////////////////////////////////////////////////////////////////
+//  TaskSanitizer: a lightweight determinacy race checking
+//          tool for OpenMP task applications
+//
+//    Copyright (c) 2015 - 2018 Hassan Salehe Matar
+//      Copying or using this code by any means whatsoever
+//      without consent of the owner is strictly prohibited.
+//
+//   Contact: hassansalehe-at-gmail-dot-com
+//
+/////////////////////////////////////////////////////////////////
+#include "instrumentor/eventlogger/TraceRecorder.h"
+#include "detector/offline/TraceChecker.h"
+#include <malloc.h>
+#include <cassert>
+#include <iostream>
+#include <thread>
+
+// records frees as the runtime does, including those of the
+// recorder itself while a thread exits
+extern "C" void __libc_free(void *ptr);
+static __thread bool isRecordingFree = false;
+
+void free(void *ptr) __THROW {
+  if (ptr && !isRecordingFree && TraceRecorder::isRecording()) {
+    isRecordingFree = true;
+    TraceRecorder::clear((ADDRESS)ptr, malloc_usable_size(ptr));
+    isRecordingFree = false;
+  }
+  __libc_free(ptr);
+}
+
+int main() {
+  setenv("TASKSAN_RECORD", "/tmp/tasksan_unittest", 1);
+  remove("/tmp/tasksan_unittest.0.trace");
+
+  // a task which frees memory on a thread which then exits
+  std::thread worker([] {
+    TraceRecorder::function(1, "f");
+    TraceRecorder::taskBegin(1);
+    long * block = (long *)malloc(64);
+    TraceRecorder::access(1, block, 8, true, 5, 1, 10);
+    free(block);
+    TraceRecorder::taskEnd(1);
+  });
+  worker.join();
+  TraceRecorder::flushAll();
+
+  TraceChecker checker(2);
+  assert(checker.addTrace("/tmp/tasksan_unittest.0.trace"));
+  checker.check();
+  checker.reportConflicts();
+  remove("/tmp/tasksan_unittest.0.trace");
+  std::cout << "trace of an exited thread checked" << std::endl;
+  return 0;
+}
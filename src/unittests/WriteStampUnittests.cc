@@ -0,0 +1,99 @@
+/////////////////////////////////////////////////////////////////
+//  TaskSanitizer: a lightweight determinacy race checking
+//          tool for OpenMP task applications
+//
+//    Copyright (c) 2015 - 2018 Hassan Salehe Matar
+//      Copying or using this code by any means whatsoever
+//      without consent of the owner is strictly prohibited.
+//
+//   Contact: hassansalehe-at-gmail-dot-com
+//
+/////////////////////////////////////////////////////////////////
+#include "detector/determinacy/checker.h"
+#include "instrumentor/eventlogger/TaskInfo.h"
+#include <cassert>
+#include <iostream>
+#include <sstream>
+
+Checker checker;
+long shared[3];
+
+/** Checks "access" of "task" at line "lineNo" as the runtime does */
+void check(TaskInfo & task, STRING access, ADDRESS addr, ulong size,
+           INTEGER value, INTEGER lineNo) {
+  std::stringstream ssin;
+  ssin << std::hex << (ulong)addr << std::dec << " " << value << " "
+       << lineNo << " 1";
+  checker.detectRaceOnMem(task.taskID, access, ssin, size,
+                          task.lockSetID);
+}
+
+/**
+ * Writes "value" to "addr" as the runtime does. Returns true if the
+ * write repeats one checked before and is skipped. */
+bool write(TaskInfo & task, INTEGER value, ADDRESS addr = &shared[0],
+           ulong size = 8, INTEGER lineNo = 10) {
+  if (task.isCheckedWrite(addr, size, value,
+                          checker.loadWriteStamp(addr))) {
+    return true;
+  }
+  check(task, "W", addr, size, value, lineNo);
+  task.noteCheckedWrite(addr, size, value,
+                        checker.getCellStamp(addr, size));
+  return false;
+}
+
+int main() {
+  // no stamps unless enabled
+  assert(checker.loadWriteStamp(&shared[0]) == 0);
+  checker.enableWriteStamps();
+  checker.registerFuncSignature("f", 1);
+  checker.onTaskCreate(0);
+  checker.saveHappensBeforeEdge(0, 1);
+  checker.saveHappensBeforeEdge(0, 2);
+  TaskInfo task1, task2;
+  task1.taskID = 1;
+  task2.taskID = 2;
+
+  // writes of one value are checked once per task
+  assert(!write(task1, 5));
+  assert(write(task1, 5));
+  assert(!write(task2, 5));
+  assert(write(task1, 5) && write(task2, 5));
+  uint64_t stamp = checker.getCellStamp(&shared[0], 8);
+  assert(stamp && checker.loadWriteStamp(&shared[0]) == stamp);
+
+  // writes of other bytes, values or locks are checked
+  assert(!write(task1, 5, &shared[2]) && write(task1, 5, &shared[2]));
+  assert(!write(task1, 5, (char *)&shared[2] + 4, 4));
+  assert(!write(task1, 6, &shared[2]));
+  task1.lockSetID = 1;
+  assert(!write(task1, 6, &shared[2]));
+  task1.lockSetID = 0;
+  assert(checker.getConflicts().empty());
+
+  // a read drops the stamp for good, and so does a race
+  assert(!write(task1, 5, &shared[1]) && write(task1, 5, &shared[1]));
+  check(task2, "R", &shared[1], 8, 0, 20);
+  assert(checker.getCellStamp(&shared[1], 8) == 0);
+  assert(!write(task1, 5, &shared[1]) && !write(task1, 5, &shared[1]));
+  assert(checker.getConflicts().size() == 1);
+
+  // clearing the history of freed memory drops the stamp, and a new
+  // history gets a new stamp
+  checker.clearRange((ADDRESS)&shared[0], sizeof(shared));
+  assert(checker.loadWriteStamp(&shared[0]) == 0);
+  assert(!write(task1, 5));
+  assert(checker.getCellStamp(&shared[0], 8) > stamp);
+  assert(write(task1, 5));
+  assert(!write(task2, 6, &shared[0], 8, 11));
+  assert(checker.getCellStamp(&shared[0], 8) == 0);
+  assert(!write(task1, 5));
+  assert(checker.getConflicts().size() == 2);
+
+  // accesses spanning two cells have no stamp
+  assert(checker.getCellStamp((char *)&shared[0] + 4, 8) == 0);
+
+  std::cout << "write stamps and their invalidation checked" << std::endl;
+  return 0;
+}